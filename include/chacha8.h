@@ -18,6 +18,26 @@ void chacha8_get_keystream(
     uint32_t n_blocks,
     uint8_t *c);
 
+/* same as chacha8_get_keystream(), 8 blocks at a time (needs AVX2, see g_cpu_kernels) */
+void chacha8_get_keystream_avx2(
+    const struct chacha8_ctx *x,
+    uint64_t pos,
+    uint32_t n_blocks,
+    uint8_t *c);
+
+/* keystream blocks at positions pos[0 .. n_blocks), see g_cpu_kernels */
+void chacha8_get_blocks_sw(
+    const struct chacha8_ctx *x,
+    const uint64_t *pos,
+    uint32_t n_blocks,
+    uint8_t *c);
+
+void chacha8_get_blocks_avx2(
+    const struct chacha8_ctx *x,
+    const uint64_t *pos,
+    uint32_t n_blocks,
+    uint8_t *c);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,228 @@
+/*
+ * BatchVerifier.hpp
+ *
+ *  Created on: Jun 23, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_BATCHVERIFIER_HPP_
+#define INCLUDE_CHIA_BATCHVERIFIER_HPP_
+
+#include <chia/phase1.hpp>
+#include <chia/blake3_short.h>
+#include <chia/util.hpp>
+
+#include "picosha2.hpp"
+
+#include <array>
+#include <vector>
+
+
+/*
+ * Validates many proofs of space (k32) at once, same checks as chia::Verifier::ValidateProof().
+ * F1 and Fx are computed table by table for all proofs, so ChaCha8 and BLAKE3 run
+ * across SIMD lanes (see g_cpu_kernels), instead of one x value / one match at a time.
+ *
+ * Smaller k (multiple of 8) are supported for testing, since a valid k32 proof needs a complete plot.
+ */
+class BatchVerifier {
+public:
+	static constexpr uint8_t default_k = 32;
+	
+	struct proof_t {
+		std::array<uint8_t, 32> id = {};
+		std::array<uint8_t, 32> challenge = {};
+		std::array<uint32_t, 64> xs = {};			// in proof order, x < 2^k
+	};
+	
+	struct result_t {
+		bool valid = false;
+		std::array<uint8_t, 32> quality = {};		// if valid
+	};
+	
+	// entry of table 1 to 7, meta data is big endian and k * kVectorLens[] bits
+	struct entry_t {
+		uint64_t y = 0;
+		uint8_t num_bytes = 0;
+		std::array<uint8_t, 16> meta = {};
+	};
+	
+	const uint8_t k;
+	
+	BatchVerifier(const uint8_t k = default_k) : k(k) {
+		if(k > 32 || k < 16 || k % 8) {
+			throw std::logic_error("BatchVerifier: invalid k = " + std::to_string(k));
+		}
+		phase1::initialize();
+	}
+	
+	// returns result for each proof, proofs of the same plot should be next to each other [thread-safe]
+	std::vector<result_t> validate(const std::vector<proof_t>& proofs) const;
+	
+	// converts 256 byte proof (see PlotReader::get_proof_bytes()) to x values
+	static std::array<uint32_t, 64> get_proof_xs(const uint8_t* proof_bytes);
+	
+	// returns quality string of a valid proof
+	static std::array<uint8_t, 32> get_quality(const proof_t& proof, const uint8_t k = default_k);
+
+private:
+	void evaluate(int table_index, const std::vector<entry_t>& in, std::vector<entry_t>& out, std::vector<result_t>& result) const;
+
+};
+
+namespace phase1 {
+
+template<>
+struct get_meta<BatchVerifier::entry_t> {
+	void operator()(const BatchVerifier::entry_t& entry, uint8_t* bytes, size_t* num_bytes) {
+		*num_bytes = entry.num_bytes;
+		memcpy(bytes, entry.meta.data(), entry.num_bytes);
+	}
+};
+
+template<>
+struct set_meta<BatchVerifier::entry_t> {
+	void operator()(BatchVerifier::entry_t& entry, const uint8_t* bytes, const size_t num_bytes) {
+		if(num_bytes > sizeof(entry.meta)) {
+			throw std::logic_error("meta data size mismatch");
+		}
+		entry.num_bytes = num_bytes;
+		memcpy(entry.meta.data(), bytes, num_bytes);
+	}
+};
+
+} // phase1
+
+
+inline
+std::vector<BatchVerifier::result_t> BatchVerifier::validate(const std::vector<proof_t>& proofs) const
+{
+	std::vector<result_t> out(proofs.size());
+	if(proofs.empty()) {
+		return out;
+	}
+	for(auto& result : out) {
+		result.valid = true;
+	}
+	std::vector<uint32_t> xs;
+	xs.reserve(proofs.size() * 64);
+	for(const auto& proof : proofs) {
+		xs.insert(xs.end(), proof.xs.begin(), proof.xs.end());
+	}
+	std::vector<phase1::entry_1> table_1(xs.size());
+	for(size_t i = 0; i < proofs.size();)
+	{
+		// one key setup for all proofs of the same plot
+		size_t end = i + 1;
+		while(end < proofs.size() && proofs[end].id == proofs[i].id) {
+			end++;
+		}
+		phase1::F1Calculator F1(proofs[i].id.data());
+		F1.compute_entries(xs.data() + i * 64, (end - i) * 64, table_1.data() + i * 64, k);
+		i = end;
+	}
+	// meta data of table 1 is x
+	std::vector<entry_t> table(table_1.size());
+	for(size_t i = 0; i < table.size(); ++i) {
+		const uint32_t tmp = bswap_32(table_1[i].x << (32 - k));
+		table[i].y = table_1[i].y;
+		table[i].num_bytes = k / 8;
+		memcpy(table[i].meta.data(), &tmp, k / 8);
+	}
+	std::vector<entry_t> next;
+	for(int table_index = 2; table_index <= 7; ++table_index) {
+		evaluate(table_index, table, next, out);
+		table.swap(next);
+	}
+	for(size_t i = 0; i < proofs.size(); ++i)
+	{
+		auto& result = out[i];
+		// f7 needs to equal the first k bits of the challenge
+		if(table[i].y != Util::EightBytesToInt(proofs[i].challenge.data()) >> (64 - k)) {
+			result.valid = false;
+		}
+		if(result.valid) {
+			result.quality = get_quality(proofs[i], k);
+		}
+	}
+	return out;
+}
+
+inline
+void BatchVerifier::evaluate(int table_index, const std::vector<entry_t>& in, std::vector<entry_t>& out, std::vector<result_t>& result) const
+{
+	phase1::FxCalculator<entry_t, entry_t> Fx(table_index, k);
+	out.resize(in.size() / 2);
+	
+	// inputs are zero padded to a full block
+	const size_t num_per_proof = out.size() / result.size();
+	std::vector<uint8_t> input(out.size() * 64);
+	std::vector<uint8_t> hash(out.size() * 32);
+	
+	size_t length = 0;
+	for(size_t i = 0; i < out.size(); ++i)
+	{
+		const auto& L = in[2 * i];
+		const auto& R = in[2 * i + 1];
+		if(!phase1::is_match(L.y, R.y)) {
+			result[i / num_per_proof].valid = false;
+		}
+		length = Fx.get_input(L, R, input.data() + i * 64);
+	}
+	blake3_hash_short(input.data(), length, out.size(), hash.data());
+	
+	for(size_t i = 0; i < out.size(); ++i) {
+		Fx.get_output(in[2 * i], in[2 * i + 1], hash.data() + i * 32, out[i]);
+	}
+}
+
+inline
+std::array<uint32_t, 64> BatchVerifier::get_proof_xs(const uint8_t* proof_bytes)
+{
+	std::array<uint32_t, 64> xs;
+	for(size_t i = 0; i < xs.size(); ++i) {
+		xs[i] = Util::SliceInt64FromBytes(proof_bytes, i * default_k, default_k);
+	}
+	return xs;
+}
+
+inline
+std::array<uint8_t, 32> BatchVerifier::get_quality(const proof_t& proof, const uint8_t k)
+{
+	auto xs = proof.xs;
+	
+	// convert to plot ordering, see chia::Verifier::GetQualityString()
+	for(int table_index = 1; table_index < 7; ++table_index)
+	{
+		const size_t size = size_t(1) << (table_index - 1);
+		for(size_t j = 0; j < xs.size(); j += 2 * size)
+		{
+			const auto L = xs.begin() + j;
+			const auto R = L + size;
+			// compare starting with the last x value
+			bool is_less = false;
+			for(size_t i = size; i-- > 0;) {
+				if(L[i] != R[i]) {
+					is_less = L[i] < R[i];
+					break;
+				}
+			}
+			if(!is_less) {
+				std::rotate(L, R, R + size);
+			}
+		}
+	}
+	// last 5 bits of challenge select the two x values
+	const uint32_t quality_index = (proof.challenge[31] & 0x1F) * 2;
+	
+	uint8_t hash_input[32 + 8] = {};
+	::memcpy(hash_input, proof.challenge.data(), 32);
+	(Bits(xs[quality_index], k) + Bits(xs[quality_index + 1], k)).ToBytes(hash_input + 32);
+	
+	std::array<uint8_t, 32> quality;
+	picosha2::hash256(hash_input, hash_input + 32 + cdiv(2 * k, 8), quality.begin(), quality.end());
+	return quality;
+}
+
+
+#endif /* INCLUDE_CHIA_BATCHVERIFIER_HPP_ */
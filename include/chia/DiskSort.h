@@ -8,6 +8,7 @@
 #ifndef INCLUDE_CHIA_DISKSORT_H_
 #define INCLUDE_CHIA_DISKSORT_H_
 
+#include <chia/codec.h>
 #include <chia/buffer.h>
 #include <chia/ThreadPool.h>
 
@@ -19,32 +20,94 @@
 #include <functional>
 
 
+/*
+ * Sorted entries split into groups of equal group key, see DiskSort::read_groups().
+ */
+template<typename T>
+struct group_batch_t {
+	struct group_t {
+		const T* data = nullptr;
+		size_t size = 0;
+		uint64_t key = 0;
+		uint64_t offset = 0;		// position of data[0] in the sorted output
+	};
+	bool has_prev = false;			// if groups[0] is the last group of the previous batch
+	std::vector<group_t> groups;
+	std::vector<std::shared_ptr<const std::vector<T>>> blocks;		// keeps group data alive
+};
+
+/*
+ * Sorted part of a bucket, see DiskSort::read_ranges().
+ */
+template<typename T>
+struct sorted_range_t {
+	size_t index = 0;			// bucket index
+	uint64_t offset = 0;		// position of data[0] in the sorted output
+	std::vector<T> data;
+};
+
 template<typename T, typename Key>
 class DiskSort {
 private:
+	static constexpr size_t run_header_size = 16;	// file index + count + CRC32C + flags (uint32)
+	static constexpr uint32_t run_flag_checksum = 1;
+	static constexpr int max_log_sub_runs = 4;			// read groups per shared file (2^x)
+	static constexpr size_t max_sub_run_size = 65535;	// sub-run counts are 16 bit
+	
+	struct run_t {
+		uint64_t offset = 0;		// file offset of first entry (after header)
+		uint32_t count = 0;
+		uint32_t checksum = 0;		// CRC32C of entries, if has_checksum
+		bool has_checksum = false;
+	};
+	
 	struct bucket_t {
+		size_t num_entries = 0;
+	};
+	
+	/*
+	 * Each file stores the buckets [first_bucket, end_bucket) as runs.
+	 * If a file has more than one bucket, its buckets are split into num_groups read groups,
+	 * and each run is written as one sub-run per group (with its own header, empty ones are skipped).
+	 * Sub-runs are stored back to back in group order, their counts are kept in sub_counts,
+	 * such that a read group can be read without reading the whole file.
+	 */
+	struct file_t {
 		FILE* file = nullptr;
 		std::mutex mutex;
 		std::string file_name;
-		size_t num_entries = 0;
+		uint64_t size = 0;
+		size_t first_bucket = 0;
+		size_t end_bucket = 0;
+		size_t num_groups = 1;
+		int group_shift = 0;				// buckets per read group (2^x)
+		size_t num_groups_read = 0;
+		bool is_preallocated = false;
+		std::vector<run_t> runs;
+		std::vector<uint16_t> sub_counts;		// [run][group], if num_groups > 1
+		std::vector<uint32_t> sub_checksums;	// [run][group], if num_groups > 1 and any run has_checksum
 		
 		void open(const char* mode);
-		void write(const void* data, size_t count);
+		void write(std::vector<bucket_t>& buckets, int bucket_shift, size_t index, const void* data, size_t count);
+		void scan(std::vector<bucket_t>& buckets, int bucket_shift, size_t index);
 		void close();
 		void remove();
 	};
 	
 public:
+	/*
+	 * Buffers entries per file, not per bucket, such that memory does not depend on the number of buckets.
+	 */
 	class WriteCache {
 	public:
-		WriteCache(DiskSort* disk, int key_shift, int num_buckets);
+		WriteCache(DiskSort* disk, int key_shift, int num_files);
 		~WriteCache() { flush(); }
 		void add(const T& entry);
 		void flush();
 	private:
 		DiskSort* disk = nullptr;
 		const int key_shift = 0;
-		std::vector<write_buffer_t<T>> buckets;
+		std::vector<write_buffer_t<T>> files;
 	};
 	
 	DiskSort(	int key_size, int log_num_buckets,
@@ -60,40 +123,151 @@ public:
 	void read(	Processor<std::vector<T>>* output,
 				int num_threads, int num_threads_read = -1);
 	
+	/*
+	 * Same as read(), but output is split into groups of equal GroupKey{}(entry),
+	 * which needs to be monotonic in Key{}(entry), for example y / kBC.
+	 * Groups are found by the sort threads, groups spanning two blocks are copied.
+	 * Each batch starts with the last group of the previous batch, such that
+	 * all pairs of neighboring groups can be processed in parallel.
+	 */
+	template<typename GroupKey>
+	void read_groups(	Processor<std::shared_ptr<const group_batch_t<T>>>* output,
+						int num_threads, int num_threads_read = -1);
+	
+	/*
+	 * Reads and sorts buckets in parallel, without any ordering between buckets.
+	 * func() is called by num_threads threads, for each bucket by one thread, in order.
+	 * Each thread needs memory for one read group, ie. a bucket, or 2^x buckets
+	 * if a file has more than 2^max_log_sub_runs buckets.
+	 */
+	void read_ranges(const std::function<void(sorted_range_t<T>&)>& func, int num_threads);
+	
+	// reserves space for an estimated total number of entries (if g_preallocate)
+	void preallocate(uint64_t num_entries);
+	
 	void finish();
 	
 	void close();
 	
 	void add(const T& entry);
 	
-	// thread safe
+	// writes a run to file index, thread safe
 	void write(size_t index, const void* data, size_t count);
 	
+	size_t num_files() const {
+		return files.size();
+	}
+	
 	std::shared_ptr<WriteCache> add_cache();
 	
 	size_t num_buckets() const {
 		return buckets.size();
 	}
 	
+	uint64_t num_entries() const {
+		uint64_t sum = 0;
+		for(const auto& bucket : buckets) {
+			sum += bucket.num_entries;
+		}
+		return sum;
+	}
+	
 	void set_keep_files(bool enable) {
 		keep_files = enable;
 	}
 	
+	/*
+	 * Keys are known to be a permutation of [0, N), like the sort keys assigned in phase 2.
+	 * Each block is then scattered by key instead of radix sorted,
+	 * blocks which turn out not to be dense are still sorted.
+	 */
+	void set_dense_keys(bool enable) {
+		dense_keys = enable;
+	}
+	
 private:
-	void read_bucket(	size_t& index,
-						std::vector<std::vector<T>>& out,
-						read_buffer_t<T>& buffer);
+	struct sorted_block_t {
+		std::shared_ptr<const std::vector<T>> data;
+		std::vector<uint32_t> groups;		// start of each group
+	};
+	
+	template<typename GroupKey>
+	class GroupSplitter : public Processor<sorted_block_t> {
+	public:
+		typedef typename group_batch_t<T>::group_t group_t;
+		
+		GroupSplitter(Processor<std::shared_ptr<const group_batch_t<T>>>* output) : output(output) {}
+		
+		// needs to be called in order, NOT thread-safe
+		void take(sorted_block_t& block) override;
+		
+		// outputs the last group
+		void flush();
+		
+	private:
+		void add_group(group_batch_t<T>& batch, const group_t& group, std::shared_ptr<const std::vector<T>> block);
+		
+	private:
+		Processor<std::shared_ptr<const group_batch_t<T>>>* output = nullptr;
+		uint64_t offset = 0;
+		group_t last;
+		group_t partial;
+		std::shared_ptr<const std::vector<T>> last_block;
+		std::shared_ptr<const std::vector<T>> partial_block;
+	};
+	
+	/*
+	 * Blocks stay packed records (T::disk_size bytes each) until sorted,
+	 * which is 1.5 to 2x less memory than T while they are queued.
+	 * Sorting uses scratch (kept per thread) as second buffer, records are freed before decoding,
+	 * such that at most two copies of a block are alive.
+	 */
+	void sort_block(std::vector<uint8_t>& records, std::vector<uint8_t>& scratch, std::vector<T>& out) const;
+	
+	static uint64_t get_key(const uint8_t* record) {
+		return disk_key_t<T, Key>::get(record);
+	}
+	
+	/*
+	 * LSD radix sort on the key bits which differ within the block.
+	 * Equal keys are ordered by their encoding, such that output does not depend on thread timing.
+	 */
+	static void radix_sort(std::vector<uint8_t>& records, std::vector<uint8_t>& scratch);
+	
+	// sorts each run of equal keys by encoding
+	static void sort_equal_keys(std::vector<uint8_t>& records);
+	
+	// returns false if keys are not unique and contiguous, records are unchanged then
+	static bool scatter_block(std::vector<uint8_t>& records, std::vector<uint8_t>& scratch);
+	
+	template<typename S>
+	void read_ex(	Processor<S>* output, const std::function<void(std::vector<T>&, S&)>& func,
+					int num_threads, int num_threads_read);
+	
+	// reads all buckets of read group index, split into blocks
+	void read_group(size_t& index,
+					std::vector<std::vector<uint8_t>>& out,
+					read_buffer_t<T>& buffer);
+	
+	size_t num_groups() const {
+		return buckets.size() >> group_shift;
+	}
 	
 private:
 	const int key_size = 0;
 	const int log_num_buckets = 0;
 	const int bucket_key_shift = 0;
+	const int file_shift = 0;
+	const int group_shift = 0;			// buckets per read group (2^x)
+	const int log_num_blocks = 0;		// blocks per bucket when reading (2^x), about 2^16 blocks in total
 	
 	bool keep_files = false;
+	bool dense_keys = false;
 	bool is_finished = false;
 	
 	WriteCache cache;
 	std::vector<bucket_t> buckets;
+	std::vector<file_t> files;
 	
 };
 
@@ -9,56 +9,245 @@
 #define INCLUDE_CHIA_DISKSORT_HPP_
 
 #include <chia/DiskSort.h>
+#include <chia/codec.h>
+#include <chia/crc32c.h>
 #include <chia/util.hpp>
+#include <chia/progress.h>
 
 #include <map>
+#include <cstring>
+#include <atomic>
+#include <thread>
 #include <algorithm>
 #include <unordered_map>
 
 
 template<typename T, typename Key>
-void DiskSort<T, Key>::bucket_t::open(const char* mode)
+void DiskSort<T, Key>::file_t::open(const char* mode)
 {
 	if(file) {
-		fclose(file);
+		fclose_ex(file);
 	}
-	file = fopen(file_name.c_str(), mode);
+	file = fopen_ex(file_name, mode);
 	if(!file) {
 		throw std::runtime_error("fopen() failed");
 	}
 }
 
 template<typename T, typename Key>
-void DiskSort<T, Key>::bucket_t::write(const void* data, size_t count)
+void DiskSort<T, Key>::file_t::write(	std::vector<bucket_t>& buckets, int bucket_shift,
+										size_t index, const void* data, size_t count)
 {
+	if(num_groups > 1 && count > max_sub_run_size) {
+		for(size_t i = 0; i < count; i += max_sub_run_size) {
+			write(buckets, bucket_shift, index, ((const uint8_t*)data) + i * T::disk_size,
+					std::min(count - i, max_sub_run_size));
+		}
+		return;
+	}
+	run_t run;
+	run.count = count;
+	run.has_checksum = g_verify_tmp;
+	
+	// entries per bucket, and per read group
+	std::vector<uint32_t> bucket_counts(end_bucket - first_bucket);
+	std::vector<uint16_t> group_counts(num_groups);
+	std::vector<uint32_t> group_checksums(num_groups);
+	std::vector<uint8_t> sorted;
+	
+	if(num_groups > 1) {
+		const uint8_t* records = (const uint8_t*)data;
+		std::vector<uint32_t> groups(count);
+		for(size_t i = 0; i < count; ++i) {
+			const size_t bucket = get_key(records + i * T::disk_size) >> bucket_shift;
+			if(bucket < first_bucket || bucket >= end_bucket) {
+				throw std::logic_error("bucket index out of range");
+			}
+			bucket_counts[bucket - first_bucket]++;
+			groups[i] = (bucket - first_bucket) >> group_shift;
+			group_counts[groups[i]]++;
+		}
+		// stable partition by group
+		std::vector<size_t> offsets(num_groups);
+		for(size_t i = 1; i < num_groups; ++i) {
+			offsets[i] = offsets[i - 1] + group_counts[i - 1];
+		}
+		sorted.resize(count * T::disk_size);
+		for(size_t i = 0; i < count; ++i) {
+			::memcpy(sorted.data() + (offsets[groups[i]]++) * T::disk_size, records + i * T::disk_size, T::disk_size);
+		}
+		data = sorted.data();
+		
+		if(run.has_checksum) {
+			size_t offset = 0;
+			for(size_t i = 0; i < num_groups; ++i) {
+				group_checksums[i] = crc32c(sorted.data() + offset * T::disk_size, group_counts[i] * T::disk_size);
+				offset += group_counts[i];
+			}
+		}
+	} else {
+		bucket_counts[0] = count;
+		if(run.has_checksum) {
+			run.checksum = crc32c(data, count * T::disk_size);
+		}
+	}
+	
 	std::lock_guard lock(mutex);
 	if(file) {
-		if(fwrite(data, T::disk_size, count, file) != count) {
-			throw std::runtime_error("fwrite() failed");
+		const auto time_begin = get_time_micros();
+		uint64_t num_bytes = 0;
+		
+		// one run per group, or a single run
+		size_t offset = 0;
+		for(size_t i = 0; i < num_groups; ++i) {
+			const size_t part_count = num_groups > 1 ? group_counts[i] : count;
+			if(!part_count) {
+				continue;
+			}
+			uint8_t header[run_header_size];
+			const uint32_t header_index = index;
+			const uint32_t header_count = part_count;
+			const uint32_t header_checksum = num_groups > 1 ? group_checksums[i] : run.checksum;
+			const uint32_t header_flags = run.has_checksum ? run_flag_checksum : 0;
+			::memcpy(header, &header_index, 4);
+			::memcpy(header + 4, &header_count, 4);
+			::memcpy(header + 8, &header_checksum, 4);
+			::memcpy(header + 12, &header_flags, 4);
+			
+			if(fwrite(header, 1, run_header_size, file) != run_header_size
+				|| fwrite(((const uint8_t*)data) + offset * T::disk_size, T::disk_size, part_count, file) != part_count
+				|| ferror(file))
+			{
+				throw std::runtime_error("fwrite() failed");
+			}
+			if(!num_bytes) {
+				run.offset = size + run_header_size;
+			}
+			offset += part_count;
+			num_bytes += run_header_size + part_count * T::disk_size;
+		}
+		runs.push_back(run);
+		
+		if(num_groups > 1) {
+			sub_counts.insert(sub_counts.end(), group_counts.begin(), group_counts.end());
+			if(run.has_checksum) {
+				sub_checksums.resize(sub_counts.size() - num_groups);
+				sub_checksums.insert(sub_checksums.end(), group_checksums.begin(), group_checksums.end());
+			}
 		}
-		num_entries += count;
+		for(size_t i = 0; i < bucket_counts.size(); ++i) {
+			buckets[first_bucket + i].num_entries += bucket_counts[i];
+		}
+		size += num_bytes;
+		disk_usage_add(file_name, num_bytes);
+		io_stats_add(file_name, true, num_bytes, get_time_micros() - time_begin);
 	}
 }
 
 template<typename T, typename Key>
-void DiskSort<T, Key>::bucket_t::close()
+void DiskSort<T, Key>::file_t::scan(std::vector<bucket_t>& buckets, int bucket_shift, size_t index)
+{
+	FILE* in = fopen_ex(file_name, "rb");
+	if(!in) {
+		throw std::runtime_error("fopen() failed");
+	}
+	std::vector<uint8_t> records;
+	uint8_t header[run_header_size];
+	size_t last_group = num_groups;
+	while(fread(header, 1, run_header_size, in) == run_header_size) {
+		uint32_t header_index = 0;
+		uint32_t count = 0;
+		uint32_t checksum = 0;
+		uint32_t flags = 0;
+		::memcpy(&header_index, header, 4);
+		::memcpy(&count, header + 4, 4);
+		::memcpy(&checksum, header + 8, 4);
+		::memcpy(&flags, header + 12, 4);
+		if(header_index != index || !count) {
+			fclose_ex(in);
+			throw std::runtime_error("invalid run header in " + file_name);
+		}
+		const uint64_t offset = size + run_header_size;
+		const bool has_checksum = flags & run_flag_checksum;
+		size = offset + count * T::disk_size;
+		
+		if(num_groups > 1) {
+			if(count > max_sub_run_size) {
+				fclose_ex(in);
+				throw std::runtime_error("invalid run header in " + file_name);
+			}
+			// need to look at the keys to count entries per bucket
+			records.resize(count * T::disk_size);
+			if(fread(records.data(), 1, records.size(), in) != records.size()) {
+				fclose_ex(in);
+				throw std::runtime_error("fread() failed");
+			}
+			size_t group = num_groups;
+			for(size_t i = 0; i < count; ++i) {
+				const size_t bucket = get_key(records.data() + i * T::disk_size) >> bucket_shift;
+				if(bucket < first_bucket || bucket >= end_bucket
+					|| (group < num_groups && ((bucket - first_bucket) >> group_shift) != group))
+				{
+					fclose_ex(in);
+					throw std::runtime_error("invalid entry in " + file_name);
+				}
+				group = (bucket - first_bucket) >> group_shift;
+				buckets[bucket].num_entries++;
+			}
+			// sub-runs of one run have increasing groups, a new run starts otherwise
+			if(last_group >= num_groups || group <= last_group) {
+				run_t run;
+				run.offset = offset;
+				runs.push_back(run);
+				sub_counts.resize(sub_counts.size() + num_groups);
+			}
+			auto& run = runs.back();
+			run.count += count;
+			run.has_checksum |= has_checksum;
+			sub_counts[sub_counts.size() - num_groups + group] = count;
+			if(has_checksum) {
+				sub_checksums.resize(sub_counts.size());
+				sub_checksums[sub_counts.size() - num_groups + group] = checksum;
+			}
+			last_group = group;
+		} else {
+			run_t run;
+			run.offset = offset;
+			run.count = count;
+			run.checksum = checksum;
+			run.has_checksum = has_checksum;
+			runs.push_back(run);
+			buckets[first_bucket].num_entries += count;
+			fseek_set(in, size);
+		}
+	}
+	fclose_ex(in);
+}
+
+template<typename T, typename Key>
+void DiskSort<T, Key>::file_t::close()
 {
 	if(file) {
-		fclose(file);
+		if(is_preallocated) {
+			// release space which was not used
+			ftruncate_ex(file, size);
+			is_preallocated = false;
+		}
+		fclose_ex(file);
 		file = nullptr;
 	}
 }
 
 template<typename T, typename Key>
-void DiskSort<T, Key>::bucket_t::remove()
+void DiskSort<T, Key>::file_t::remove()
 {
 	close();
-	std::remove(file_name.c_str());
+	::remove(file_name);
 }
 
 template<typename T, typename Key>
-DiskSort<T, Key>::WriteCache::WriteCache(DiskSort* disk, int key_shift, int num_buckets)
-	:	disk(disk), key_shift(key_shift), buckets(num_buckets)
+DiskSort<T, Key>::WriteCache::WriteCache(DiskSort* disk, int key_shift, int num_files)
+	:	disk(disk), key_shift(key_shift), files(num_files)
 {
 }
 
@@ -66,10 +255,10 @@ template<typename T, typename Key>
 void DiskSort<T, Key>::WriteCache::add(const T& entry)
 {
 	const size_t index = Key{}(entry) >> key_shift;
-	if(index >= buckets.size()) {
+	if(index >= files.size()) {
 		throw std::logic_error("bucket index out of range");
 	}
-	auto& buffer = buckets[index];
+	auto& buffer = files[index];
 	if(buffer.count >= buffer.capacity) {
 		disk->write(index, buffer.data, buffer.count);
 		buffer.count = 0;
@@ -81,8 +270,8 @@ void DiskSort<T, Key>::WriteCache::add(const T& entry)
 template<typename T, typename Key>
 void DiskSort<T, Key>::WriteCache::flush()
 {
-	for(size_t index = 0; index < buckets.size(); ++index) {
-		auto& buffer = buckets[index];
+	for(size_t index = 0; index < files.size(); ++index) {
+		auto& buffer = files[index];
 		if(buffer.count) {
 			disk->write(index, buffer.data, buffer.count);
 			buffer.count = 0;
@@ -96,18 +285,30 @@ DiskSort<T, Key>::DiskSort(	int key_size, int log_num_buckets,
 	:	key_size(key_size),
 		log_num_buckets(log_num_buckets),
 		bucket_key_shift(key_size - log_num_buckets),
+		file_shift(std::max(log_num_buckets - g_max_log_num_files, 0)),
+		group_shift(std::max(file_shift - max_log_sub_runs, 0)),
+		log_num_blocks(std::min(std::min(log_num_buckets, std::max(16 - log_num_buckets, 0)),
+								key_size - log_num_buckets)),
 		keep_files(read_only),
 		is_finished(read_only),
-		cache(this, key_size - log_num_buckets, 1 << log_num_buckets),
-		buckets(1 << log_num_buckets)
+		cache(this, key_size - log_num_buckets + file_shift, 1 << (log_num_buckets - file_shift)),
+		buckets(1 << log_num_buckets),
+		files(buckets.size() >> file_shift)
 {
-	for(size_t i = 0; i < buckets.size(); ++i) {
-		auto& bucket = buckets[i];
-		bucket.file_name = file_prefix + ".sort_bucket_" + std::to_string(i) + ".tmp";
+	if(bucket_key_shift < 0) {
+		throw std::logic_error("log_num_buckets > key_size");
+	}
+	for(size_t i = 0; i < files.size(); ++i) {
+		auto& file = files[i];
+		file.file_name = file_prefix + ".sort_bucket_" + std::to_string(i) + ".tmp";
+		file.first_bucket = i << file_shift;
+		file.end_bucket = (i + 1) << file_shift;
+		file.num_groups = size_t(1) << (file_shift - group_shift);
+		file.group_shift = group_shift;
 		if(read_only) {
-			bucket.num_entries = get_file_size(bucket.file_name.c_str()) / T::disk_size;
+			file.scan(buckets, bucket_key_shift, i);
 		} else {
-			bucket.open("wb");
+			file.open("wb");
 		}
 	}
 }
@@ -124,52 +325,80 @@ void DiskSort<T, Key>::write(size_t index, const void* data, size_t count)
 	if(is_finished) {
 		throw std::logic_error("read only");
 	}
-	if(index >= buckets.size()) {
+	if(index >= files.size()) {
 		throw std::logic_error("index out of range");
 	}
-	auto& bucket = buckets[index];
-	if(fwrite(data, T::disk_size, count, bucket.file) != count) {
-		throw std::runtime_error("fwrite() failed");
-	}
-	bucket.num_entries += count;
+	files[index].write(buckets, bucket_key_shift, index, data, count);
 }
 
 template<typename T, typename Key>
 std::shared_ptr<typename DiskSort<T, Key>::WriteCache> DiskSort<T, Key>::add_cache()
 {
-	return std::make_shared<WriteCache>(this, bucket_key_shift, buckets.size());
+	return std::make_shared<WriteCache>(this, bucket_key_shift + file_shift, files.size());
 }
 
 template<typename T, typename Key>
 void DiskSort<T, Key>::read(Processor<std::vector<T>>* output,
 							int num_threads, int num_threads_read)
+{
+	read_ex<std::vector<T>>(output,
+		[](std::vector<T>& input, std::vector<T>& out) {
+			out = std::move(input);
+		}, num_threads, num_threads_read);
+}
+
+template<typename T, typename Key>
+template<typename GroupKey>
+void DiskSort<T, Key>::read_groups(	Processor<std::shared_ptr<const group_batch_t<T>>>* output,
+									int num_threads, int num_threads_read)
+{
+	GroupSplitter<GroupKey> splitter(output);
+	
+	read_ex<sorted_block_t>(&splitter,
+		[](std::vector<T>& input, sorted_block_t& out) {
+			uint64_t key = 0;
+			for(size_t i = 0; i < input.size(); ++i) {
+				const uint64_t next = GroupKey{}(input[i]);
+				if(i == 0 || next != key) {
+					out.groups.push_back(i);
+				}
+				key = next;
+			}
+			out.data = std::make_shared<const std::vector<T>>(std::move(input));
+		}, num_threads, num_threads_read);
+	
+	splitter.flush();
+}
+
+template<typename T, typename Key>
+template<typename S>
+void DiskSort<T, Key>::read_ex(	Processor<S>* output, const std::function<void(std::vector<T>&, S&)>& func,
+								int num_threads, int num_threads_read)
 {
 	if(num_threads_read < 0) {
 		num_threads_read = std::max(num_threads / 4, 2);
 	}
 	
-	ThreadPool<std::vector<T>, std::vector<T>> sort_pool(
-		[](std::vector<T>& input, std::vector<T>& out, size_t&) {
-			std::sort(input.begin(), input.end(),
-				[](const T& lhs, const T& rhs) -> bool {
-					return Key{}(lhs) < Key{}(rhs);
-				});
-			out = std::move(input);
+	ThreadPool<std::vector<uint8_t>, S, std::vector<uint8_t>> sort_pool(
+		[this, &func](std::vector<uint8_t>& input, S& out, std::vector<uint8_t>& scratch) {
+			std::vector<T> sorted;
+			sort_block(input, scratch, sorted);
+			func(sorted, out);
 		}, output, num_threads, "Disk/sort");
 	
-	Thread<std::vector<std::vector<T>>> sort_thread(
-		[&sort_pool](std::vector<std::vector<T>>& input) {
+	Thread<std::vector<std::vector<uint8_t>>> sort_thread(
+		[&sort_pool](std::vector<std::vector<uint8_t>>& input) {
 			for(auto& block : input) {
 				sort_pool.take(block);
 			}
 		}, "Disk/sort");
 	
-	ThreadPool<size_t, std::vector<std::vector<T>>, read_buffer_t<T>> read_pool(
-		std::bind(&DiskSort::read_bucket, this,
+	ThreadPool<size_t, std::vector<std::vector<uint8_t>>, read_buffer_t<T>> read_pool(
+		std::bind(&DiskSort::read_group, this,
 				std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
 		&sort_thread, num_threads_read, "Disk/read");
 	
-	for(size_t i = 0; i < buckets.size(); ++i) {
+	for(size_t i = 0; i < num_groups(); ++i) {
 		read_pool.take_copy(i);
 	}
 	read_pool.close();
@@ -178,43 +407,151 @@ void DiskSort<T, Key>::read(Processor<std::vector<T>>* output,
 }
 
 template<typename T, typename Key>
-void DiskSort<T, Key>::read_bucket(	size_t& index,
-									std::vector<std::vector<T>>& out,
+void DiskSort<T, Key>::read_group(	size_t& index,
+									std::vector<std::vector<uint8_t>>& out,
 									read_buffer_t<T>& buffer)
 {
-	auto& bucket = buckets[index];
-	bucket.open("rb");
+	const size_t groups_per_file = size_t(1) << (file_shift - group_shift);
+	const size_t group = index % groups_per_file;
+	const size_t first_bucket = index << group_shift;
+	const size_t end_bucket = (index + 1) << group_shift;
+	auto& file = files[index / groups_per_file];
 	
-	const int key_shift = bucket_key_shift - log_num_buckets;
-	if(key_shift < 0) {
-		throw std::logic_error("key_shift < 0");
+	// sub-runs of this group, one per run at most
+	std::vector<run_t> sub_runs;
+	if(file.num_groups > 1) {
+		for(size_t i = 0; i < file.runs.size(); ++i) {
+			const uint16_t* counts = file.sub_counts.data() + i * file.num_groups;
+			uint64_t offset = file.runs[i].offset;
+			for(size_t k = 0; k < group; ++k) {
+				if(counts[k]) {
+					offset += counts[k] * T::disk_size + run_header_size;
+				}
+			}
+			if(counts[group]) {
+				run_t run;
+				run.offset = offset;
+				run.count = counts[group];
+				if(file.runs[i].has_checksum) {
+					run.checksum = file.sub_checksums.at(i * file.num_groups + group);
+					run.has_checksum = true;
+				}
+				sub_runs.push_back(run);
+			}
+		}
+	}
+	const auto& runs = file.num_groups > 1 ? sub_runs : file.runs;
+	
+	// each reader needs its own stream, since the writing stream is closed
+	FILE* in = fopen_ex(file.file_name, keep_files ? "rb" : "rb+");
+	if(!in) {
+		throw std::runtime_error("fopen() failed");
 	}
-	std::unordered_map<size_t, std::vector<T>> table;
-	table.reserve(size_t(1) << log_num_buckets);
+	const int key_shift = bucket_key_shift - log_num_blocks;
+	
+	std::unordered_map<size_t, std::vector<uint8_t>> table;
+	table.reserve(size_t(1) << log_num_blocks);
+	
+	// RAM disk files are decoded in place
+	const uint8_t* mapped = nullptr;
+	if(is_ram_file(file.file_name) && file.size) {
+		mapped = mmap_file(file.file_name, file.size);
+	}
+	const uint64_t max_bytes = buffer.capacity * T::disk_size;
+	std::vector<std::pair<uint64_t, size_t>> parts;		// [offset in chunk, count]
+	
+	// parts are in order of runs, runs can span more than one chunk
+	size_t verify_index = 0;
+	uint64_t verify_pos = 0;
+	uint32_t verify_crc = 0;
 	
-	for(size_t i = 0; i < bucket.num_entries;)
+	// read adjacent runs in one go
+	size_t run_index = 0;
+	uint64_t run_pos = 0;
+	while(run_index < runs.size())
 	{
-		const size_t num_entries = std::min(buffer.capacity, bucket.num_entries - i);
-		if(fread(buffer.data, T::disk_size, num_entries, bucket.file) != num_entries) {
-			throw std::runtime_error("fread() failed");
+		const uint64_t chunk_begin = runs[run_index].offset + run_pos * T::disk_size;
+		uint64_t chunk_end = chunk_begin;
+		parts.clear();
+		
+		while(run_index < runs.size()) {
+			const auto& run = runs[run_index];
+			const uint64_t begin = run.offset + run_pos * T::disk_size;
+			if(begin != chunk_end && begin != chunk_end + run_header_size) {
+				break;
+			}
+			if(begin + T::disk_size > chunk_begin + max_bytes) {
+				break;
+			}
+			const size_t count = std::min<uint64_t>(
+					run.count - run_pos, (chunk_begin + max_bytes - begin) / T::disk_size);
+			parts.emplace_back(begin - chunk_begin, count);
+			chunk_end = begin + count * T::disk_size;
+			run_pos += count;
+			if(run_pos < run.count) {
+				break;
+			}
+			run_index++;
+			run_pos = 0;
 		}
-		for(size_t k = 0; k < num_entries; ++k) {
-			T entry;
-			entry.read(buffer.entry_at(k));
-			
-			auto& block = table[Key{}(entry) >> key_shift];
-			if(block.empty()) {
-				block.reserve((bucket.num_entries >> log_num_buckets) * 1.1);
+		const uint64_t num_bytes = chunk_end - chunk_begin;
+		
+		const uint8_t* data = buffer.data;
+		if(mapped) {
+			data = mapped + chunk_begin;
+			io_stats_add(file.file_name, false, num_bytes);
+		} else {
+			const auto time_begin = get_time_micros();
+			fseek_set(in, chunk_begin);
+			if(fread(buffer.data, 1, num_bytes, in) != num_bytes) {
+				throw std::runtime_error("fread() failed");
+			}
+			io_stats_add(file.file_name, false, num_bytes, get_time_micros() - time_begin);
+		}
+		for(const auto& part : parts) {
+			const auto& run = runs[verify_index];
+			if(run.has_checksum) {
+				verify_crc = crc32c(data + part.first, part.second * T::disk_size, verify_crc);
+			}
+			verify_pos += part.second;
+			if(verify_pos == run.count) {
+				if(run.has_checksum && verify_crc != run.checksum) {
+					throw std::runtime_error("checksum mismatch in " + file.file_name
+							+ " at offset " + std::to_string(run.offset) + " (file " + std::to_string(index / groups_per_file) + ")");
+				}
+				verify_index++;
+				verify_pos = 0;
+				verify_crc = 0;
+			}
+			for(size_t k = 0; k < part.second; ++k) {
+				const uint8_t* record = data + part.first + k * T::disk_size;
+				
+				const size_t block_index = get_key(record) >> key_shift;
+				auto& block = table[block_index];
+				if(block.empty()) {
+					const auto& bucket = buckets.at(block_index >> log_num_blocks);
+					block.reserve((bucket.num_entries >> log_num_blocks) * 1.1 * T::disk_size);
+				}
+				block.insert(block.end(), record, record + T::disk_size);
+			}
+		}
+		if(!keep_files && file.num_groups == 1) {
+			// free space behind us right away (sub-runs are too small for that)
+			if(fpunch_ex(in, chunk_begin, num_bytes)) {
+				disk_usage_add(file.file_name, -int64_t(num_bytes));
 			}
-			block.push_back(entry);
 		}
-		i += num_entries;
 	}
+	fclose_ex(in);
+	
 	if(!keep_files) {
-		bucket.remove();
+		std::lock_guard lock(file.mutex);
+		if(++file.num_groups_read == file.num_groups) {
+			file.remove();
+		}
 	}
 	
-	std::map<size_t, std::vector<T>> sorted;
+	std::map<size_t, std::vector<uint8_t>> sorted;
 	for(auto& entry : table) {
 		sorted.emplace(entry.first, std::move(entry.second));
 	}
@@ -224,14 +561,319 @@ void DiskSort<T, Key>::read_bucket(	size_t& index,
 	for(auto& entry : sorted) {
 		out.emplace_back(std::move(entry.second));
 	}
+	uint64_t num_entries = 0;
+	for(size_t i = first_bucket; i < end_bucket; ++i) {
+		num_entries += buckets[i].num_entries;
+	}
+	progress_add_buckets(end_bucket - first_bucket);
+	progress_add_entries(num_entries);
+}
+
+template<typename T, typename Key>
+void DiskSort<T, Key>::read_ranges(const std::function<void(sorted_range_t<T>&)>& func, int num_threads)
+{
+	if(num_threads < 1) {
+		throw std::logic_error("num_threads < 1");
+	}
+	std::vector<uint64_t> offsets(buckets.size());
+	for(size_t i = 1; i < buckets.size(); ++i) {
+		offsets[i] = offsets[i - 1] + buckets[i - 1].num_entries;
+	}
+	std::mutex mutex;
+	std::string error;
+	std::atomic<size_t> next {0};
+	std::vector<std::thread> threads;
+	
+	for(int i = 0; i < num_threads; ++i) {
+		threads.emplace_back([this, &func, &offsets, &mutex, &error, &next]() {
+			read_buffer_t<T> buffer;
+			std::vector<uint8_t> scratch;
+			while(true) {
+				size_t index = next++;
+				if(index >= num_groups()) {
+					break;
+				}
+				try {
+					std::vector<std::vector<uint8_t>> blocks;
+					read_group(index, blocks, buffer);
+					
+					size_t bucket = buckets.size();
+					uint64_t offset = 0;
+					for(auto& block : blocks) {
+						// blocks are in order and never empty
+						const size_t block_bucket = get_key(block.data()) >> bucket_key_shift;
+						if(block_bucket != bucket) {
+							bucket = block_bucket;
+							offset = offsets[bucket];
+						}
+						sorted_range_t<T> range;
+						range.index = bucket;
+						range.offset = offset;
+						sort_block(block, scratch, range.data);
+						offset += range.data.size();
+						func(range);
+					}
+				} catch(const std::exception& ex) {
+					std::lock_guard<std::mutex> lock(mutex);
+					error = ex.what();
+					next = num_groups();
+				}
+			}
+		});
+	}
+	for(auto& thread : threads) {
+		thread.join();
+	}
+	if(!error.empty()) {
+		throw std::runtime_error("thread failed with: " + error);
+	}
+}
+
+template<typename T, typename Key>
+void DiskSort<T, Key>::sort_block(std::vector<uint8_t>& records, std::vector<uint8_t>& scratch, std::vector<T>& out) const
+{
+	if(!dense_keys || !scatter_block(records, scratch)) {
+		radix_sort(records, scratch);
+	}
+	// keep the other buffer as scratch for the next block
+	records.swap(scratch);
+	std::vector<uint8_t>().swap(records);
+	
+	const size_t count = scratch.size() / T::disk_size;
+	out.resize(count);
+	decode_block(scratch.data(), out.data(), count);
+}
+
+template<typename T, typename Key>
+void DiskSort<T, Key>::radix_sort(std::vector<uint8_t>& records, std::vector<uint8_t>& scratch)
+{
+	static constexpr int max_digit_bits = 11;
+	
+	const size_t count = records.size() / T::disk_size;
+	if(count < 2) {
+		return;
+	}
+	// only sort on bits which differ, usually all blocks share the upper bits
+	const uint64_t first = get_key(records.data());
+	uint64_t diff = 0;
+	for(size_t i = 1; i < count; ++i) {
+		diff |= get_key(records.data() + i * T::disk_size) ^ first;
+	}
+	int num_bits = 0;
+	while(num_bits < 64 && (diff >> num_bits)) {
+		num_bits++;
+	}
+	if(num_bits) {
+		const int num_passes = (num_bits + max_digit_bits - 1) / max_digit_bits;
+		const int digit_bits = (num_bits + num_passes - 1) / num_passes;
+		const uint64_t mask = (uint64_t(1) << digit_bits) - 1;
+
+		// histograms of all passes in one go
+		std::vector<std::vector<size_t>> offsets(num_passes, std::vector<size_t>(size_t(1) << digit_bits));
+		for(size_t i = 0; i < count; ++i) {
+			const auto key = get_key(records.data() + i * T::disk_size);
+			for(int pass = 0; pass < num_passes; ++pass) {
+				offsets[pass][(key >> (pass * digit_bits)) & mask]++;
+			}
+		}
+		scratch.resize(records.size());
+		for(int pass = 0; pass < num_passes; ++pass) {
+			auto& offset = offsets[pass];
+			size_t sum = 0;
+			for(auto& value : offset) {
+				const auto num = value;
+				value = sum;
+				sum += num;
+			}
+			const int shift = pass * digit_bits;
+			for(size_t i = 0; i < count; ++i) {
+				const uint8_t* record = records.data() + i * T::disk_size;
+				const auto digit = (get_key(record) >> shift) & mask;
+				::memcpy(scratch.data() + (offset[digit]++) * T::disk_size, record, T::disk_size);
+			}
+			records.swap(scratch);
+		}
+	}
+	sort_equal_keys(records);
+}
+
+template<typename T, typename Key>
+void DiskSort<T, Key>::sort_equal_keys(std::vector<uint8_t>& records)
+{
+	const size_t count = records.size() / T::disk_size;
+	std::vector<uint32_t> order;
+	std::vector<uint8_t> tmp;
+	
+	size_t begin = 0;
+	uint64_t key = count ? get_key(records.data()) : 0;
+	for(size_t i = 1; i <= count; ++i) {
+		const uint64_t next = i < count ? get_key(records.data() + i * T::disk_size) : 0;
+		if(i < count && next == key) {
+			continue;
+		}
+		if(i - begin > 1) {
+			const uint8_t* data = records.data() + begin * T::disk_size;
+			order.resize(i - begin);
+			for(size_t k = 0; k < order.size(); ++k) {
+				order[k] = k;
+			}
+			std::sort(order.begin(), order.end(),
+				[data](const uint32_t lhs, const uint32_t rhs) -> bool {
+					return ::memcmp(data + lhs * T::disk_size, data + rhs * T::disk_size, T::disk_size) < 0;
+				});
+			tmp.resize(order.size() * T::disk_size);
+			for(size_t k = 0; k < order.size(); ++k) {
+				::memcpy(tmp.data() + k * T::disk_size, data + order[k] * T::disk_size, T::disk_size);
+			}
+			::memcpy(records.data() + begin * T::disk_size, tmp.data(), tmp.size());
+		}
+		begin = i;
+		key = next;
+	}
+}
+
+template<typename T, typename Key>
+bool DiskSort<T, Key>::scatter_block(std::vector<uint8_t>& records, std::vector<uint8_t>& scratch)
+{
+	const size_t count = records.size() / T::disk_size;
+	if(!count) {
+		return true;
+	}
+	uint64_t min_key = get_key(records.data());
+	for(size_t i = 1; i < count; ++i) {
+		min_key = std::min(min_key, get_key(records.data() + i * T::disk_size));
+	}
+	scratch.resize(records.size());
+	std::vector<bool> is_set(count);
+	for(size_t i = 0; i < count; ++i) {
+		const uint8_t* record = records.data() + i * T::disk_size;
+		const uint64_t index = get_key(record) - min_key;
+		if(index >= count || is_set[index]) {
+			return false;
+		}
+		::memcpy(scratch.data() + index * T::disk_size, record, T::disk_size);
+		is_set[index] = true;
+	}
+	// all slots are filled, since there are no duplicates
+	records.swap(scratch);
+	return true;
+}
+
+template<typename T, typename Key>
+template<typename GroupKey>
+void DiskSort<T, Key>::GroupSplitter<GroupKey>::take(sorted_block_t& block)
+{
+	const auto& data = *block.data;
+	const auto& starts = block.groups;
+	if(data.empty()) {
+		return;
+	}
+	auto batch = std::make_shared<group_batch_t<T>>();
+	if(last_block) {
+		batch->has_prev = true;
+		add_group(*batch, last, last_block);
+	}
+	size_t i = 0;
+	if(partial_block) {
+		if(GroupKey{}(data[0]) == partial.key) {
+			// group continues in this block, need to copy
+			const size_t end = starts.size() > 1 ? starts[1] : data.size();
+			auto merged = std::make_shared<std::vector<T>>(partial.data, partial.data + partial.size);
+			merged->insert(merged->end(), data.begin(), data.begin() + end);
+			partial.data = merged->data();
+			partial.size = merged->size();
+			partial_block = merged;
+			i = 1;
+		}
+		if(i < starts.size()) {
+			add_group(*batch, partial, partial_block);
+			partial_block = nullptr;
+		}
+	}
+	for(; i + 1 < starts.size(); ++i) {
+		group_t group;
+		group.data = data.data() + starts[i];
+		group.size = starts[i + 1] - starts[i];
+		group.key = GroupKey{}(data[starts[i]]);
+		group.offset = offset + starts[i];
+		add_group(*batch, group, block.data);
+	}
+	if(i < starts.size()) {
+		// last group might continue in next block
+		partial.data = data.data() + starts[i];
+		partial.size = data.size() - starts[i];
+		partial.key = GroupKey{}(data[starts[i]]);
+		partial.offset = offset + starts[i];
+		partial_block = block.data;
+	}
+	offset += data.size();
+	
+	if(batch->groups.size() > (batch->has_prev ? 1 : 0)) {
+		last = batch->groups.back();
+		last_block = batch->blocks.back();
+		std::shared_ptr<const group_batch_t<T>> out = batch;
+		output->take(out);
+	}
+}
+
+template<typename T, typename Key>
+template<typename GroupKey>
+void DiskSort<T, Key>::GroupSplitter<GroupKey>::flush()
+{
+	if(!partial_block) {
+		return;
+	}
+	auto batch = std::make_shared<group_batch_t<T>>();
+	if(last_block) {
+		batch->has_prev = true;
+		add_group(*batch, last, last_block);
+	}
+	add_group(*batch, partial, partial_block);
+	
+	last_block = nullptr;
+	partial_block = nullptr;
+	std::shared_ptr<const group_batch_t<T>> out = batch;
+	output->take(out);
+}
+
+template<typename T, typename Key>
+template<typename GroupKey>
+void DiskSort<T, Key>::GroupSplitter<GroupKey>::add_group(
+		group_batch_t<T>& batch, const group_t& group, std::shared_ptr<const std::vector<T>> block)
+{
+	batch.groups.push_back(group);
+	if(batch.blocks.empty() || batch.blocks.back() != block) {
+		batch.blocks.push_back(block);
+	}
+}
+
+template<typename T, typename Key>
+void DiskSort<T, Key>::preallocate(uint64_t num_entries)
+{
+	if(!g_preallocate) {
+		return;
+	}
+	if(is_finished) {
+		throw std::logic_error("read only");
+	}
+	// add some margin since file sizes vary a bit, plus run headers
+	const uint64_t file_entries = (num_entries / files.size()) * 1.02 + g_write_chunk_size;
+	const uint64_t file_size = file_entries * T::disk_size
+			+ (file_entries / g_write_chunk_size + 1) * (size_t(1) << (file_shift - group_shift)) * run_header_size;
+	
+	for(auto& file : files) {
+		if(file.file) {
+			file.is_preallocated = fallocate_ex(file.file, 0, file_size);
+		}
+	}
 }
 
 template<typename T, typename Key>
 void DiskSort<T, Key>::finish()
 {
 	cache.flush();
-	for(auto& bucket : buckets) {
-		bucket.close();
+	for(auto& file : files) {
+		file.close();
 	}
 	is_finished = true;
 }
@@ -239,12 +881,13 @@ void DiskSort<T, Key>::finish()
 template<typename T, typename Key>
 void DiskSort<T, Key>::close()
 {
-	for(auto& bucket : buckets) {
-		bucket.close();
+	for(auto& file : files) {
+		file.close();
 		if(!keep_files) {
-			bucket.remove();
+			file.remove();
 		}
 	}
+	files.clear();
 	buckets.clear();
 }
 
@@ -8,10 +8,17 @@
 #ifndef INCLUDE_CHIA_DISKTABLE_H_
 #define INCLUDE_CHIA_DISKTABLE_H_
 
+#include <chia/codec.h>
+#include <chia/crc32c.h>
 #include <chia/buffer.h>
 #include <chia/ThreadPool.h>
+#include <chia/util.hpp>
+#include <chia/progress.h>
 
+#include <map>
+#include <mutex>
 #include <cstdio>
+#include <iostream>
 
 
 template<typename T>
@@ -20,9 +27,10 @@ private:
 	struct local_t {
 		FILE* file = nullptr;
 		uint8_t* buffer = nullptr;
+		const uint8_t* mapped = nullptr;		// entire table when using mmap()
 		~local_t() {
 			if(file) {
-				fclose(file);
+				fclose_ex(file);
 			}
 			delete [] buffer;
 		}
@@ -34,17 +42,27 @@ public:
 			num_entries(num_entries)
 	{
 		if(!num_entries) {
-			file_out = fopen(file_name.c_str(), "wb");
+			file_out = fopen_ex(file_name, "wb");
+			if(g_verify_tmp) {
+				checksum_block = g_read_chunk_size;
+			}
 		}
 	}
 	
 	DiskTable(const table_t& info)
 		:	DiskTable(info.file_name, info.num_entries)
 	{
+		checksum_block = info.checksum_block;
+		checksums = info.checksums;
 	}
 	
 	~DiskTable() {
-		close();
+		try {
+			close();
+		} catch(const std::exception& ex) {
+			// tables are closed explicitly when done, so we are unwinding and cannot throw again
+			std::cout << "Error: DiskTable close() failed for " << file_name << " with: " << ex.what() << std::endl;
+		}
 	}
 	
 	DiskTable(DiskTable&) = delete;
@@ -54,13 +72,23 @@ public:
 		table_t out;
 		out.file_name = file_name;
 		out.num_entries = num_entries;
+		out.checksum_block = checksum_block;
+		out.checksums = checksums;
 		return out;
 	}
 	
 	void read(	Processor<std::pair<std::vector<T>, size_t>>* output,
 				int num_threads_read = 2,
-				const size_t block_size = g_read_chunk_size) const
+				size_t block_size = g_read_chunk_size) const
 	{
+		if(checksum_block) {
+			block_size = checksum_block;		// need to read what was checksummed
+		}
+		const size_t map_size = num_entries * T::disk_size;
+		const uint8_t* mapped = nullptr;
+		if(map_size && (g_use_mmap || is_tmpfs(file_name) || is_ram_file(file_name))) {
+			mapped = mmap_file(file_name, map_size);
+		}
 		ThreadPool<std::pair<size_t, size_t>, std::pair<std::vector<T>, size_t>, local_t> pool(
 			std::bind(&DiskTable::read_block, this,
 					std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
@@ -68,13 +96,20 @@ public:
 		
 		for(size_t i = 0; i < pool.num_threads(); ++i)
 		{
-			FILE* file = fopen(file_name.c_str(), "rb");
+			auto& local = pool.get_local(i);
+			local.mapped = mapped;
+			if(mapped && !free_after_read) {
+				continue;
+			}
+			// file is still needed to punch holes when mapped
+			FILE* file = fopen_ex(file_name, free_after_read ? "rb+" : "rb");
 			if(!file) {
 				throw std::runtime_error("fopen() failed");
 			}
-			auto& local = pool.get_local(i);
 			local.file = file;
-			local.buffer = new uint8_t[block_size * T::disk_size];
+			if(!mapped) {
+				local.buffer = new uint8_t[block_size * T::disk_size];
+			}
 		}
 		const size_t num_blocks = num_entries / block_size;
 		const size_t left_over = num_entries % block_size;
@@ -88,59 +123,240 @@ public:
 			pool.take_copy(std::make_pair(offset, left_over));
 		}
 		pool.close();
+		
+		if(mapped) {
+			munmap_file(file_name, mapped, map_size);
+		}
+	}
+	
+	// punch holes into the file behind each block read, ie. the table can only be read once
+	void set_free_after_read(bool enable) {
+		free_after_read = enable;
 	}
 	
 	// NOT thread-safe
 	void write(const T& entry) {
+		if(!blocks.empty()) {
+			throw std::logic_error("DiskTable: write() after write_block()");
+		}
 		if(cache.count >= cache.capacity) {
-			flush();
+			flush_cache();
 		}
 		entry.write(cache.entry_at(cache.count));
 		cache.count++;
 	}
 	
+	// NOT thread-safe
+	void write(const std::vector<T>& entries) {
+		if(!blocks.empty()) {
+			throw std::logic_error("DiskTable: write() after write_block()");
+		}
+		for(size_t i = 0; i < entries.size();) {
+			if(cache.count >= cache.capacity) {
+				flush_cache();
+			}
+			const size_t count = std::min(cache.capacity - cache.count, entries.size() - i);
+			encode_block(entries.data() + i, cache.entry_at(cache.count), count);
+			cache.count += count;
+			i += count;
+		}
+	}
+	
+	/*
+	 * Writes entries at offset (in number of entries), blocks can be written in any order.
+	 * Cannot be mixed with write(), table is complete after flush() / close(). [thread-safe]
+	 */
+	void write_block(const uint64_t offset, const std::vector<T>& entries) {
+		if(!file_out) {
+			throw std::logic_error("DiskTable: not open for writing");
+		}
+		if(num_entries || cache.count) {
+			throw std::logic_error("DiskTable: write_block() after write()");
+		}
+		if(entries.empty()) {
+			return;
+		}
+		add_block(offset, entries.size());
+		
+		thread_local std::vector<uint8_t> buffer;
+		buffer.resize(entries.size() * T::disk_size);
+		encode_block(entries.data(), buffer.data(), entries.size());
+		pwrite_ex(file_out, offset * T::disk_size, buffer.data(), buffer.size());
+		disk_usage_add(file_name, buffer.size());
+		add_checksums(offset, buffer.data(), entries.size());
+	}
+	
+	// writes remaining entries, table is complete afterwards
 	void flush() {
-		if(fwrite(cache.data, cache.entry_size, cache.count, file_out) != cache.count) {
-			throw std::runtime_error("fwrite() failed");
+		if(!blocks.empty()) {
+			if(blocks.size() > 1 || blocks.begin()->first) {
+				throw std::logic_error("DiskTable: blocks missing");
+			}
+			num_entries = blocks.begin()->second;
+		} else {
+			flush_cache();
+		}
+		if(checksum_block) {
+			finish_checksums();
 		}
-		num_entries += cache.count;
-		cache.count = 0;
 	}
 	
 	void close() {
 		if(file_out) {
-			flush();
-			fclose(file_out);
+			try {
+				flush();
+			} catch(...) {
+				fclose_ex(file_out);
+				file_out = nullptr;		// don't throw again from destructor
+				throw;
+			}
+			fclose_ex(file_out);
 			file_out = nullptr;
 		}
 	}
 	
 private:
+	void flush_cache() {
+		const auto time_begin = get_time_micros();
+		if(fwrite(cache.data, cache.entry_size, cache.count, file_out) != cache.count || ferror(file_out)) {
+			throw std::runtime_error("fwrite() failed");
+		}
+		disk_usage_add(file_name, cache.count * cache.entry_size);
+		io_stats_add(file_name, true, cache.count * cache.entry_size, get_time_micros() - time_begin);
+		add_checksums(num_entries, cache.data, cache.count);
+		num_entries += cache.count;
+		cache.count = 0;
+	}
+	
+	// records [offset, offset + count) as written, adjacent blocks are merged [thread-safe]
+	void add_block(const uint64_t offset, const uint64_t count) {
+		const uint64_t end = offset + count;
+		std::lock_guard<std::mutex> lock(block_mutex);
+		auto next = blocks.lower_bound(offset);
+		if(next != blocks.end() && next->first < end) {
+			throw std::logic_error("DiskTable: overlapping blocks at entry " + std::to_string(next->first));
+		}
+		auto iter = next;
+		if(next != blocks.begin()) {
+			const auto prev = std::prev(next);
+			if(prev->second > offset) {
+				throw std::logic_error("DiskTable: overlapping blocks at entry " + std::to_string(offset));
+			}
+			if(prev->second == offset) {
+				prev->second = end;
+				iter = prev;
+			}
+		}
+		if(iter == next) {
+			iter = blocks.emplace_hint(next, offset, end);
+		}
+		if(next != blocks.end() && next->first == end) {
+			iter->second = next->second;
+			blocks.erase(next);
+		}
+	}
+	
+	// checksums each part of [offset, offset + count) within a block, parts of a block are merged when adjacent [thread-safe]
+	void add_checksums(const uint64_t offset, const uint8_t* data, const uint64_t count) {
+		if(!checksum_block) {
+			return;
+		}
+		for(uint64_t i = 0; i < count;) {
+			const uint64_t begin = offset + i;
+			const uint64_t num = std::min(checksum_block - begin % checksum_block, count - i);
+			const uint32_t crc = crc32c(data + i * T::disk_size, num * T::disk_size);
+			i += num;
+			
+			std::lock_guard<std::mutex> lock(block_mutex);
+			auto iter = checksum_parts.emplace(begin, std::make_pair(num, crc)).first;
+			if(iter != checksum_parts.begin()) {
+				const auto prev = std::prev(iter);
+				if(prev->first + prev->second.first == begin && begin % checksum_block) {
+					prev->second.second = crc32c_combine(prev->second.second, crc, num * T::disk_size);
+					prev->second.first += num;
+					checksum_parts.erase(iter);
+					iter = prev;
+				}
+			}
+			const auto next = std::next(iter);
+			if(next != checksum_parts.end()
+				&& iter->first + iter->second.first == next->first && next->first % checksum_block)
+			{
+				iter->second.second = crc32c_combine(iter->second.second, next->second.second, next->second.first * T::disk_size);
+				iter->second.first += next->second.first;
+				checksum_parts.erase(next);
+			}
+		}
+	}
+	
+	// NOT thread-safe
+	void finish_checksums() {
+		checksums.clear();
+		for(const auto& part : checksum_parts) {
+			if(part.first != checksums.size() * checksum_block
+				|| (part.second.first != checksum_block && part.first + part.second.first != num_entries))
+			{
+				throw std::logic_error("DiskTable: incomplete checksums");
+			}
+			checksums.push_back(part.second.second);
+		}
+		if(checksums.size() != (num_entries + checksum_block - 1) / checksum_block) {
+			throw std::logic_error("DiskTable: incomplete checksums");
+		}
+	}
+	
 	void read_block(std::pair<size_t, size_t>& param,
 					std::pair<std::vector<T>, size_t>& out,
 					local_t& local) const
 	{
-		if(int err = fseek(local.file, param.first * T::disk_size, SEEK_SET)) {
-			throw std::runtime_error("fseek() failed");
+		const uint8_t* data = local.buffer;
+		if(local.mapped) {
+			data = local.mapped + param.first * T::disk_size;		// decode in place
+			io_stats_add(file_name, false, param.second * T::disk_size);
+		} else {
+			const auto time_begin = get_time_micros();
+			if(int err = fseek(local.file, param.first * T::disk_size, SEEK_SET)) {
+				throw std::runtime_error("fseek() failed");
+			}
+			if(fread(local.buffer, T::disk_size, param.second, local.file) != param.second) {
+				throw std::runtime_error("fread() failed");
+			}
+			io_stats_add(file_name, false, param.second * T::disk_size, get_time_micros() - time_begin);
 		}
-		if(fread(local.buffer, T::disk_size, param.second, local.file) != param.second) {
-			throw std::runtime_error("fread() failed");
+		if(checksum_block) {
+			const size_t index = param.first / checksum_block;
+			if(index >= checksums.size() || crc32c(data, param.second * T::disk_size) != checksums[index]) {
+				throw std::runtime_error("checksum mismatch in " + file_name + " at entry " + std::to_string(param.first));
+			}
 		}
 		auto& entries = out.first;
 		entries.resize(param.second);
-		for(size_t k = 0; k < param.second; ++k) {
-			entries[k].read(local.buffer + k * T::disk_size);
+		decode_block(data, entries.data(), param.second);
+		if(free_after_read) {
+			const uint64_t num_bytes = param.second * T::disk_size;
+			if(fpunch_ex(local.file, param.first * T::disk_size, num_bytes)) {
+				disk_usage_add(file_name, -int64_t(num_bytes));
+			}
 		}
 		out.second = param.first;
+		progress_add_entries(param.second);
 	}
 	
 private:
 	std::string file_name;
 	size_t num_entries;
+	bool free_after_read = false;
 	
 	write_buffer_t<T> cache;
 	FILE* file_out = nullptr;
 	
+	std::mutex block_mutex;
+	std::map<uint64_t, uint64_t> blocks;	// [begin => end] written by write_block()
+	
+	size_t checksum_block = 0;			// see g_verify_tmp
+	std::vector<uint32_t> checksums;
+	std::map<uint64_t, std::pair<uint64_t, uint32_t>> checksum_parts;	// [offset => (count, crc)]
+	
 };
 
 
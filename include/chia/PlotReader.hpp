@@ -0,0 +1,513 @@
+/*
+ * PlotReader.hpp
+ *
+ *  Created on: Jun 16, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_PLOTREADER_HPP_
+#define INCLUDE_CHIA_PLOTREADER_HPP_
+
+#include <chia/phase1.hpp>
+#include <chia/phase3.hpp>
+#include <chia/encoding.hpp>
+#include <chia/util.hpp>
+
+#include "picosha2.hpp"
+
+#include <array>
+#include <vector>
+#include <string>
+
+
+/*
+ * Reads a finished plot via mmap(), to get qualities and full proofs for a challenge.
+ * C2 is kept in memory, C1 / C3 / P7 and the line point parks are accessed in place.
+ * All lookups are thread-safe.
+ */
+class PlotReader {
+public:
+	static constexpr uint8_t k = 32;
+	
+	PlotReader(const std::string& file_name);
+	
+	~PlotReader();
+	
+	PlotReader(PlotReader&) = delete;
+	PlotReader& operator=(PlotReader&) = delete;
+	
+	const std::array<uint8_t, 32>& get_plot_id() const {
+		return plot_id;
+	}
+	
+	const std::vector<uint8_t>& get_memo() const {
+		return memo;
+	}
+	
+	uint64_t get_file_size() const {
+		return file_size;
+	}
+	
+	// begin of table i, 1 to 7 = parks, 8 = C1, 9 = C2, 10 = C3
+	uint64_t get_table_begin(int table_index) const {
+		return table_begin.at(table_index);
+	}
+	
+	uint64_t get_num_parks(int table_index) const;
+	
+	uint64_t get_num_c1() const {
+		return num_C1;
+	}
+	
+	const std::vector<uint32_t>& get_c2() const {
+		return C2;
+	}
+	
+	uint32_t read_c1(uint64_t index) const;
+	
+	// returns table 6 positions of all f7 matching the first k bits of challenge
+	std::vector<uint64_t> get_p7_entries(const uint8_t* challenge) const;
+	
+	// returns 32 byte qualities, one for each f7 match
+	std::vector<std::array<uint8_t, 32>> get_qualities(const uint8_t* challenge) const;
+	
+	// returns the 64 x values of proof index (like get_qualities()), in proof order
+	std::vector<uint32_t> get_full_proof(const uint8_t* challenge, size_t index) const;
+	
+	// returns line point at position of table 1 to 6
+	uint128_t read_line_point(int table_index, uint64_t position) const;
+	
+	// returns all line points of a park
+	std::vector<uint128_t> read_park(int table_index, uint64_t park_index) const;
+	
+	// returns all table 6 positions of a P7 park
+	std::vector<uint64_t> read_p7_park(uint64_t park_index) const;
+	
+	// converts 64 x values to 256 byte proof
+	static std::vector<uint8_t> get_proof_bytes(const std::vector<uint32_t>& proof);
+	
+	// decodes a line point park of table 1 to 6, returns first line point, throws on invalid park
+	static uint128_t decode_park(int table_index, const uint8_t* park, std::vector<uint8_t>& deltas);
+	
+	// decodes a C3 park, returns f7 deltas, throws on invalid park
+	static std::vector<uint8_t> decode_c3_park(const uint8_t* park);
+	
+	static uint64_t get_park_size(int table_index);
+	
+	static uint64_t get_c3_park_size();
+
+private:
+	uint64_t read_p7_entry(uint64_t position) const;
+	
+	std::vector<uint8_t> read_c3_deltas(uint64_t index) const;
+	
+	uint128_t read_park(int table_index, uint64_t park_index, std::vector<uint8_t>& deltas) const;
+	
+	void get_inputs(uint64_t position, int depth, std::vector<uint32_t>& out) const;
+	
+	std::vector<uint32_t> reorder_proof(const std::vector<uint32_t>& xs) const;
+	
+	template<typename T, typename S>
+	void reorder_table(int table_index, const std::vector<T>& in, std::vector<S>& out, std::vector<uint32_t>& xs) const;
+
+private:
+	std::string file_name;
+	const uint8_t* data = nullptr;
+	uint64_t file_size = 0;
+	
+	std::array<uint8_t, 32> plot_id = {};
+	std::vector<uint8_t> memo;
+	std::array<uint64_t, 11> table_begin = {};
+	
+	uint64_t num_C1 = 0;
+	std::vector<uint32_t> C2;
+
+};
+
+
+inline
+PlotReader::PlotReader(const std::string& file_name)
+	:	file_name(file_name)
+{
+	file_size = ::get_file_size(file_name.c_str());
+	if(int64_t(file_size) <= 0) {
+		throw std::runtime_error("failed to open " + file_name);
+	}
+	data = mmap_file(file_name, file_size);
+	if(!data) {
+		throw std::runtime_error("mmap() not supported");
+	}
+	try {
+		const std::string header_text = "Proof of Space Plot";
+		if(file_size < 128 || ::memcmp(data, header_text.c_str(), header_text.size())) {
+			throw std::runtime_error("invalid plot header");
+		}
+		size_t offset = header_text.size();
+		::memcpy(plot_id.data(), data + offset, plot_id.size());
+		offset += plot_id.size();
+		
+		if(data[offset] != k) {
+			throw std::runtime_error("unsupported k = " + std::to_string(data[offset]));
+		}
+		offset += 1;
+		offset += 2 + Util::TwoBytesToInt(data + offset);		// format description
+		
+		const size_t memo_size = Util::TwoBytesToInt(data + offset);
+		offset += 2;
+		memo.assign(data + offset, data + offset + memo_size);
+		offset += memo_size;
+		
+		for(int i = 1; i <= 10; ++i) {
+			table_begin[i] = Util::EightBytesToInt(data + offset);
+			offset += 8;
+		}
+		for(int i = 1; i <= 10; ++i) {
+			if(table_begin[i] < offset || table_begin[i] > file_size
+				|| (i > 1 && table_begin[i] < table_begin[i - 1]))
+			{
+				throw std::runtime_error("invalid table pointer " + std::to_string(i));
+			}
+		}
+		
+		// C1 and C2 end with a zero entry
+		num_C1 = (table_begin[9] - table_begin[8]) / 4;
+		num_C1 = num_C1 ? num_C1 - 1 : 0;
+		
+		const uint64_t num_C2 = (table_begin[10] - table_begin[9]) / 4;
+		for(uint64_t i = 0; i + 1 < num_C2; ++i) {
+			C2.push_back(Util::SliceInt64FromBytes(data + table_begin[9] + i * 4, 0, 32));
+		}
+	}
+	catch(...) {
+		munmap_file(file_name, data, file_size);
+		throw;
+	}
+}
+
+inline
+PlotReader::~PlotReader()
+{
+	munmap_file(file_name, data, file_size);
+}
+
+inline
+uint64_t PlotReader::get_park_size(int table_index)
+{
+	if(table_index < 1 || table_index > 7) {
+		throw std::logic_error("invalid table_index");
+	}
+	if(table_index < 7) {
+		return phase3::CalculateParkSize(k, table_index);
+	}
+	return Util::ByteAlign((k + 1) * kEntriesPerPark) / 8;
+}
+
+inline
+uint64_t PlotReader::get_c3_park_size()
+{
+	// same as phase4::CalculateC3Size(k)
+	return Util::ByteAlign(kC3BitsPerEntry * kCheckpoint1Interval) / 8;
+}
+
+inline
+uint64_t PlotReader::get_num_parks(int table_index) const
+{
+	return (table_begin[table_index + 1] - table_begin[table_index]) / get_park_size(table_index);
+}
+
+inline
+uint32_t PlotReader::read_c1(uint64_t index) const
+{
+	return Util::SliceInt64FromBytes(data + table_begin[8] + index * 4, 0, 32);
+}
+
+inline
+std::vector<uint8_t> PlotReader::read_c3_deltas(uint64_t index) const
+{
+	const uint64_t offset = table_begin[10] + index * get_c3_park_size();
+	if(offset + get_c3_park_size() > file_size) {
+		throw std::runtime_error("C3 park out of bounds");
+	}
+	return decode_c3_park(data + offset);
+}
+
+inline
+std::vector<uint8_t> PlotReader::decode_c3_park(const uint8_t* park)
+{
+	const size_t num_bytes = Util::TwoBytesToInt(park);
+	if(num_bytes == 0) {
+		return {};		// last park with single entry
+	}
+	if(num_bytes + 2 > get_c3_park_size()) {
+		throw std::runtime_error("invalid C3 park size");
+	}
+	return Encoding::ANSDecodeDeltas(park + 2, num_bytes, kCheckpoint1Interval, kC3R);
+}
+
+inline
+uint64_t PlotReader::read_p7_entry(uint64_t position) const
+{
+	const uint8_t* park = data + table_begin[7] + (position / kEntriesPerPark) * get_park_size(7);
+	return Util::SliceInt64FromBytes(park, (position % kEntriesPerPark) * (k + 1), k + 1);
+}
+
+inline
+std::vector<uint64_t> PlotReader::read_p7_park(uint64_t park_index) const
+{
+	std::vector<uint64_t> out(kEntriesPerPark);
+	for(uint32_t i = 0; i < kEntriesPerPark; ++i) {
+		out[i] = read_p7_entry(park_index * kEntriesPerPark + i);
+	}
+	return out;
+}
+
+inline
+std::vector<uint64_t> PlotReader::get_p7_entries(const uint8_t* challenge) const
+{
+	if(num_C1 == 0) {
+		return {};
+	}
+	const uint64_t f7 = Util::SliceInt64FromBytes(challenge, 0, k);
+	
+	// find last C1 entry < f7, since equal f7 can span multiple C3 parks
+	uint64_t lower = 0;
+	uint64_t upper = num_C1;
+	if(!C2.empty()) {
+		const auto iter = std::lower_bound(C2.begin(), C2.end(), f7);
+		const uint64_t index = iter - C2.begin();
+		lower = (index ? index - 1 : 0) * kCheckpoint2Interval;
+		upper = std::min(index * kCheckpoint2Interval + 1, num_C1);
+	}
+	while(upper - lower > 1) {
+		const auto middle = (lower + upper) / 2;
+		if(read_c1(middle) < f7) {
+			lower = middle;
+		} else {
+			upper = middle;
+		}
+	}
+	std::vector<uint64_t> positions;
+	for(uint64_t index = lower; index < num_C1; ++index)
+	{
+		uint64_t value = read_c1(index);
+		uint64_t position = index * kCheckpoint1Interval;
+		if(value > f7) {
+			break;
+		}
+		if(value == f7) {
+			positions.push_back(position);
+		}
+		for(const auto delta : read_c3_deltas(index)) {
+			value += delta;
+			position++;
+			if(value > f7) {
+				break;
+			}
+			if(value == f7) {
+				positions.push_back(position);
+			}
+		}
+		if(value > f7) {
+			break;
+		}
+	}
+	std::vector<uint64_t> out;
+	for(const auto position : positions) {
+		out.push_back(read_p7_entry(position));
+	}
+	return out;
+}
+
+inline
+uint128_t PlotReader::read_park(int table_index, uint64_t park_index, std::vector<uint8_t>& deltas) const
+{
+	if(table_index < 1 || table_index > 6) {
+		throw std::logic_error("invalid table_index");
+	}
+	const uint64_t park_size = get_park_size(table_index);
+	const uint64_t offset = table_begin[table_index] + park_index * park_size;
+	if(offset + park_size > table_begin[table_index + 1]) {
+		throw std::runtime_error("park out of bounds");
+	}
+	return decode_park(table_index, data + offset, deltas);
+}
+
+inline
+uint128_t PlotReader::decode_park(int table_index, const uint8_t* park, std::vector<uint8_t>& deltas)
+{
+	const uint128_t first_point = Util::SliceInt128FromBytes(park, 0, 2 * k);
+	
+	const uint8_t* deltas_ptr = park + phase3::CalculateLinePointSize(k) + phase3::CalculateStubsSize(k);
+	uint16_t num_bytes = deltas_ptr[0] | (uint16_t(deltas_ptr[1]) << 8);
+	deltas_ptr += 2;
+	
+	const bool is_raw = num_bytes & 0x8000;
+	num_bytes &= 0x7FFF;
+	
+	if(num_bytes > phase3::CalculateMaxDeltasSize(k, table_index)) {
+		throw std::runtime_error("invalid park deltas size");
+	}
+	if(is_raw) {
+		deltas.assign(deltas_ptr, deltas_ptr + num_bytes);
+	} else {
+		deltas = Encoding::ANSDecodeDeltas(deltas_ptr, num_bytes, kEntriesPerPark - 1, kRValues[table_index - 1]);
+	}
+	return first_point;
+}
+
+inline
+uint128_t PlotReader::read_line_point(int table_index, uint64_t position) const
+{
+	std::vector<uint8_t> deltas;
+	const auto first_point = read_park(table_index, position / kEntriesPerPark, deltas);
+	
+	const uint8_t* stubs = data + table_begin[table_index]
+			+ (position / kEntriesPerPark) * get_park_size(table_index)
+			+ phase3::CalculateLinePointSize(k);
+	const uint32_t stub_size = k - kStubMinusBits;
+	const uint32_t count = std::min<uint32_t>(position % kEntriesPerPark, deltas.size());
+	
+	uint64_t sum_deltas = 0;
+	uint64_t sum_stubs = 0;
+	for(uint32_t i = 0; i < count; ++i) {
+		sum_stubs += Util::SliceInt64FromBytes(stubs, i * stub_size, stub_size);
+		sum_deltas += deltas[i];
+	}
+	return first_point + ((uint128_t(sum_deltas) << stub_size) + sum_stubs);
+}
+
+inline
+std::vector<uint128_t> PlotReader::read_park(int table_index, uint64_t park_index) const
+{
+	std::vector<uint8_t> deltas;
+	const auto first_point = read_park(table_index, park_index, deltas);
+	
+	const uint8_t* stubs = data + table_begin[table_index]
+			+ park_index * get_park_size(table_index)
+			+ phase3::CalculateLinePointSize(k);
+	const uint32_t stub_size = k - kStubMinusBits;
+	
+	std::vector<uint128_t> out;
+	out.reserve(deltas.size() + 1);
+	out.push_back(first_point);
+	for(size_t i = 0; i < deltas.size(); ++i) {
+		const uint64_t stub = Util::SliceInt64FromBytes(stubs, i * stub_size, stub_size);
+		out.push_back(out.back() + ((uint128_t(deltas[i]) << stub_size) + stub));
+	}
+	return out;
+}
+
+inline
+std::vector<std::array<uint8_t, 32>> PlotReader::get_qualities(const uint8_t* challenge) const
+{
+	std::vector<std::array<uint8_t, 32>> out;
+	
+	// last 5 bits of challenge decide which branch to follow
+	const uint32_t quality_index = challenge[31] & 0x1F;
+	
+	for(auto position : get_p7_entries(challenge))
+	{
+		for(int table_index = 6; table_index > 1; --table_index) {
+			const auto xy = Encoding::LinePointToSquare(read_line_point(table_index, position));
+			position = ((quality_index >> (table_index - 2)) & 1) ? xy.first : xy.second;
+		}
+		const auto x1x2 = Encoding::LinePointToSquare(read_line_point(1, position));
+		
+		uint8_t hash_input[32 + 8] = {};
+		::memcpy(hash_input, challenge, 32);
+		Bits(x1x2.second, k).ToBytes(hash_input + 32);
+		Bits(x1x2.first, k).ToBytes(hash_input + 36);
+		
+		std::array<uint8_t, 32> quality;
+		picosha2::hash256(hash_input, hash_input + sizeof(hash_input), quality.begin(), quality.end());
+		out.push_back(quality);
+	}
+	return out;
+}
+
+inline
+void PlotReader::get_inputs(uint64_t position, int depth, std::vector<uint32_t>& out) const
+{
+	const auto xy = Encoding::LinePointToSquare(read_line_point(depth, position));
+	if(depth == 1) {
+		out.push_back(xy.second);
+		out.push_back(xy.first);
+	} else {
+		get_inputs(xy.second, depth - 1, out);
+		get_inputs(xy.first, depth - 1, out);
+	}
+}
+
+template<typename T, typename S>
+void PlotReader::reorder_table(int table_index, const std::vector<T>& in, std::vector<S>& out, std::vector<uint32_t>& xs) const
+{
+	// each input covers 2^(table_index - 2) x values
+	const size_t num_x = size_t(1) << (table_index - 2);
+	
+	phase1::FxCalculator<T, S> Fx(table_index);
+	out.resize(in.size() / 2);
+	
+	for(size_t i = 0; i < out.size(); ++i) {
+		const auto& L = in[2 * i];
+		const auto& R = in[2 * i + 1];
+		if(L.y < R.y) {
+			Fx.evaluate(L, R, out[i]);
+		} else {
+			// swap left and right
+			Fx.evaluate(R, L, out[i]);
+			const auto begin = xs.begin() + 2 * i * num_x;
+			std::rotate(begin, begin + num_x, begin + 2 * num_x);
+		}
+	}
+}
+
+inline
+std::vector<uint32_t> PlotReader::reorder_proof(const std::vector<uint32_t>& input) const
+{
+	if(input.size() != 64) {
+		throw std::logic_error("invalid proof size");
+	}
+	std::vector<uint32_t> xs = input;
+	
+	phase1::F1Calculator F1(plot_id.data());
+	std::vector<phase1::entry_1> table_1(64);
+	F1.compute_entries(xs.data(), xs.size(), table_1.data());
+	std::vector<phase1::entry_2> table_2;
+	std::vector<phase1::entry_3> table_3;
+	std::vector<phase1::entry_4> table_4;
+	std::vector<phase1::entry_5> table_5;
+	std::vector<phase1::entry_6> table_6;
+	std::vector<phase1::entry_7> table_7;
+	reorder_table(2, table_1, table_2, xs);
+	reorder_table(3, table_2, table_3, xs);
+	reorder_table(4, table_3, table_4, xs);
+	reorder_table(5, table_4, table_5, xs);
+	reorder_table(6, table_5, table_6, xs);
+	reorder_table(7, table_6, table_7, xs);
+	return xs;
+}
+
+inline
+std::vector<uint32_t> PlotReader::get_full_proof(const uint8_t* challenge, size_t index) const
+{
+	const auto entries = get_p7_entries(challenge);
+	if(index >= entries.size()) {
+		throw std::logic_error("invalid proof index");
+	}
+	std::vector<uint32_t> xs;
+	get_inputs(entries[index], 6, xs);
+	return reorder_proof(xs);
+}
+
+inline
+std::vector<uint8_t> PlotReader::get_proof_bytes(const std::vector<uint32_t>& proof)
+{
+	std::vector<uint8_t> out(proof.size() * 4);
+	for(size_t i = 0; i < proof.size(); ++i) {
+		Bits(proof[i], 32).ToBytes(out.data() + i * 4);
+	}
+	return out;
+}
+
+
+#endif /* INCLUDE_CHIA_PLOTREADER_HPP_ */
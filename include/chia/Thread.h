@@ -8,10 +8,13 @@
 #ifndef INCLUDE_CHIA_THREAD_H_
 #define INCLUDE_CHIA_THREAD_H_
 
+#include <chia/trace.h>
+
 #include <mutex>
 #include <thread>
 #include <atomic>
 #include <iostream>
+#include <exception>
 #include <functional>
 #include <condition_variable>
 
@@ -43,7 +46,17 @@ public:
 	}
 	
 	virtual ~Thread() {
-		close();
+		if(is_closed) {
+			return;		// any failure was thrown by close() already
+		}
+		try {
+			close();
+		} catch(const std::exception& ex) {
+			// either we are unwinding, or close() was missed
+			if(!std::uncaught_exceptions()) {
+				std::cout << "Error: Thread not closed, " << ex.what() << std::endl;
+			}
+		}
 	}
 	
 	// thread-safe
@@ -84,13 +97,20 @@ public:
 	
 	// NOT thread-safe
 	void close() {
-		wait();
+		is_closed = true;
 		std::unique_lock<std::mutex> lock(mutex);
+		while(do_run && (is_avail || is_busy)) {
+			signal.wait(lock);
+		}
 		do_run = false;
 		if(thread.joinable()) {
 			lock.unlock();
 			signal.notify_all();
 			thread.join();
+			lock.lock();
+		}
+		if(is_fail) {
+			throw std::runtime_error("thread failed with: " + ex_what);
 		}
 	}
 	
@@ -107,6 +127,10 @@ private:
 			pthread_setname_np(pthread_self(), thread_name.c_str());
 #endif
 		}
+		// decided once per thread, so tracing costs nothing when disabled
+		const bool do_trace = is_trace_enabled();
+		const uint32_t trace_name = do_trace ? trace_thread_begin(name.empty() ? "thread" : name) : 0;
+		
 		std::unique_lock<std::mutex> lock(mutex);
 		while(true) {
 			while(do_run && !is_avail) {
@@ -122,7 +146,11 @@ private:
 			lock.unlock();
 			signal.notify_all();		// notify about is_busy + is_avail change
 			try {
+				const auto time_begin = do_trace ? get_time_micros() : 0;
 				execute(tmp);
+				if(do_trace) {
+					trace_add(trace_name, time_begin, get_time_micros());
+				}
 				lock.lock();
 			} catch(const std::exception& ex) {
 				lock.lock();
@@ -139,6 +167,7 @@ private:
 	T input;
 	bool do_run = true;
 	bool is_fail = false;
+	bool is_closed = false;
 	bool is_busy = false;
 	bool is_avail = false;
 	std::mutex mutex;
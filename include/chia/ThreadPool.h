@@ -12,6 +12,7 @@
 
 #include <vector>
 #include <memory>
+#include <exception>
 
 
 template<typename T, typename S, typename L = size_t>
@@ -48,7 +49,14 @@ public:
 	}
 	
 	~ThreadPool() {
-		close();
+		try {
+			close();
+		} catch(const std::exception& ex) {
+			// either we are unwinding, or close() was missed
+			if(!std::uncaught_exceptions()) {
+				std::cout << "Error: ThreadPool not closed, " << ex.what() << std::endl;
+			}
+		}
 	}
 	
 	// NOT thread-safe
@@ -70,13 +78,22 @@ public:
 		}
 	}
 	
-	// NOT thread-safe
+	// closes all threads even if one failed, then throws the first failure [NOT thread-safe]
 	void close() {
-		wait();
+		std::exception_ptr error;
 		for(const auto& state : threads) {
-			state->thread->close();
+			try {
+				state->thread->close();
+			} catch(...) {
+				if(!error) {
+					error = std::current_exception();
+				}
+			}
 		}
 		threads.clear();
+		if(error) {
+			std::rethrow_exception(error);
+		}
 	}
 	
 	// NOT thread-safe
@@ -102,21 +119,48 @@ private:
 	void wrapper(thread_t* state, thread_t* prev, T& input)
 	{
 		S out;
-		execute(input, out, state->local);
+		std::exception_ptr error;
+		try {
+			execute(input, out, state->local);
+		} catch(...) {
+			error = std::current_exception();
+		}
+		
+		// on failure too, otherwise the next job could output before the previous ones
+		const bool do_trace = is_trace_enabled();
 		{
 			std::unique_lock<std::mutex> lock(prev->mutex);
-			while(prev->job < state->job) {
-				prev->signal.wait(lock);
+			if(prev->job < state->job) {
+				const auto time_begin = do_trace ? get_time_micros() : 0;
+				while(prev->job < state->job) {
+					prev->signal.wait(lock);
+				}
+				if(do_trace) {
+					trace_add(TRACE_WAIT, time_begin, get_time_micros());
+				}
 			}
 		}
-		if(output) {
-			output->take(out);	// only one thread can be at this position
+		if(output && !error) {
+			const auto time_begin = do_trace ? get_time_micros() : 0;
+			try {
+				output->take(out);	// only one thread can be at this position
+			} catch(...) {
+				error = std::current_exception();
+			}
+			if(do_trace) {
+				trace_add(TRACE_OUTPUT, time_begin, get_time_micros());
+			}
 		}
+		// don't block the next job forever, failure is reported via Thread::wait()
 		{
 			std::lock_guard<std::mutex> lock(state->mutex);
 			state->job = -1;
 		}
 		state->signal.notify_all();
+		
+		if(error) {
+			std::rethrow_exception(error);
+		}
 	}
 	
 private:
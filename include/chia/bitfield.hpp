@@ -16,6 +16,7 @@
 #define INCLUDE_CHIA_BITFIELD_H_
 
 #include <chia/util.hpp>
+#include <chia/cpu_features.h>
 
 #include <memory>
 #include <atomic>
@@ -67,11 +68,8 @@ struct bitfield
         auto const* start = buffer_.get() + start_bit / 64;
         auto const* end = buffer_.get() + end_bit / 64;
         
-        int64_t ret = 0;
-        while (start != end) {
-            ret += Util::PopCount(*start);
-            ++start;
-        }
+        static_assert(sizeof(*start) == sizeof(uint64_t), "unexpected atomic<uint64_t> layout");
+        int64_t ret = g_cpu_kernels.popcount((const uint64_t*)start, end - start);
         int const tail = end_bit % 64;
         if (tail > 0) {
             uint64_t const mask = (uint64_t(1) << tail) - 1;
@@ -0,0 +1,29 @@
+/*
+ * blake3_short.h
+ *
+ *  Created on: Jun 23, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_BLAKE3_SHORT_H_
+#define INCLUDE_CHIA_BLAKE3_SHORT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+ * BLAKE3 of count inputs of the same length (<= 64 bytes, ie. a single block), as used by Fx.
+ * Input i is at input + i * 64, output i (32 bytes) at out + i * 32.
+ * Uses AVX2 (8 inputs at once) when supported, see g_cpu_kernels. [thread-safe]
+ */
+void blake3_hash_short(const uint8_t* input, size_t length, size_t count, uint8_t* out);
+
+/*
+ * Kernels for g_cpu_kernels.blake3_short
+ */
+void blake3_hash_short_sw(const uint8_t* input, size_t length, size_t count, uint8_t* out);
+void blake3_hash_short_avx2(const uint8_t* input, size_t length, size_t count, uint8_t* out);
+
+
+#endif /* INCLUDE_CHIA_BLAKE3_SHORT_H_ */
@@ -11,6 +11,7 @@
 #include <chrono>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include <chia/settings.h>
 
@@ -75,6 +76,8 @@ static const std::string kFormatDescription = "v1.0";
 struct table_t {
 	std::string file_name;
 	size_t num_entries = 0;
+	size_t checksum_block = 0;			// entries per checksum, 0 = none
+	std::vector<uint32_t> checksums;	// CRC32C of each block, see g_verify_tmp
 };
 
 
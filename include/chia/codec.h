@@ -0,0 +1,332 @@
+/*
+ * codec.h
+ *
+ *  Created on: Jun 21, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_CODEC_H_
+#define INCLUDE_CHIA_CODEC_H_
+
+#include <chia/cpu_features.h>
+
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CHIA_CODEC_AVX2
+#endif
+
+
+/*
+ * Decodes / encodes via T::read() / T::write() per entry.
+ */
+template<typename T>
+struct default_codec_t {
+	static void decode(const uint8_t* src, T* dst, const size_t count) {
+		for(size_t i = 0; i < count; ++i) {
+			dst[i].read(src + i * T::disk_size);
+		}
+	}
+	static void encode(const T* src, uint8_t* dst, const size_t count) {
+		for(size_t i = 0; i < count; ++i) {
+			src[i].write(dst + i * T::disk_size);
+		}
+	}
+};
+
+/*
+ * Bulk decode / encode of table entries, specialized per entry type (see shuffle_codec_t below).
+ */
+template<typename T>
+struct codec_t : default_codec_t<T> {};
+
+template<typename T>
+void decode_block(const uint8_t* src, T* dst, const size_t count) {
+	codec_t<T>::decode(src, dst, count);
+}
+
+template<typename T>
+void encode_block(const T* src, uint8_t* dst, const size_t count) {
+	codec_t<T>::encode(src, dst, count);
+}
+
+/*
+ * Byte shuffle from records of in_stride to records of out_stride, computed once per type.
+ * Records are processed in periods of 32 byte output chunks, each half gathered from two 16 byte input windows.
+ */
+struct shuffle_plan_t {
+	static constexpr size_t max_pairs = 16;
+	
+	bool valid = false;
+	bool two_windows = false;		// if any output chunk spans more than 16 input bytes
+	size_t num_records = 0;			// per period
+	size_t in_size = 0;				// bytes per period
+	size_t out_size = 0;
+	size_t read_size = 0;			// input bytes touched per period, windows overlap into the next
+	std::vector<size_t> window;		// input offset of first window for each chunk
+	std::vector<std::array<uint8_t, 16>> mask;		// [chunk * 2 + window]
+	
+	// map[i] = index in input record for byte i of output record, -1 = zero
+	shuffle_plan_t(const size_t in_stride, const size_t out_stride, const std::vector<int>& map)
+	{
+		size_t gcd = 32;
+		while(out_stride % gcd) {
+			gcd >>= 1;
+		}
+		num_records = 32 / gcd;
+		in_size = num_records * in_stride;
+		out_size = num_records * out_stride;
+		
+		for(size_t chunk = 0; chunk < out_size / 16; ++chunk)
+		{
+			int index[16];
+			size_t first = in_size;
+			for(size_t i = 0; i < 16; ++i) {
+				const size_t k = chunk * 16 + i;
+				const int pos = map[k % out_stride];
+				index[i] = pos < 0 ? -1 : int((k / out_stride) * in_stride + pos);
+				if(index[i] >= 0) {
+					first = std::min(first, size_t(index[i]));
+				}
+			}
+			if(first == in_size) {
+				first = 0;
+			}
+			std::array<uint8_t, 16> mask_0;
+			std::array<uint8_t, 16> mask_1;
+			for(size_t i = 0; i < 16; ++i) {
+				mask_0[i] = 0x80;
+				mask_1[i] = 0x80;
+				if(index[i] < 0) {
+					continue;
+				}
+				const size_t offset = index[i] - first;
+				if(offset < 16) {
+					mask_0[i] = offset;
+				} else if(offset < 32) {
+					mask_1[i] = offset - 16;
+					two_windows = true;
+				} else {
+					return;
+				}
+			}
+			window.push_back(first);
+			mask.push_back(mask_0);
+			mask.push_back(mask_1);
+		}
+		for(const auto offset : window) {
+			read_size = std::max(read_size, offset + (two_windows ? 32 : 16));
+		}
+		valid = true;
+	}
+	
+	// returns number of records done, the rest is left to the caller
+	size_t apply(const uint8_t* src, uint8_t* dst, const size_t count) const
+	{
+		return valid ? g_cpu_kernels.shuffle(*this, src, dst, count) : 0;
+	}
+
+#ifdef CHIA_CODEC_AVX2
+	__attribute__((target("avx2")))
+	static __m256i load_pair(const uint8_t* first, const uint8_t* second) {
+		return _mm256_inserti128_si256(_mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i*)first)), _mm_loadu_si128((const __m128i*)second), 1);
+	}
+	
+	__attribute__((target("avx2")))
+	size_t apply_avx2(const uint8_t* src, uint8_t* dst, const size_t count) const
+	{
+		const size_t num_pairs = window.size() / 2;
+		if(num_pairs > max_pairs) {
+			return 0;
+		}
+		__m256i mask_lo[max_pairs];
+		__m256i mask_hi[max_pairs];
+		for(size_t i = 0; i < num_pairs; ++i) {
+			mask_lo[i] = load_pair(mask[i * 4].data(), mask[i * 4 + 2].data());
+			mask_hi[i] = load_pair(mask[i * 4 + 1].data(), mask[i * 4 + 3].data());
+		}
+		const size_t num_periods = count / num_records;
+		const uint8_t* const src_end = src + count * (in_size / num_records);
+		
+		size_t period = 0;
+		for(const uint8_t* in = src; period < num_periods && in + read_size <= src_end; ++period, in += in_size)
+		{
+			uint8_t* out = dst + period * out_size;
+			for(size_t i = 0; i < num_pairs; ++i) {
+				const uint8_t* in_0 = in + window[i * 2];
+				const uint8_t* in_1 = in + window[i * 2 + 1];
+				__m256i res = _mm256_shuffle_epi8(load_pair(in_0, in_1), mask_lo[i]);
+				if(two_windows) {
+					res = _mm256_or_si256(res, _mm256_shuffle_epi8(load_pair(in_0 + 16, in_1 + 16), mask_hi[i]));
+				}
+				_mm256_storeu_si256((__m256i*)(out + i * 32), res);
+			}
+		}
+		return period * num_records;
+	}
+#endif
+
+};
+
+/*
+ * Kernels for g_cpu_kernels.shuffle
+ */
+inline
+size_t shuffle_apply_none(const shuffle_plan_t& plan, const uint8_t* src, uint8_t* dst, const size_t count) {
+	return 0;
+}
+
+#ifdef CHIA_CODEC_AVX2
+inline
+size_t shuffle_apply_avx2(const shuffle_plan_t& plan, const uint8_t* src, uint8_t* dst, const size_t count) {
+	return plan.apply_avx2(src, dst, count);
+}
+#endif
+
+/*
+ * Field of size bytes at offset in memory, stored as little endian.
+ */
+template<size_t Offset, size_t Size>
+struct field_t {
+	static constexpr size_t offset = Offset;
+	static constexpr size_t size = Size;
+};
+
+/*
+ * Sort key Key{}(entry) extracted directly from a record in disk format, see DiskSort.
+ * The default decodes the whole entry, specialized per entry type where the key is a field on disk.
+ */
+template<typename T, typename Key>
+struct disk_key_t {
+	static uint64_t get(const uint8_t* record) {
+		T tmp;
+		tmp.read(record);
+		return Key{}(tmp);
+	}
+};
+
+/*
+ * Key stored as little endian field of size bytes at offset on disk, with mask applied.
+ */
+template<size_t Offset, size_t Size, uint64_t Mask = ~uint64_t(0)>
+struct disk_field_key_t {
+	static_assert(Size <= 8, "key field too large");
+	static uint64_t get(const uint8_t* record) {
+		// split into loads of 8, 4, 2 and 1 bytes, a memcpy of odd size into key stalls on store forwarding
+		const uint8_t* src = record + Offset;
+		uint64_t key = 0;
+		size_t pos = 0;
+		if(Size & 8) {
+			key |= load<uint64_t>(src);
+			pos += 8;
+		}
+		if(Size & 4) {
+			key |= uint64_t(load<uint32_t>(src + pos)) << (pos * 8);
+			pos += 4;
+		}
+		if(Size & 2) {
+			key |= uint64_t(load<uint16_t>(src + pos)) << (pos * 8);
+			pos += 2;
+		}
+		if(Size & 1) {
+			key |= uint64_t(src[pos]) << (pos * 8);
+		}
+		return key & Mask;
+	}
+private:
+	template<typename V>
+	static V load(const uint8_t* src) {
+		V value;
+		::memcpy(&value, src, sizeof(V));
+		return value;
+	}
+};
+
+/*
+ * For entries where disk format is a plain concatenation of (truncated) fields, in order of Fields.
+ * Bytes in memory not covered by a field are set to zero (upper bytes of truncated fields, padding).
+ */
+template<typename T, typename... Fields>
+struct shuffle_codec_t {
+	static_assert(std::is_trivially_copyable<T>::value, "T not trivially copyable");
+	static_assert((Fields::size + ...) == T::disk_size, "fields do not match disk_size");
+	
+	// offset on disk of the field at offset in memory
+	static constexpr size_t get_disk_offset(const size_t offset) {
+		constexpr size_t offsets[] = {Fields::offset...};
+		constexpr size_t sizes[] = {Fields::size...};
+		size_t pos = 0;
+		for(size_t i = 0; i < sizeof...(Fields); ++i) {
+			if(offsets[i] == offset) {
+				return pos;
+			}
+			pos += sizes[i];
+		}
+		return T::disk_size;
+	}
+	
+	static constexpr size_t get_disk_size(const size_t offset) {
+		constexpr size_t offsets[] = {Fields::offset...};
+		constexpr size_t sizes[] = {Fields::size...};
+		for(size_t i = 0; i < sizeof...(Fields); ++i) {
+			if(offsets[i] == offset) {
+				return sizes[i];
+			}
+		}
+		return 0;
+	}
+	
+	// key extractor for the field at offset in memory, see disk_key_t
+	template<size_t Offset>
+	struct field_key_t : disk_field_key_t<get_disk_offset(Offset), get_disk_size(Offset)> {
+		static_assert(get_disk_size(Offset) > 0, "no field at this offset");
+	};
+	
+	// offset in memory for each byte on disk
+	static std::vector<int> get_layout() {
+		std::vector<int> out;
+		for(const auto& field : {std::make_pair(Fields::offset, Fields::size)...}) {
+			for(size_t i = 0; i < field.second; ++i) {
+				out.push_back(field.first + i);
+			}
+		}
+		return out;
+	}
+	
+	static const shuffle_plan_t& get_decode_plan() {
+		static const shuffle_plan_t plan = []() {
+			const auto layout = get_layout();
+			std::vector<int> map(sizeof(T), -1);
+			for(size_t i = 0; i < layout.size(); ++i) {
+				map[layout[i]] = i;
+			}
+			return shuffle_plan_t(T::disk_size, sizeof(T), map);
+		}();
+		return plan;
+	}
+	
+	static const shuffle_plan_t& get_encode_plan() {
+		static const shuffle_plan_t plan(sizeof(T), T::disk_size, get_layout());
+		return plan;
+	}
+	
+	static void decode(const uint8_t* src, T* dst, const size_t count) {
+		const size_t num_done = get_decode_plan().apply(src, (uint8_t*)dst, count);
+		default_codec_t<T>::decode(src + num_done * T::disk_size, dst + num_done, count - num_done);
+	}
+	static void encode(const T* src, uint8_t* dst, const size_t count) {
+		const size_t num_done = get_encode_plan().apply((const uint8_t*)src, dst, count);
+		default_codec_t<T>::encode(src + num_done, dst + num_done * T::disk_size, count - num_done);
+	}
+};
+
+
+#endif /* INCLUDE_CHIA_CODEC_H_ */
@@ -0,0 +1,84 @@
+/*
+ * cpu_features.h
+ *
+ *  Created on: Jun 22, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_CPU_FEATURES_H_
+#define INCLUDE_CHIA_CPU_FEATURES_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+struct chacha8_ctx;
+struct shuffle_plan_t;
+
+
+/*
+ * Instruction set extensions used by the kernels below (x86_64 only, none on other platforms).
+ */
+enum {
+	CPU_POPCNT = 1,
+	CPU_SSE42 = 2,
+	CPU_AVX2 = 4,
+	CPU_ALL = CPU_POPCNT | CPU_SSE42 | CPU_AVX2
+};
+
+/*
+ * Function pointers for all SIMD kernels, set at startup according to get_cpu_features().
+ * Each has a portable version, so a binary built without -march runs on any x86_64.
+ */
+struct cpu_kernels_t {
+	// number of set bits in words[0 .. count), see bitfield::count()
+	uint64_t (*popcount)(const uint64_t* words, size_t count);
+	
+	// CRC32C without pre / post inversion, see crc32c()
+	uint32_t (*crc32c)(const uint8_t* data, size_t length, uint32_t crc);
+	
+	// same as chacha8_get_keystream(), see F1Calculator
+	void (*chacha8_keystream)(const chacha8_ctx* ctx, uint64_t pos, uint32_t n_blocks, uint8_t* out);
+	
+	// keystream blocks at positions pos[0 .. n_blocks), see F1Calculator::compute_entries()
+	void (*chacha8_blocks)(const chacha8_ctx* ctx, const uint64_t* pos, uint32_t n_blocks, uint8_t* out);
+	
+	// see blake3_hash_short()
+	void (*blake3_short)(const uint8_t* input, size_t length, size_t count, uint8_t* out);
+	
+	// returns number of records done, see shuffle_plan_t::apply()
+	size_t (*shuffle)(const shuffle_plan_t& plan, const uint8_t* src, uint8_t* dst, size_t count);
+};
+
+extern cpu_kernels_t g_cpu_kernels;
+
+/*
+ * Returns features supported by CPU and OS, detected once via cpuid. [thread-safe]
+ */
+uint32_t detect_cpu_features();
+
+/*
+ * Returns features the kernels are currently selected for. [thread-safe]
+ */
+uint32_t get_cpu_features();
+
+/*
+ * Restricts kernels to the given features, like "avx2,popcnt", "none" or "native" (all detected).
+ * Throws if a feature is unknown or not supported by this CPU.
+ * Needs to be called before any pipeline is started. [NOT thread-safe]
+ */
+void set_cpu_features(const std::string& list);
+
+/*
+ * Returns features as a list like "popcnt,sse4.2,avx2", or "none".
+ */
+std::string cpu_features_to_string(uint32_t features);
+
+/*
+ * Portable / popcnt kernels for g_cpu_kernels.popcount
+ */
+uint64_t popcount_sw(const uint64_t* words, size_t count);
+uint64_t popcount_popcnt(const uint64_t* words, size_t count);
+
+
+#endif /* INCLUDE_CHIA_CPU_FEATURES_H_ */
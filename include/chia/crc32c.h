@@ -0,0 +1,33 @@
+/*
+ * crc32c.h
+ *
+ *  Created on: Jun 21, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_CRC32C_H_
+#define INCLUDE_CHIA_CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+ * CRC32C (Castagnoli) of data, continuing from crc (result of previous call, 0 to start).
+ * Uses SSE4.2 crc32 instruction when supported, see g_cpu_kernels. [thread-safe]
+ */
+uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0);
+
+/*
+ * Returns CRC32C of A followed by B, given CRC32C of A and B and the length of B. [thread-safe]
+ */
+uint32_t crc32c_combine(uint32_t crc_A, uint32_t crc_B, uint64_t length_B);
+
+/*
+ * Kernels for g_cpu_kernels.crc32c, without pre / post inversion.
+ */
+uint32_t crc32c_sw(const uint8_t* data, size_t length, uint32_t crc);
+uint32_t crc32c_sse42(const uint8_t* data, size_t length, uint32_t crc);
+
+
+#endif /* INCLUDE_CHIA_CRC32C_H_ */
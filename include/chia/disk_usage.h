@@ -0,0 +1,37 @@
+/*
+ * disk_usage.h
+ *
+ *  Created on: Jun 9, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_DISK_USAGE_H_
+#define INCLUDE_CHIA_DISK_USAGE_H_
+
+#include <string>
+#include <cstdint>
+
+
+/*
+ * Returns the directory a file is accounted to, "" for $PWD and "ram:" for the RAM disk.
+ */
+std::string get_usage_dir(const std::string& file_name);
+
+/*
+ * Adds num_bytes (can be negative) to the space used by file_name. [thread-safe]
+ */
+void disk_usage_add(const std::string& file_name, int64_t num_bytes);
+
+/*
+ * Releases all space used by file_name. [thread-safe]
+ */
+void disk_usage_remove(const std::string& file_name);
+
+/*
+ * Prints peak usage per directory since the last call and resets it,
+ * or the peak over the whole run if total = true. [thread-safe]
+ */
+void print_disk_usage(const std::string& prefix, bool total = false);
+
+
+#endif /* INCLUDE_CHIA_DISK_USAGE_H_ */
@@ -233,6 +233,8 @@ public:
         if (FSE_isError(err)) {
             throw InvalidStateException(FSE_getErrorName(err));
         }
+        // numDeltas is only an upper bound (for the last park)
+        deltas.resize(err);
 
         for (uint32_t i = 0; i < deltas.size(); i++) {
             if (deltas[i] == 0xff) {
@@ -0,0 +1,65 @@
+/*
+ * io_stats.h
+ *
+ *  Created on: Jun 11, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_IO_STATS_H_
+#define INCLUDE_CHIA_IO_STATS_H_
+
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+
+inline
+int64_t get_time_micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Records one read or write of num_bytes to file_name, which took time_us.
+ * time_us < 0 means no syscall was involved (mmap, RAM disk), ie. not part of latency. [thread-safe]
+ */
+void io_stats_add(const std::string& file_name, bool is_write, uint64_t num_bytes, int64_t time_us = -1);
+
+/*
+ * Same as above, for streams opened via fopen_ex(). [thread-safe]
+ */
+void io_stats_add(FILE* file, bool is_write, uint64_t num_bytes, int64_t time_us = -1);
+
+/*
+ * Associates a stream with a file name. [thread-safe]
+ */
+void io_stats_open(FILE* file, const std::string& file_name);
+
+/*
+ * Removes the association, needs to be called before fclose(). [thread-safe]
+ */
+void io_stats_close(FILE* file);
+
+/*
+ * Starts a new section (like "P1"), following stats are accounted to it. [thread-safe]
+ */
+void io_stats_begin(const std::string& name);
+
+/*
+ * Returns total bytes read / written in the last section of given name. [thread-safe]
+ */
+void get_io_stats(const std::string& name, uint64_t& num_read, uint64_t& num_write);
+
+/*
+ * Prints stats per directory / device for the current section. [thread-safe]
+ */
+void print_io_stats(const std::string& prefix);
+
+/*
+ * Writes all stats as JSON, per section, directory and file. [thread-safe]
+ */
+void write_io_stats(const std::string& file_name);
+
+
+#endif /* INCLUDE_CHIA_IO_STATS_H_ */
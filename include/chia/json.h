@@ -0,0 +1,125 @@
+/*
+ * json.h
+ *
+ *  Created on: Jun 21, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_JSON_H_
+#define INCLUDE_CHIA_JSON_H_
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+
+/*
+ * Returns str as a quoted JSON string, with quotes, backslashes and control characters escaped.
+ */
+inline
+std::string json_string(const std::string& str)
+{
+	std::string out = "\"";
+	for(const char c : str) {
+		switch(c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\b': out += "\\b"; break;
+			case '\f': out += "\\f"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if((unsigned char)c < 0x20) {
+					char tmp[8];
+					::snprintf(tmp, sizeof(tmp), "\\u%04x", (unsigned int)c);
+					out += tmp;
+				} else {
+					out += c;
+				}
+		}
+	}
+	return out + "\"";
+}
+
+/*
+ * Returns position right after "key": in json[begin, end), or npos if not found.
+ * Only meant for the flat JSON written by this project (like test.e2e.json), not a full parser.
+ */
+inline
+size_t json_find_key(const std::string& json, const std::string& key, size_t begin = 0, size_t end = std::string::npos)
+{
+	const auto name = json_string(key);
+	end = std::min(end, json.size());
+	for(auto pos = json.find(name, begin); pos < end; pos = json.find(name, pos + 1)) {
+		auto next = json.find_first_not_of(" \t\r\n", pos + name.size());
+		if(next < end && json[next] == ':') {
+			return json.find_first_not_of(" \t\r\n", next + 1);
+		}
+	}
+	return std::string::npos;
+}
+
+/*
+ * Returns the object {...} of "section" as [begin, end), or false if not found.
+ */
+inline
+bool json_find_object(const std::string& json, const std::string& section, size_t& begin, size_t& end)
+{
+	begin = json_find_key(json, section);
+	if(begin >= json.size() || json[begin] != '{') {
+		return false;
+	}
+	int depth = 0;
+	for(end = begin; end < json.size(); ++end) {
+		if(json[end] == '{') {
+			depth++;
+		} else if(json[end] == '}' && --depth == 0) {
+			end++;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Reads number "key" (in object "section" if not empty) into value, returns false if not found.
+ */
+inline
+bool json_get_number(const std::string& json, const std::string& section, const std::string& key, double& value)
+{
+	size_t begin = 0;
+	size_t end = json.size();
+	if(!section.empty() && !json_find_object(json, section, begin, end)) {
+		return false;
+	}
+	const auto pos = json_find_key(json, key, begin, end);
+	if(pos >= end) {
+		return false;
+	}
+	char* num_end = nullptr;
+	value = ::strtod(json.c_str() + pos, &num_end);
+	return num_end != json.c_str() + pos;
+}
+
+/*
+ * Reads string "key" into value (without escapes), returns false if not found.
+ */
+inline
+bool json_get_string(const std::string& json, const std::string& key, std::string& value)
+{
+	const auto pos = json_find_key(json, key);
+	if(pos >= json.size() || json[pos] != '"') {
+		return false;
+	}
+	const auto end = json.find('"', pos + 1);
+	if(end == std::string::npos) {
+		return false;
+	}
+	value = json.substr(pos + 1, end - pos - 1);
+	return true;
+}
+
+
+#endif /* INCLUDE_CHIA_JSON_H_ */
@@ -0,0 +1,44 @@
+/*
+ * perf_stats.h
+ *
+ *  Created on: Jun 20, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_PERF_STATS_H_
+#define INCLUDE_CHIA_PERF_STATS_H_
+
+#include <string>
+#include <cstdint>
+
+
+struct perf_stats_t {
+	int64_t time_us = 0;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t llc_misses = 0;
+	uint64_t dtlb_misses = 0;
+	uint64_t branch_misses = 0;
+};
+
+/*
+ * Opens hardware counters via perf_event_open() for the whole process.
+ * Threads created afterwards are counted too, but only once they exit,
+ * which is fine since pipeline threads live for one table at most.
+ * Returns false if not supported (Linux only, needs kernel.perf_event_paranoid <= 2). [NOT thread-safe]
+ */
+bool perf_stats_init();
+
+/*
+ * Returns current counter values (scaled when multiplexed), all zero if not initialized. [thread-safe]
+ */
+perf_stats_t get_perf_stats();
+
+/*
+ * Prints IPC, cache / TLB / branch misses and estimated memory bandwidth since begin.
+ * Does nothing if not initialized. [thread-safe]
+ */
+void print_perf_stats(const std::string& prefix, const perf_stats_t& begin);
+
+
+#endif /* INCLUDE_CHIA_PERF_STATS_H_ */
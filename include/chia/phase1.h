@@ -10,6 +10,7 @@
 
 #include <chia/chia.h>
 #include <chia/entries.h>
+#include <chia/codec.h>
 #include <chia/DiskSort.h>
 #include <chia/util.hpp>
 
@@ -157,6 +158,14 @@ struct get_y {
 	}
 };
 
+// BC group index
+template<typename T>
+struct get_group {
+	uint64_t operator()(const T& entry) {
+		return entry.y / kBC;
+	}
+};
+
 template<typename T>
 struct get_meta {
 	void operator()(const T& entry, uint8_t* bytes, size_t* num_bytes) {
@@ -215,4 +224,34 @@ struct output_t {
 
 } // phase1
 
+template<>
+struct codec_t<phase1::entry_1> : shuffle_codec_t<phase1::entry_1,
+		field_t<offsetof(phase1::entry_1, y), 5>, field_t<offsetof(phase1::entry_1, x), 4>> {};
+
+template<>
+struct codec_t<phase1::entry_7> : shuffle_codec_t<phase1::entry_7,
+		field_t<offsetof(phase1::entry_7, y), 4>, field_t<offsetof(phase1::entry_7, pos), 4>,
+		field_t<offsetof(phase1::entry_7, off), 2>> {};
+
+template<>
+struct codec_t<phase1::tmp_entry_1> : shuffle_codec_t<phase1::tmp_entry_1,
+		field_t<offsetof(phase1::tmp_entry_1, x), 4>> {};
+
+template<>
+struct codec_t<phase1::tmp_entry_x> : shuffle_codec_t<phase1::tmp_entry_x,
+		field_t<offsetof(phase1::tmp_entry_x, pos), 4>, field_t<offsetof(phase1::tmp_entry_x, off), 2>> {};
+
+template<>
+struct disk_key_t<phase1::entry_1, phase1::get_y<phase1::entry_1>>
+	: codec_t<phase1::entry_1>::field_key_t<offsetof(phase1::entry_1, y)> {};
+
+template<>
+struct disk_key_t<phase1::entry_7, phase1::get_y<phase1::entry_7>>
+	: codec_t<phase1::entry_7>::field_key_t<offsetof(phase1::entry_7, y)> {};
+
+// y shares its upper byte with off, see entry_xm::read()
+template<int N>
+struct disk_key_t<phase1::entry_xm<N>, phase1::get_y<phase1::entry_xm<N>>>
+	: disk_field_key_t<0, 5, 0x3FFFFFFFFFull> {};
+
 #endif /* INCLUDE_CHIA_PHASE1_H_ */
@@ -12,6 +12,7 @@
 #include <chia/ThreadPool.h>
 #include <chia/DiskTable.h>
 #include <chia/bits.hpp>
+#include <chia/cpu_features.h>
 
 #include "b3/blake3.h"
 #include "chacha8.h"
@@ -39,20 +40,41 @@ static void initialize() {
 	load_tables();
 }
 
+/*
+ * Returns true if y_L and y_R match, same condition as FxMatcher. Needs initialize().
+ */
+inline
+bool is_match(const uint64_t y_L, const uint64_t y_R)
+{
+	if(y_R / kBC != y_L / kBC + 1) {
+		return false;
+	}
+	const uint16_t* targets = L_targets[(y_L / kBC) % 2][y_L % kBC];
+	for(int i = 0; i < kExtraBitsPow; ++i) {
+		if(targets[i] == y_R % kBC) {
+			return true;
+		}
+	}
+	return false;
+}
+
 class F1Calculator {
 public:
+	static constexpr uint8_t k = 32;
+	static constexpr uint64_t num_entries = uint64_t(1) << k;	// one per x
+	
 	F1Calculator(const uint8_t* orig_key)
 	{
 		uint8_t enc_key[32] = {};
-
+		
 		// First byte is 1, the index of this table
 		enc_key[0] = 1;
 		memcpy(enc_key + 1, orig_key, 31);
-
+		
 		// Setup ChaCha8 context with zero-filled IV
 		chacha8_keysetup(&enc_ctx_, enc_key, 256, NULL);
 	}
-
+	
 	/*
 	 * x = [index * 16 .. index * 16 + 15]
 	 * block = entry_1[16]
@@ -60,29 +82,83 @@ public:
 	void compute_block(const uint64_t index, entry_1* block)
 	{
 		uint8_t buf[64];
-		chacha8_get_keystream(&enc_ctx_, index, 1, buf);
+		g_cpu_kernels.chacha8_keystream(&enc_ctx_, index, 1, buf);
+		convert(index, buf, block);
+	}
+	
+	/*
+	 * Same as compute_block() for blocks [index, index + count), block = entry_1[count * 16]
+	 */
+	void compute_blocks(uint64_t index, const size_t count, entry_1* block)
+	{
+		static constexpr size_t N = 16;
+		uint8_t buf[N * 64];
+		
+		for(size_t i = 0; i < count; i += N) {
+			const size_t num_blocks = std::min(count - i, N);
+			g_cpu_kernels.chacha8_keystream(&enc_ctx_, index + i, num_blocks, buf);
+			for(size_t k = 0; k < num_blocks; ++k) {
+				convert(index + i + k, buf + k * 64, block + (i + k) * 16);
+			}
+		}
+	}
+	
+	/*
+	 * Computes entries for any x values, out = entry_1[count]
+	 * A smaller plot_k (x < 2^plot_k) is only meant for BatchVerifier, entries are the same as for a k = plot_k plot.
+	 */
+	void compute_entries(const uint32_t* xs, const size_t count, entry_1* out, const uint8_t plot_k = k)
+	{
+		static constexpr size_t N = 64;
+		uint64_t pos[2 * N];
+		size_t first[N];
+		uint8_t buf[2 * N * 64 + 8];		// SliceInt64FromBytes() reads 8 bytes
 		
+		for(size_t i = 0; i < count; i += N) {
+			const size_t num_entries = std::min(count - i, N);
+			size_t num_blocks = 0;
+			for(size_t j = 0; j < num_entries; ++j) {
+				const uint64_t bit = uint64_t(xs[i + j]) * plot_k;
+				first[j] = num_blocks;
+				pos[num_blocks++] = bit / 512;
+				if(bit % 512 + plot_k > 512) {
+					pos[num_blocks++] = bit / 512 + 1;		// y spans two blocks
+				}
+			}
+			g_cpu_kernels.chacha8_blocks(&enc_ctx_, pos, num_blocks, buf);
+			
+			for(size_t j = 0; j < num_entries; ++j) {
+				const uint64_t x = xs[i + j];
+				const uint64_t y = Util::SliceInt64FromBytes(buf + first[j] * 64, (x * plot_k) % 512, plot_k);
+				out[i + j].x = x;
+				out[i + j].y = (y << kExtraBits) | (x >> (plot_k - kExtraBits));
+			}
+		}
+	}
+
+private:
+	static void convert(const uint64_t index, const uint8_t* buf, entry_1* block)
+	{
 		for(uint64_t i = 0; i < 16; ++i)
 		{
 			const uint64_t x = index * 16 + i;
-			const uint64_t y = Util::SliceInt64FromBytes(buf, i * 32, 32);
+			const uint64_t y = Util::SliceInt64FromBytes(buf, i * k, k);
 			block[i].x = x;
-			block[i].y = (y << kExtraBits) | (x >> (32 - kExtraBits));
+			block[i].y = (y << kExtraBits) | (x >> (k - kExtraBits));
 		}
 	}
-
-private:
+	
 	chacha8_ctx enc_ctx_ {};
 };
 
 // Class to evaluate F2 .. F7.
+// Other k than 32 are only meant for BatchVerifier, with k % 8 == 0 such that meta data is whole bytes.
 template<typename T, typename S>
 class FxCalculator {
 public:
-	static constexpr uint8_t k_ = 32;
-	
-    FxCalculator(int table_index) {
+    FxCalculator(int table_index, uint8_t k = 32) {
         table_index_ = table_index;
+        k_ = k;
     }
 
     // Disable copying
@@ -91,10 +167,21 @@ public:
     // Performs one evaluation of the f function.
     void evaluate(const T& L, const T& R, S& entry) const
     {
-        Bits C;
-        Bits input;
         uint8_t input_bytes[64];
         uint8_t hash_bytes[32];
+        const size_t num_bytes = get_input(L, R, input_bytes);
+
+        blake3_hasher hasher;
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, input_bytes, num_bytes);
+        blake3_hasher_finalize(&hasher, hash_bytes, sizeof(hash_bytes));
+
+        get_output(L, R, hash_bytes, entry);
+    }
+
+    // Writes input of the hash, returns number of bytes (same for all entries of a table).
+    size_t get_input(const T& L, const T& R, uint8_t* input_bytes) const
+    {
         uint8_t L_meta[16];
         uint8_t R_meta[16];
         
@@ -107,41 +194,46 @@ public:
         const Bits L_c(L_meta, L_meta_bytes, L_meta_bytes * 8);
         const Bits R_c(R_meta, R_meta_bytes, R_meta_bytes * 8);
 
-        if (table_index_ < 4) {
-            C = L_c + R_c;
-            input = Y_1 + C;
-        } else {
-            input = Y_1 + L_c + R_c;
-        }
+        const Bits input = Y_1 + L_c + R_c;
         input.ToBytes(input_bytes);
+        return cdiv(input.GetSize(), 8);
+    }
 
-        blake3_hasher hasher;
-        blake3_hasher_init(&hasher);
-        blake3_hasher_update(&hasher, input_bytes, cdiv(input.GetSize(), 8));
-        blake3_hasher_finalize(&hasher, hash_bytes, sizeof(hash_bytes));
-
+    // Computes entry from the hash of get_input().
+    void get_output(const T& L, const T& R, const uint8_t* hash_bytes, S& entry) const
+    {
         entry.y = Util::EightBytesToInt(hash_bytes) >> (64 - (k_ + (table_index_ < 7 ? kExtraBits : 0)));
 
         if (table_index_ < 4) {
-            // c is already computed
-        } else if (table_index_ < 7) {
-            uint8_t len = kVectorLens[table_index_ + 1];
-            uint8_t start_byte = (k_ + kExtraBits) / 8;
-            uint8_t end_bit = k_ + kExtraBits + k_ * len;
-            uint8_t end_byte = cdiv(end_bit, 8);
+            // meta data is L and R concatenated, both are whole bytes
+            uint8_t C_bytes[32];
+            size_t L_meta_bytes = 0;
+            size_t R_meta_bytes = 0;
+            get_meta<T>{}(L, C_bytes, &L_meta_bytes);
+            get_meta<T>{}(R, C_bytes + L_meta_bytes, &R_meta_bytes);
+            set_meta<S>{}(entry, C_bytes, L_meta_bytes + R_meta_bytes);
+        } else {
+            Bits C;
+            if (table_index_ < 7) {
+                uint8_t len = kVectorLens[table_index_ + 1];
+                uint8_t start_byte = (k_ + kExtraBits) / 8;
+                uint8_t end_bit = k_ + kExtraBits + k_ * len;
+                uint8_t end_byte = cdiv(end_bit, 8);
 
-            // TODO: proper support for partial bytes in Bits ctor
-            C = Bits(hash_bytes + start_byte, end_byte - start_byte, (end_byte - start_byte) * 8);
+                // TODO: proper support for partial bytes in Bits ctor
+                C = Bits(hash_bytes + start_byte, end_byte - start_byte, (end_byte - start_byte) * 8);
 
-            C = C.Slice((k_ + kExtraBits) % 8, end_bit - start_byte * 8);
+                C = C.Slice((k_ + kExtraBits) % 8, end_bit - start_byte * 8);
+            }
+            uint8_t C_bytes[16];
+            C.ToBytes(C_bytes);
+            set_meta<S>{}(entry, C_bytes, C.GetSize() / 8);
         }
-        uint8_t C_bytes[16];
-        C.ToBytes(C_bytes);
-        set_meta<S>{}(entry, C_bytes, C.GetSize() / 8);
     }
 
 private:
     int table_index_ = 0;
+    uint8_t k_ = 32;
 };
 
 template<typename T>
@@ -173,12 +265,12 @@ public:
     // any R value matches. This function can be further optimized by removing the inner loop, and
     // being more careful with memory allocation.
     int find_matches_ex(
-        const std::vector<T>& bucket_L,
-        const std::vector<T>& bucket_R,
+        const T* bucket_L, const size_t size_L,
+        const T* bucket_R, const size_t size_R,
         uint16_t* idx_L,
         uint16_t* idx_R)
     {
-        if(bucket_L.empty() || bucket_R.empty()) {
+        if(!size_L || !size_R) {
         	return 0;
         }
     	const uint16_t parity = (bucket_L[0].y / kBC) % 2;
@@ -189,7 +281,7 @@ public:
         rmap_clean.clear();
 
         const uint64_t offset = (bucket_R[0].y / kBC) * kBC;
-        for (size_t pos_R = 0; pos_R < bucket_R.size(); pos_R++) {
+        for (size_t pos_R = 0; pos_R < size_R; pos_R++) {
             const uint64_t r_y = bucket_R[pos_R].y - offset;
 
             if (!rmap[r_y].count) {
@@ -201,7 +293,7 @@ public:
 
         int idx_count = 0;
         const uint64_t offset_y = offset - kBC;
-        for (size_t pos_L = 0; pos_L < bucket_L.size(); pos_L++) {
+        for (size_t pos_L = 0; pos_L < size_L; pos_L++) {
             const uint64_t r = bucket_L[pos_L].y - offset_y;
             for (int i = 0; i < kExtraBitsPow; i++) {
                 const uint16_t r_target = L_targets[parity][r][i];
@@ -216,13 +308,13 @@ public:
     }
     
     int find_matches(	const uint64_t& L_pos_begin,
-						const std::vector<T>& bucket_L,
-						const std::vector<T>& bucket_R,
+						const T* bucket_L, const size_t size_L,
+						const T* bucket_R, const size_t size_R,
 						std::vector<match_t<T>>& out)
 	{
     	uint16_t idx_L[kBC];
 		uint16_t idx_R[kBC];
-		const int count = find_matches_ex(bucket_L, bucket_R, idx_L, idx_R);
+		const int count = find_matches_ex(bucket_L, size_L, bucket_R, size_R, idx_L, idx_R);
 		
 		for(int i = 0; i < count; ++i) {
 			const auto pos = L_pos_begin + idx_L[i];
@@ -231,7 +323,7 @@ public:
 				match.left = bucket_L[idx_L[i]];
 				match.right = bucket_R[idx_R[i]];
 				match.pos = pos;
-				match.off = idx_R[i] + (bucket_L.size() - idx_L[i]);
+				match.off = idx_R[i] + (size_L - idx_L[i]);
 				out.push_back(match);
 			}
 		}
@@ -252,9 +344,13 @@ void compute_f1(const uint8_t* id, int num_threads, DS* T1_sort)
 	static constexpr size_t M = 4096;	// F1 block size
 	
 	const auto begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
 	
 	typedef typename DS::WriteCache WriteCache;
 	
+	T1_sort->preallocate(F1Calculator::num_entries);
+	progress_begin("P1", 1, F1Calculator::num_entries);
+	
 	ThreadPool<std::vector<entry_1>, size_t, std::shared_ptr<WriteCache>> output(
 		[T1_sort](std::vector<entry_1>& input, size_t&, std::shared_ptr<WriteCache>& cache) {
 			if(!cache) {
@@ -269,12 +365,11 @@ void compute_f1(const uint8_t* id, int num_threads, DS* T1_sort)
 		[id](uint64_t& block, std::vector<entry_1>& out, size_t&) {
 			out.resize(M * 16);
 			F1Calculator F1(id);
-			for(size_t i = 0; i < M; ++i) {
-				F1.compute_block(block * M + i, &out[i * 16]);
-			}
+			F1.compute_blocks(block * M, M, out.data());
+			progress_add_entries(out.size());
 		}, &output, num_threads, "phase1/F1");
 	
-	for(uint64_t k = 0; k < (uint64_t(1) << 28) / M; ++k) {
+	for(uint64_t k = 0; k < F1Calculator::num_entries / 16 / M; ++k) {
 		pool.take_copy(k);
 	}
 	pool.close();
@@ -282,27 +377,25 @@ void compute_f1(const uint8_t* id, int num_threads, DS* T1_sort)
 	T1_sort->finish();
 	
 	std::cout << "[P1] Table 1 took " << (get_wall_time_micros() - begin) / 1e6 << " sec" << std::endl;
+	print_perf_stats("[P1] Table 1", perf_begin);
 }
 
 template<typename T, typename S, typename R, typename DS_L, typename DS_R>
 uint64_t compute_matches(	int R_index, int num_threads,
 							DS_L* L_sort, DS_R* R_sort,
-							Processor<std::vector<T>>* L_tmp_out,
+							Processor<std::shared_ptr<const group_batch_t<T>>>* L_tmp_out,
 							Processor<std::vector<S>>* R_tmp_out)
 {
 	std::atomic<uint64_t> num_found {};
 	std::atomic<uint64_t> num_written {};
-	std::array<uint64_t, 2> L_index = {};
-	std::array<uint64_t, 2> L_offset = {};
-	std::array<std::shared_ptr<std::vector<T>>, 2> L_bucket;
-	double avg_bucket_size = 0;
-	
-	struct match_input_t {
-		std::array<uint64_t, 2> L_offset = {};
-		std::array<std::shared_ptr<std::vector<T>>, 2> L_bucket;
-	};
 	
 	typedef typename DS_R::WriteCache WriteCache;
+	typedef std::shared_ptr<const group_batch_t<T>> batch_t;
+	
+	if(R_sort) {
+		// number of matches is about the same as number of entries
+		R_sort->preallocate(L_sort->num_entries());
+	}
 	
 	ThreadPool<std::vector<S>, size_t, std::shared_ptr<WriteCache>> R_add(
 		[R_sort](std::vector<S>& input, size_t&, std::shared_ptr<WriteCache>& cache) {
@@ -332,67 +425,41 @@ uint64_t compute_matches(	int R_index, int num_threads,
 			}
 		}, R_out, num_threads, "phase1/eval");
 	
-	ThreadPool<std::vector<match_input_t>, std::vector<match_t<T>>, FxMatcher<T>> match_pool(
+	ThreadPool<batch_t, std::vector<match_t<T>>, FxMatcher<T>> match_pool(
 		[&num_found, &num_written]
-		 (std::vector<match_input_t>& input, std::vector<match_t<T>>& out, FxMatcher<T>& Fx) {
+		 (batch_t& input, std::vector<match_t<T>>& out, FxMatcher<T>& Fx) {
 			out.reserve(64 * 1024);
-			for(const auto& pair : input) {
-				num_found += Fx.find_matches(pair.L_offset[1], *pair.L_bucket[1], *pair.L_bucket[0], out);
+			const auto& groups = input->groups;
+			for(size_t i = 1; i < groups.size(); ++i) {
+				const auto& left = groups[i - 1];
+				const auto& right = groups[i];
+				if(left.key + 1 == right.key) {
+					num_found += Fx.find_matches(left.offset, left.data, left.size, right.data, right.size, out);
+				}
 			}
 			num_written += out.size();
 		}, &eval_pool, num_threads, "phase1/match");
 	
-	Thread<std::vector<T>> read_thread(
-		[&L_index, &L_offset, &L_bucket, &avg_bucket_size, &match_pool, L_tmp_out]
-		 (std::vector<T>& input) {
-			std::vector<match_input_t> out;
-			out.reserve(1024);
-			for(const auto& entry : input) {
-				const uint64_t index = entry.y / kBC;
-				if(index < L_index[0]) {
-					throw std::logic_error("input not sorted");
-				}
-				if(index > L_index[0]) {
-					if(L_index[1] + 1 == L_index[0]) {
-						match_input_t pair;
-						pair.L_offset = L_offset;
-						pair.L_bucket = L_bucket;
-						out.push_back(pair);
-					}
-					L_index[1] = L_index[0];
-					L_index[0] = index;
-					L_offset[1] = L_offset[0];
-					if(auto bucket = L_bucket[0]) {
-						L_offset[0] += bucket->size();
-						avg_bucket_size = avg_bucket_size * 0.99 + bucket->size() * 0.01;
-					}
-					L_bucket[1] = L_bucket[0];
-					L_bucket[0] = nullptr;
-				}
-				if(!L_bucket[0]) {
-					L_bucket[0] = std::make_shared<std::vector<T>>();
-					L_bucket[0]->reserve(avg_bucket_size * 1.2);
-				}
-				L_bucket[0]->push_back(entry);
+	// called in order by the sort threads
+	class tee_t : public Processor<batch_t> {
+	public:
+		Processor<batch_t>* first = nullptr;
+		Processor<batch_t>* second = nullptr;
+		void take(batch_t& batch) override {
+			if(second) {
+				batch_t copy = batch;
+				second->take(copy);
 			}
-			match_pool.take(out);
-			if(L_tmp_out) {
-				L_tmp_out->take(input);
-			}
-		}, "phase1/slice");
+			first->take(batch);
+		}
+	} tee;
 	
-	L_sort->read(&read_thread, std::max(num_threads / 2, 2), std::max(num_threads / 4, 2));
+	tee.first = &match_pool;
+	tee.second = L_tmp_out;
 	
-	read_thread.close();
-	match_pool.close();
+	L_sort->template read_groups<get_group<T>>(&tee, std::max(num_threads / 2, 2), std::max(num_threads / 4, 2));
 	
-	if(L_index[1] + 1 == L_index[0]) {
-		FxMatcher<T> Fx;
-		std::vector<match_t<T>> matches;
-		num_found += Fx.find_matches(L_offset[1], *L_bucket[1], *L_bucket[0], matches);
-		num_written += matches.size();
-		eval_pool.take(matches);
-	}
+	match_pool.close();
 	eval_pool.close();
 	R_add.close();
 	
@@ -411,29 +478,62 @@ uint64_t compute_table(	int R_index, int num_threads,
 						DS_L* L_sort, DS_R* R_sort,
 						DiskTable<R>* L_tmp, DiskTable<S>* R_tmp = nullptr)
 {
-	Thread<std::vector<T>> L_write(
-		[L_tmp](std::vector<T>& input) {
-			for(const auto& entry : input) {
-				R tmp;
-				tmp.assign(entry);
-				L_tmp->write(tmp);
+	typedef std::shared_ptr<const group_batch_t<T>> batch_t;
+	
+	const int num_threads_write = std::max(num_threads / 4, 2);
+	
+	ThreadPool<std::pair<uint64_t, batch_t>, size_t> L_write(
+		[L_tmp](std::pair<uint64_t, batch_t>& input, size_t&, size_t&) {
+			std::vector<R> out;
+			const auto& groups = input.second->groups;
+			for(size_t i = input.second->has_prev ? 1 : 0; i < groups.size(); ++i) {
+				const auto& group = groups[i];
+				for(size_t k = 0; k < group.size; ++k) {
+					R tmp;
+					tmp.assign(group.data[k]);
+					out.push_back(tmp);
+				}
 			}
-		}, "phase1/write/L");
-	
-	Thread<std::vector<S>> R_write(
-		[R_tmp](std::vector<S>& input) {
-			for(const auto& entry : input) {
-				R_tmp->write(entry);
+			L_tmp->write_block(input.first, out);
+		}, nullptr, num_threads_write, "phase1/write/L");
+	
+	ThreadPool<std::pair<uint64_t, std::vector<S>>, size_t> R_write(
+		[R_tmp](std::pair<uint64_t, std::vector<S>>& input, size_t&, size_t&) {
+			R_tmp->write_block(input.first, input.second);
+		}, nullptr, num_threads_write, "phase1/write/R");
+	
+	// called in order, assigns each block its position in the table
+	uint64_t L_offset = 0;
+	Thread<batch_t> L_order(
+		[&L_write, &L_offset](batch_t& input) {
+			const auto& groups = input->groups;
+			std::pair<uint64_t, batch_t> job(L_offset, input);
+			for(size_t i = input->has_prev ? 1 : 0; i < groups.size(); ++i) {
+				L_offset += groups[i].size;
 			}
-		}, "phase1/write/R");
+			L_write.take(job);
+		}, "phase1/order/L");
+	
+	uint64_t R_offset = 0;
+	Thread<std::vector<S>> R_order(
+		[&R_write, &R_offset](std::vector<S>& input) {
+			std::pair<uint64_t, std::vector<S>> job(R_offset, std::move(input));
+			R_offset += job.second.size();
+			R_write.take(job);
+		}, "phase1/order/R");
 	
 	const auto begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
+	progress_begin("P1", R_index, L_sort->num_entries());
+	
 	const auto num_matches =
 			phase1::compute_matches<T, S, R>(
 					R_index, num_threads, L_sort, R_sort,
-					L_tmp ? &L_write : nullptr,
-					R_tmp ? &R_write : nullptr);
+					L_tmp ? &L_order : nullptr,
+					R_tmp ? &R_order : nullptr);
 	
+	L_order.close();
+	R_order.close();
 	L_write.close();
 	R_write.close();
 	
@@ -445,6 +545,7 @@ uint64_t compute_table(	int R_index, int num_threads,
 	}
 	std::cout << "[P1] Table " << R_index << " took " << (get_wall_time_micros() - begin) / 1e6 << " sec"
 			<< ", found " << num_matches << " matches" << std::endl;
+	print_perf_stats("[P1] Table " + std::to_string(R_index), perf_begin);
 	return num_matches;
 }
 
@@ -456,6 +557,8 @@ void compute(	const input_t& input, output_t& out,
 				const std::string tmp_dir_2)
 {
 	const auto total_begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
+	io_stats_begin("P1");
 	
 	initialize();
 	
@@ -505,6 +608,9 @@ void compute(	const input_t& input, output_t& out,
 	out.table[6] = tmp_7.get_info();
 	
 	std::cout << "Phase 1 took " << (get_wall_time_micros() - total_begin) / 1e6 << " sec" << std::endl;
+	print_disk_usage("[P1]");
+	print_io_stats("[P1]");
+	print_perf_stats("[P1]", perf_begin);
 }
 
 
@@ -85,4 +85,13 @@ struct output_t {
 
 } // phase2
 
+template<>
+struct codec_t<phase2::entry_x> : shuffle_codec_t<phase2::entry_x,
+		field_t<offsetof(phase2::entry_x, key), 4>, field_t<offsetof(phase2::entry_x, pos), 4>,
+		field_t<offsetof(phase2::entry_x, off), 2>> {};
+
+template<>
+struct disk_key_t<phase2::entry_x, phase2::get_pos<phase2::entry_x>>
+	: codec_t<phase2::entry_x>::field_key_t<offsetof(phase2::entry_x, pos)> {};
+
 #endif /* INCLUDE_CHIA_PHASE2_H_ */
@@ -22,13 +22,16 @@ void compute_table(	int R_index, int num_threads,
 					DS* R_sort, DiskTable<S>* R_file,
 					const table_t& R_table,
 					bitfield* L_used,
-					const bitfield* R_used)
+					const bitfield* R_used,
+					const bool free_input = false)
 {
 	const int num_threads_read = std::max(num_threads / 4, 2);
 	
 	DiskTable<T> R_input(R_table);
+	progress_begin("P2", R_index, 2 * R_table.num_entries);		// scan + rewrite
 	{
 		const auto begin = get_wall_time_micros();
+		const auto perf_begin = get_perf_stats();
 		
 		ThreadPool<std::pair<std::vector<T>, size_t>, size_t> pool(
 			[L_used, R_used](std::pair<std::vector<T>, size_t>& input, size_t&, size_t&) {
@@ -48,20 +51,24 @@ void compute_table(	int R_index, int num_threads,
 		
 		std::cout << "[P2] Table " << R_index << " scan took "
 				<< (get_wall_time_micros() - begin) / 1e6 << " sec" << std::endl;
+		print_perf_stats("[P2] Table " + std::to_string(R_index) + " scan", perf_begin);
 	}
 	const auto begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
 	
 	uint64_t num_written = 0;
 	const bitfield_index index(*L_used);
 	
 	typedef typename DS::WriteCache WriteCache;
 	
-	Thread<std::vector<S>> R_write(
-		[R_file](std::vector<S>& input) {
-			for(auto& entry : input) {
-				R_file->write(entry);
-			}
-		}, "phase2/write");
+	if(R_sort) {
+		R_sort->preallocate(R_table.num_entries);
+	}
+	
+	ThreadPool<std::pair<uint64_t, std::vector<S>>, size_t> R_write(
+		[R_file](std::pair<uint64_t, std::vector<S>>& input, size_t&, size_t&) {
+			R_file->write_block(input.first, input.second);
+		}, nullptr, std::max(num_threads / 2, 1), "phase2/write");
 	
 	ThreadPool<std::vector<S>, size_t, std::shared_ptr<WriteCache>> R_add(
 		[R_sort](std::vector<S>& input, size_t&, std::shared_ptr<WriteCache>& cache) {
@@ -73,17 +80,18 @@ void compute_table(	int R_index, int num_threads,
 			}
 		}, nullptr, std::max(num_threads / 2, 1), "phase2/add");
 	
-	Processor<std::vector<S>>* R_out = &R_add;
-	if(R_file) {
-		R_out = &R_write;
-	}
-	
 	Thread<std::vector<S>> R_count(
-		[R_out, &num_written](std::vector<S>& input) {
+		[R_file, &R_write, &R_add, &num_written](std::vector<S>& input) {
+			const uint64_t offset = num_written;
 			for(auto& entry : input) {
 				set_sort_key<S>{}(entry, num_written++);
 			}
-			R_out->take(input);
+			if(R_file) {
+				std::pair<uint64_t, std::vector<S>> job(offset, std::move(input));
+				R_write.take(job);
+			} else {
+				R_add.take(input);
+			}
 		}, "phase2/count");
 	
 	ThreadPool<std::pair<std::vector<T>, size_t>, std::vector<S>> map_pool(
@@ -103,6 +111,7 @@ void compute_table(	int R_index, int num_threads,
 			}
 		}, &R_count, num_threads, "phase2/remap");
 	
+	R_input.set_free_after_read(free_input);
 	R_input.read(&map_pool, num_threads_read);
 	
 	map_pool.close();
@@ -120,6 +129,7 @@ void compute_table(	int R_index, int num_threads,
 				<< (get_wall_time_micros() - begin) / 1e6 << " sec"
 				<< ", dropped " << R_table.num_entries - num_written << " entries"
 				<< " (" << 100 * (1 - double(num_written) / R_table.num_entries) << " %)" << std::endl;
+	print_perf_stats("[P2] Table " + std::to_string(R_index) + " rewrite", perf_begin);
 }
 
 inline
@@ -130,6 +140,8 @@ void compute(	const phase1::output_t& input, output_t& out,
 				const std::string tmp_dir_2)
 {
 	const auto total_begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
+	io_stats_begin("P2");
 	
 	const std::string prefix = tmp_dir + plot_name + ".p2.";
 	const std::string prefix_2 = tmp_dir_2 + plot_name + ".p2.";
@@ -146,7 +158,7 @@ void compute(	const phase1::output_t& input, output_t& out,
 	DiskTable<entry_7> table_7(prefix_2 + "table7.tmp");
 	
 	compute_table<entry_7, entry_7, DiskSort7>(
-			7, num_threads, nullptr, &table_7, input.table[6], next_bitfield.get(), nullptr);
+			7, num_threads, nullptr, &table_7, input.table[6], next_bitfield.get(), nullptr, true);
 	
 	table_7.close();
 	remove(input.table[6].file_name);
@@ -157,7 +169,7 @@ void compute(	const phase1::output_t& input, output_t& out,
 		out.sort[i] = std::make_shared<DiskSortT>(32, log_num_buckets, prefix + "t" + std::to_string(i + 1));
 		
 		compute_table<phase1::tmp_entry_x, entry_x, DiskSortT>(
-			i + 1, num_threads, out.sort[i].get(), nullptr, input.table[i], next_bitfield.get(), curr_bitfield.get());
+			i + 1, num_threads, out.sort[i].get(), nullptr, input.table[i], next_bitfield.get(), curr_bitfield.get(), true);
 		
 		remove(input.table[i].file_name);
 	}
@@ -168,6 +180,9 @@ void compute(	const phase1::output_t& input, output_t& out,
 	out.bitfield_1 = next_bitfield;
 	
 	std::cout << "Phase 2 took " << (get_wall_time_micros() - total_begin) / 1e6 << " sec" << std::endl;
+	print_disk_usage("[P2]");
+	print_io_stats("[P2]");
+	print_perf_stats("[P2]", perf_begin);
 }
 
 
@@ -104,4 +104,20 @@ struct output_t {
 
 } // phase3
 
+template<>
+struct codec_t<phase3::entry_lp> : shuffle_codec_t<phase3::entry_lp,
+		field_t<offsetof(phase3::entry_lp, point), 8>, field_t<offsetof(phase3::entry_lp, key), 4>> {};
+
+template<>
+struct codec_t<phase3::entry_np> : shuffle_codec_t<phase3::entry_np,
+		field_t<offsetof(phase3::entry_np, key), 4>, field_t<offsetof(phase3::entry_np, pos), 4>> {};
+
+template<>
+struct disk_key_t<phase3::entry_lp, phase3::get_line_point<phase3::entry_lp>>
+	: codec_t<phase3::entry_lp>::field_key_t<offsetof(phase3::entry_lp, point)> {};
+
+template<>
+struct disk_key_t<phase3::entry_np, phase3::get_sort_key<phase3::entry_np>>
+	: codec_t<phase3::entry_np>::field_key_t<offsetof(phase3::entry_np, key)> {};
+
 #endif /* INCLUDE_CHIA_PHASE3_H_ */
@@ -25,6 +25,7 @@ void compute_stage1(int L_index, int num_threads,
 					DiskTable<S>* R_table = nullptr)
 {
 	const auto begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
 	
 	std::mutex mutex;
 	std::condition_variable signal;
@@ -74,6 +75,8 @@ void compute_stage1(int L_index, int num_threads,
 	
 	typedef DiskSortLP::WriteCache WriteCache;
 	
+	R_sort_2->preallocate(R_table ? R_table->get_info().num_entries : R_sort->num_entries());
+	
 	ThreadPool<std::vector<entry_kpp>, size_t, std::shared_ptr<WriteCache>> R_add_2(
 		[R_sort_2, &R_num_write]
 		 (std::vector<entry_kpp>& input, size_t&, std::shared_ptr<WriteCache>& cache) {
@@ -162,6 +165,7 @@ void compute_stage1(int L_index, int num_threads,
 	std::cout << "[P3-1] Table " << L_index + 1 << " took "
 				<< (get_wall_time_micros() - begin) / 1e6 << " sec"
 				<< ", wrote " << R_num_write << " right entries" << std::endl;
+	print_perf_stats("[P3-1] Table " + std::to_string(L_index + 1), perf_begin);
 }
 
 static uint32_t CalculateLinePointSize(uint8_t k) {
@@ -202,28 +206,28 @@ uint32_t WriteHeader(
 	// x bytes   - format description
 	// 2 bytes   - memo length
 	// x bytes   - memo
-
+	
 	const std::string header_text = "Proof of Space Plot";
 	
 	size_t num_bytes = 0;
 	num_bytes += fwrite(header_text.c_str(), 1, header_text.size(), file);
 	num_bytes += fwrite((id), 1, kIdLen, file);
-
+	
 	uint8_t k_buffer[1] = {k};
 	num_bytes += fwrite((k_buffer), 1, 1, file);
-
+	
 	uint8_t size_buffer[2];
 	Util::IntToTwoBytes(size_buffer, kFormatDescription.size());
 	num_bytes += fwrite((size_buffer), 1, 2, file);
 	num_bytes += fwrite(kFormatDescription.c_str(), 1, kFormatDescription.size(), file);
-
+	
 	Util::IntToTwoBytes(size_buffer, memo_len);
 	num_bytes += fwrite((size_buffer), 1, 2, file);
 	num_bytes += fwrite((memo), 1, memo_len, file);
-
+	
 	uint8_t pointers[10 * 8] = {};
 	num_bytes += fwrite((pointers), 8, 10, file) * 8;
-
+	
 	fflush(file);
 	std::cout << "Wrote plot header with " << num_bytes << " bytes" << std::endl;
 	return num_bytes;
@@ -297,6 +301,7 @@ uint64_t compute_stage2(int L_index, int num_threads,
 						FILE* plot_file, uint64_t L_final_begin, uint64_t* R_final_begin)
 {
 	const auto begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
 	
 	uint64_t R_num_read = 0;
 	std::atomic<uint64_t> L_num_write {0};
@@ -316,6 +321,8 @@ uint64_t compute_stage2(int L_index, int num_threads,
 	
 	typedef DiskSortNP::WriteCache WriteCache;
 	
+	L_sort->preallocate(R_sort->num_entries());
+	
 	ThreadPool<std::vector<entry_np>, size_t, std::shared_ptr<WriteCache>> L_add(
 		[L_sort, &L_num_write]
 		 (std::vector<entry_np>& input, size_t&, std::shared_ptr<WriteCache>& cache) {
@@ -362,6 +369,7 @@ uint64_t compute_stage2(int L_index, int num_threads,
 				out.buffer.data(),
 				out.buffer.size());
 			num_written_final += points.size();
+			progress_add_parks(1);
 		}, &park_write, std::max(num_threads / 2, 1), "phase3/park");
 	
 	Thread<std::vector<entry_lp>> R_read(
@@ -419,6 +427,7 @@ uint64_t compute_stage2(int L_index, int num_threads,
 				<< (get_wall_time_micros() - begin) / 1e6 << " sec"
 				<< ", wrote " << L_num_write << " left entries"
 				<< ", " << num_written_final << " final" << std::endl;
+	print_perf_stats("[P3-2] Table " + std::to_string(L_index + 1), perf_begin);
 	return num_written_final;
 }
 
@@ -430,18 +439,32 @@ void compute(	phase2::output_t& input, output_t& out,
 				const std::string tmp_dir_2)
 {
 	const auto total_begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
+	io_stats_begin("P3");
 	
 	const std::string prefix_2 = tmp_dir_2 + plot_name + ".";
 	
 	out.params = input.params;
 	out.plot_file_name = tmp_dir + plot_name + ".plot.tmp";
 	
-	FILE* plot_file = fopen(out.plot_file_name.c_str(), "wb");
+	FILE* plot_file = fopen_ex(out.plot_file_name, "wb");
 	if(!plot_file) {
 		throw std::runtime_error("fopen() failed");
 	}
 	out.header_size = WriteHeader(	plot_file, 32, input.params.id.data(),
 									input.params.memo.data(), input.params.memo.size());
+	disk_usage_add(out.plot_file_name, out.header_size);
+	io_stats_add(plot_file, true, out.header_size);
+	
+	if(g_preallocate) {
+		// reserve space for the parks of tables 1 to 6 (upper bound), P7 is reserved in phase 4
+		uint64_t num_bytes = out.header_size;
+		for(int i = 1; i < 6; ++i) {
+			num_bytes += cdiv(input.sort[i]->num_entries(), kEntriesPerPark) * CalculateParkSize(32, i);
+		}
+		num_bytes += cdiv(input.table_7.num_entries, kEntriesPerPark) * CalculateParkSize(32, 6);
+		fallocate_ex(plot_file, 0, num_bytes);
+	}
 	
 	std::vector<uint64_t> final_pointers(8, 0);
 	final_pointers[1] = out.header_size;
@@ -449,22 +472,29 @@ void compute(	phase2::output_t& input, output_t& out,
 	uint64_t num_written_final = 0;
 	
 	DiskTable<phase2::entry_1> L_table_1(input.table_1);
+	L_table_1.set_free_after_read(true);
 	
 	auto R_sort_lp = std::make_shared<DiskSortLP>(
 			63, log_num_buckets, prefix_2 + "p3s1.t2");
 	
+	// stage 1 reads L and R, stage 2 reads R again
+	progress_begin("P3", 2, input.table_1.num_entries + 2 * input.sort[1]->num_entries());
+	
 	compute_stage1<phase2::entry_1, phase2::entry_x, DiskSortNP, phase2::DiskSortT>(
 			1, num_threads, nullptr, input.sort[1].get(), R_sort_lp.get(), &L_table_1, input.bitfield_1.get());
 	
 	input.bitfield_1 = nullptr;
 	remove(input.table_1.file_name);
 	
+	// keys are dense (assigned in phase 2), except for table 7 (f7)
 	auto L_sort_np = std::make_shared<DiskSortNP>(
 			32, log_num_buckets, prefix_2 + "p3s2.t2");
+	L_sort_np->set_dense_keys(true);
 	
 	num_written_final += compute_stage2(
 			1, num_threads, R_sort_lp.get(), L_sort_np.get(),
 			plot_file, final_pointers[1], &final_pointers[2]);
+	disk_usage_add(out.plot_file_name, final_pointers[2] - final_pointers[1]);
 	
 	for(int L_index = 2; L_index < 6; ++L_index)
 	{
@@ -473,21 +503,28 @@ void compute(	phase2::output_t& input, output_t& out,
 		R_sort_lp = std::make_shared<DiskSortLP>(
 				63, log_num_buckets, prefix_2 + "p3s1." + R_t);
 		
+		progress_begin("P3", L_index + 1, L_sort_np->num_entries() + 2 * input.sort[L_index]->num_entries());
+		
 		compute_stage1<entry_np, phase2::entry_x, DiskSortNP, phase2::DiskSortT>(
 				L_index, num_threads, L_sort_np.get(), input.sort[L_index].get(), R_sort_lp.get());
 		
 		L_sort_np = std::make_shared<DiskSortNP>(
 				32, log_num_buckets, prefix_2 + "p3s2." + R_t);
+		L_sort_np->set_dense_keys(true);
 		
 		num_written_final += compute_stage2(
 				L_index, num_threads, R_sort_lp.get(), L_sort_np.get(),
 				plot_file, final_pointers[L_index], &final_pointers[L_index + 1]);
+		disk_usage_add(out.plot_file_name, final_pointers[L_index + 1] - final_pointers[L_index]);
 	}
 	
 	DiskTable<phase2::entry_7> R_table_7(input.table_7);
+	R_table_7.set_free_after_read(true);
 	
 	R_sort_lp = std::make_shared<DiskSortLP>(63, log_num_buckets, prefix_2 + "p3s1.t7");
 	
+	progress_begin("P3", 7, L_sort_np->num_entries() + 2 * input.table_7.num_entries);
+	
 	compute_stage1<entry_np, phase2::entry_7, DiskSortNP, phase2::DiskSort7>(
 			6, num_threads, L_sort_np.get(), nullptr, R_sort_lp.get(), nullptr, nullptr, &R_table_7);
 	
@@ -499,6 +536,7 @@ void compute(	phase2::output_t& input, output_t& out,
 			6, num_threads, R_sort_lp.get(), L_sort_np.get(),
 			plot_file, final_pointers[6], &final_pointers[7]);
 	num_written_final += num_written_final_7;
+	disk_usage_add(out.plot_file_name, final_pointers[7] - final_pointers[6]);
 	
 	fseek_set(plot_file, out.header_size - 10 * 8);
 	for(size_t i = 1; i < final_pointers.size(); ++i) {
@@ -506,7 +544,7 @@ void compute(	phase2::output_t& input, output_t& out,
 		Util::IntToEightBytes(tmp, final_pointers[i]);
 		fwrite_ex(plot_file, tmp, sizeof(tmp));
 	}
-	fclose(plot_file);
+	fclose_ex(plot_file);
 	
 	out.sort_7 = L_sort_np;
 	out.num_written_7 = num_written_final_7;
@@ -514,6 +552,9 @@ void compute(	phase2::output_t& input, output_t& out,
 	
 	std::cout << "Phase 3 took " << (get_wall_time_micros() - total_begin) / 1e6 << " sec"
 			", wrote " << num_written_final << " entries to final plot" << std::endl;
+	print_disk_usage("[P3]");
+	print_io_stats("[P3]");
+	print_perf_stats("[P3]", perf_begin);
 }
 
 
@@ -71,6 +71,10 @@ uint64_t compute(	FILE* plot_file, const int header_size,
     final_table_begin_pointers[10] = begin_byte_C3;
     final_table_begin_pointers[11] = end_byte;
 
+    if(g_preallocate) {
+        fallocate_ex(plot_file, final_pointer_7, end_byte - final_pointer_7);
+    }
+
     uint64_t final_file_writer_1 = begin_byte_C1;
     uint64_t final_file_writer_3 = final_table_begin_pointers[7];
 
@@ -111,6 +115,7 @@ uint64_t compute(	FILE* plot_file, const int header_size,
     			bits += ParkBits(new_pos, k + 1);
     		}
 			bits.ToBytes(out.buffer.data());
+			progress_add_parks(1);
 		}, &plot_write, std::max(num_threads / 2, 1), "phase4/P7");
     
 	ThreadPool<park_deltas_t, write_data_t> park_threads(
@@ -124,6 +129,7 @@ uint64_t compute(	FILE* plot_file, const int header_size,
 				throw std::logic_error("C3 overflow");
 			}
 			Util::IntToTwoBytes(out.buffer.data(), num_bytes);	// Write the size
+			progress_add_parks(1);
 		}, &plot_write, std::max(num_threads / 2, 1), "phase4/C3");
 
     // We read each table7 entry, which is sorted by f7, but we don't need f7 anymore. Instead,
@@ -223,6 +229,9 @@ uint64_t compute(	FILE* plot_file, const int header_size,
         final_file_writer_1 +=
         		fwrite_at(plot_file, final_file_writer_1, table_pointer_bytes, 8);
     }
+    if(g_preallocate) {
+        ftruncate_ex(plot_file, end_byte);
+    }
     return end_byte;
 }
 
@@ -234,16 +243,20 @@ void compute(	const phase3::output_t& input, output_t& out,
 				const std::string tmp_dir_2)
 {
 	const auto total_begin = get_wall_time_micros();
+	const auto perf_begin = get_perf_stats();
+	io_stats_begin("P4");
 	
-	FILE* plot_file = fopen(input.plot_file_name.c_str(), "r+");
+	FILE* plot_file = fopen_ex(input.plot_file_name, "r+");
 	if(!plot_file) {
 		throw std::runtime_error("fopen() failed");
 	}
+	progress_begin("P4", 7, input.sort_7->num_entries());
 	
 	out.plot_size = compute(plot_file, input.header_size, input.sort_7.get(),
 							num_threads, input.final_pointer_7, input.num_written_7);
 	
-	fclose(plot_file);
+	fclose_ex(plot_file);
+	disk_usage_add(input.plot_file_name, out.plot_size - input.final_pointer_7);
 	
 	out.params = input.params;
 	out.plot_file_name = tmp_dir + plot_name + ".plot";
@@ -252,6 +265,9 @@ void compute(	const phase3::output_t& input, output_t& out,
 	
 	std::cout << "Phase 4 took " << (get_wall_time_micros() - total_begin) / 1e6 << " sec"
 			", final plot size is " << out.plot_size << " bytes" << std::endl;
+	print_disk_usage("[P4]");
+	print_io_stats("[P4]");
+	print_perf_stats("[P4]", perf_begin);
 }
 
 
@@ -0,0 +1,403 @@
+/*
+ * predict.hpp
+ *
+ *  Created on: Jun 18, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_PREDICT_HPP_
+#define INCLUDE_CHIA_PREDICT_HPP_
+
+#include <chia/phase1.hpp>
+#include <chia/phase2.h>
+#include <chia/phase3.hpp>
+#include <chia/json.h>
+
+#include <cmath>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+
+/*
+ * Predicts table sizes, temporary space and duration of a k32 plot, before it's created.
+ *
+ * Table sizes are estimated by matching a sample of BC groups, phase 2 survival
+ * via the expected number of referenced entries (calibrated by the sample).
+ * All tables have the same y density, so one sample covers all of them.
+ * Duration is the predicted I/O volume per phase divided by measured throughput,
+ * it is unknown without a measurement.
+ */
+namespace predict {
+
+struct table_t {
+	double num_entries = 0;			// after phase 1
+	double num_used = 0;			// after phase 2
+	double bucket_size = 0;			// average sort bucket in phase 1 [bytes]
+	double max_bucket_size = 0;		// +4 sigma [bytes]
+};
+
+struct phase_t {
+	std::string name;
+	double tmp_size = 0;			// peak usage of <tmp_dir> [bytes]
+	double tmp_size_2 = 0;			// peak usage of <tmp_dir2> [bytes]
+	double num_read = 0;			// [bytes]
+	double num_write = 0;			// [bytes]
+	double time_sec = -1;			// -1 if unknown
+};
+
+/*
+ * Effective throughput (read + write bytes per sec) per phase, measured by test_e2e on the same machine.
+ * There is no default, since it depends on drives, CPU and number of threads.
+ */
+struct throughput_t {
+	std::array<double, 4> bytes_per_sec = {};
+	
+	bool is_measured() const {
+		return bytes_per_sec[0] > 0;
+	}
+	
+	// loads "P1" .. "P4" time_sec, read_bytes and write_bytes from test_e2e output
+	void load(const std::string& file_name);
+};
+
+struct input_t {
+	int log_num_buckets = 7;
+	int num_groups = 16384;			// BC groups to sample
+	uint64_t seed = 0;
+	throughput_t throughput;
+};
+
+struct output_t {
+	double match_rate = 0;			// matches per left entry (sampled)
+	double match_rate_error = 0;	// standard error of match_rate
+	double used_calib = 1;			// sampled / analytic fraction of used left entries
+	double used_calib_error = 0;	// standard error of used_calib
+	std::array<table_t, 7> table;
+	std::array<phase_t, 4> phase;
+	double plot_size = 0;			// [bytes]
+	double tmp_size = 0;			// peak of all phases [bytes]
+	double tmp_size_2 = 0;			// peak of all phases [bytes]
+	double total_sec = -1;			// -1 if unknown
+};
+
+inline
+void throughput_t::load(const std::string& file_name)
+{
+	std::ifstream in(file_name);
+	if(!in) {
+		throw std::runtime_error("failed to open " + file_name);
+	}
+	const std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	
+	auto find_value = [&json](const std::string& section, const std::string& key) -> double {
+		double value = 0;
+		if(!json_get_number(json, section, key, value)) {
+			throw std::runtime_error("missing " + section + "." + key);
+		}
+		return value;
+	};
+	for(int i = 0; i < 4; ++i) {
+		const std::string name = "P" + std::to_string(i + 1);
+		const auto time_sec = find_value(name, "time_sec");
+		const auto num_bytes = find_value(name, "read_bytes") + find_value(name, "write_bytes");
+		if(time_sec <= 0) {
+			throw std::runtime_error("invalid " + name + ".time_sec");
+		}
+		bytes_per_sec[i] = num_bytes / time_sec;
+	}
+}
+
+/*
+ * Returns mean of ratios num[i] / den[i] over all batches, and its standard error.
+ */
+inline
+void batch_ratio(const std::vector<double>& num, const std::vector<double>& den, double& ratio, double& error)
+{
+	double sum_num = 0;
+	double sum_den = 0;
+	for(size_t i = 0; i < num.size(); ++i) {
+		sum_num += num[i];
+		sum_den += den[i];
+	}
+	ratio = sum_den ? sum_num / sum_den : 0;
+	error = 0;
+	if(num.size() > 1) {
+		double sum_sq = 0;
+		for(size_t i = 0; i < num.size(); ++i) {
+			const double res = den[i] ? num[i] / den[i] - ratio : 0;
+			sum_sq += res * res;
+		}
+		error = std::sqrt(sum_sq / (num.size() - 1) / num.size());
+	}
+}
+
+/*
+ * Matches num_groups consecutive BC groups of random y values at given density (entries per y).
+ * Since y values are uniform, this is the same as sampling real F1 / Fx output.
+ * Returns number of matches per left entry, fraction of entries used in a match,
+ * and their standard errors (from batches of consecutive groups, which are nearly independent).
+ */
+inline
+void sample_matches(const double density, const int num_groups, std::mt19937_64& generator,
+					double& match_rate, double& match_rate_error,
+					double& used_fraction, double& used_fraction_error)
+{
+	static constexpr int batch_size = 64;
+	const size_t num_batches = (num_groups + batch_size - 1) / batch_size;
+	
+	std::poisson_distribution<int> group_size(density * kBC);
+	std::uniform_int_distribution<uint32_t> group_offset(0, kBC - 1);
+	
+	// random start to cover both parities
+	const uint64_t first_group = generator() % ((uint64_t(1) << (32 + kExtraBits)) / kBC - num_groups);
+	
+	std::vector<std::vector<phase1::entry_1>> groups(num_groups);
+	std::vector<std::vector<bool>> used(num_groups);
+	for(int i = 0; i < num_groups; ++i) {
+		auto& group = groups[i];
+		group.resize(group_size(generator));
+		for(auto& entry : group) {
+			entry.y = (first_group + i) * kBC + group_offset(generator);
+			entry.x = 0;
+		}
+		std::sort(group.begin(), group.end(),
+			[](const phase1::entry_1& lhs, const phase1::entry_1& rhs) -> bool {
+				return lhs.y < rhs.y;
+			});
+		used[i].resize(group.size());
+	}
+	phase1::FxMatcher<phase1::entry_1> matcher;
+	std::vector<uint16_t> idx_L(kBC);
+	std::vector<uint16_t> idx_R(kBC);
+	
+	// per batch
+	std::vector<double> num_matches(num_batches);
+	std::vector<double> num_left(num_batches);
+	for(int i = 0; i + 1 < num_groups; ++i) {
+		const auto& L = groups[i];
+		const auto& R = groups[i + 1];
+		const int count = matcher.find_matches_ex(L.data(), L.size(), R.data(), R.size(), idx_L.data(), idx_R.data());
+		for(int j = 0; j < count; ++j) {
+			used[i][idx_L[j]] = true;
+			used[i + 1][idx_R[j]] = true;
+		}
+		num_matches[i / batch_size] += count;
+		num_left[i / batch_size] += L.size();
+	}
+	// first and last group only have one neighbor
+	std::vector<double> num_used(num_batches);
+	std::vector<double> num_total(num_batches);
+	for(int i = 1; i + 1 < num_groups; ++i) {
+		for(const auto flag : used[i]) {
+			num_used[i / batch_size] += flag;
+		}
+		num_total[i / batch_size] += used[i].size();
+	}
+	batch_ratio(num_matches, num_left, match_rate, match_rate_error);
+	batch_ratio(num_used, num_total, used_fraction, used_fraction_error);
+}
+
+inline
+void compute(const input_t& input, output_t& out)
+{
+	static constexpr uint8_t k = 32;
+	const double num_y = std::pow(2, k + kExtraBits);
+	const double max_pos = std::pow(2, k);
+	const double num_buckets = std::pow(2, input.log_num_buckets);
+	
+	// disk size of phase 1 sort entries
+	const std::array<double, 7> sort_size = {
+			phase1::entry_1::disk_size, phase1::entry_2::disk_size, phase1::entry_3::disk_size,
+			phase1::entry_4::disk_size, phase1::entry_5::disk_size, phase1::entry_6::disk_size,
+			phase1::entry_7::disk_size};
+	
+	std::mt19937_64 generator(input.seed);
+	phase1::initialize();
+	
+	auto& table = out.table;
+	table[0].num_entries = max_pos;
+	
+	double used_fraction = 0;
+	double used_fraction_error = 0;
+	sample_matches(max_pos / num_y, input.num_groups, generator,
+			out.match_rate, out.match_rate_error, used_fraction, used_fraction_error);
+	
+	const double expected = 1 - std::exp(-2 * out.match_rate);
+	out.used_calib = expected > 0 ? used_fraction / expected : 1;
+	out.used_calib_error = expected > 0 ? used_fraction_error / expected : 0;
+	
+	for(int i = 1; i < 7; ++i) {
+		// matches with left position >= 2^32 are lost
+		table[i].num_entries = out.match_rate * std::min(table[i - 1].num_entries, max_pos);
+	}
+	// each used entry references two entries of the previous table
+	table[6].num_used = table[6].num_entries;
+	for(int i = 5; i >= 0; --i) {
+		auto& L = table[i];
+		L.num_used = std::min(L.num_entries, L.num_entries * out.used_calib
+				* (1 - std::exp(-2 * table[i + 1].num_used / L.num_entries)));
+	}
+	for(int i = 0; i < 7; ++i) {
+		auto& entry = table[i];
+		const double bucket_entries = entry.num_entries / num_buckets;
+		entry.bucket_size = bucket_entries * sort_size[i];
+		entry.max_bucket_size = (bucket_entries + 4 * std::sqrt(bucket_entries)) * sort_size[i];
+	}
+	
+	// final plot, phase 3 writes parks for table 1 to 6 with one entry per used entry of the next table
+	double park_size[7] = {};
+	for(int i = 0; i < 6; ++i) {
+		park_size[i] = std::ceil(table[i + 1].num_used / kEntriesPerPark) * phase3::CalculateParkSize(k, i + 1);
+	}
+	park_size[6] = std::ceil(table[6].num_used / kEntriesPerPark) * (Util::ByteAlign((k + 1) * kEntriesPerPark) / 8);
+	
+	const double num_C1 = std::floor(table[6].num_used / kCheckpoint1Interval) + 1;
+	const double num_C2 = std::floor(num_C1 / kCheckpoint2Interval) + 1;
+	const double C_size = (num_C1 + 1) * 4 + (num_C2 + 1) * 4
+			+ num_C1 * (Util::ByteAlign(kC3BitsPerEntry * kCheckpoint1Interval) / 8);
+	
+	out.plot_size = C_size;
+	for(const auto size : park_size) {
+		out.plot_size += size;
+	}
+	
+	// current usage of <tmp_dir> and <tmp_dir2>
+	double tmp_size = 0;
+	double tmp_size_2 = 0;
+	
+	// phase 1: sort t is read while sort t + 1 is written, buckets are deleted once read
+	{
+		auto& phase = out.phase[0];
+		phase.name = "P1";
+		for(int i = 0; i < 7; ++i) {
+			const double sort_bytes = table[i].num_entries * sort_size[i];
+			if(i < 6) {
+				const double tmp_bytes = table[i].num_entries * (i ? phase1::tmp_entry_x::disk_size : phase1::tmp_entry_1::disk_size);
+				tmp_size += tmp_bytes;
+				phase.num_write += tmp_bytes;
+				phase.num_read += sort_bytes;
+			}
+			phase.num_write += sort_bytes;
+			if(i) {
+				phase.tmp_size_2 = std::max(phase.tmp_size_2, std::max(sort_bytes, table[i - 1].num_entries * sort_size[i - 1]));
+			}
+		}
+		phase.tmp_size = tmp_size;
+		tmp_size_2 = table[6].num_entries * phase1::entry_7::disk_size;
+	}
+	// phase 2: tables are rewritten in order 7 .. 2, input is deleted after each table
+	{
+		auto& phase = out.phase[1];
+		phase.name = "P2";
+		phase.num_read += 2 * tmp_size_2;
+		phase.num_write += tmp_size_2;
+		phase.tmp_size_2 = 2 * tmp_size_2;
+		phase.tmp_size = tmp_size;
+		
+		for(int i = 5; i > 0; --i) {
+			const double in_bytes = table[i].num_entries * phase1::tmp_entry_x::disk_size;
+			const double out_bytes = table[i].num_used * phase2::entry_x::disk_size;
+			phase.num_read += 2 * in_bytes;
+			phase.num_write += out_bytes;
+			tmp_size += out_bytes;
+			phase.tmp_size = std::max(phase.tmp_size, tmp_size);
+			tmp_size -= in_bytes;
+		}
+	}
+	// phase 3: tables 2 .. 7 are converted to line points (stage 1), then parks (stage 2)
+	{
+		auto& phase = out.phase[2];
+		phase.name = "P3";
+		double L_bytes = table[0].num_entries * phase1::tmp_entry_1::disk_size;
+		
+		for(int i = 1; i < 7; ++i) {
+			const double R_bytes = table[i].num_used * (i < 6 ? phase2::entry_x::disk_size : phase1::entry_7::disk_size);
+			const double lp_bytes = table[i].num_used * phase3::entry_lp::disk_size;
+			const double np_bytes = table[i].num_used * phase3::entry_np::disk_size;
+			
+			phase.num_read += L_bytes + R_bytes + lp_bytes;
+			phase.num_write += lp_bytes + np_bytes + park_size[i - 1];
+			
+			// inputs of stage 1 in <tmp_dir2>, table 1 and 2 .. 6 are in <tmp_dir>
+			const double input_2 = (i > 1 ? L_bytes : 0) + (i == 6 ? R_bytes : 0);
+			tmp_size -= (i == 1 ? L_bytes : 0) + (i < 6 ? R_bytes : 0);
+			tmp_size_2 -= input_2;
+			phase.tmp_size_2 = std::max(phase.tmp_size_2, tmp_size_2 + std::max(input_2, lp_bytes));
+			
+			// stage 2 reads line points, writes parks and new positions
+			tmp_size += park_size[i - 1];
+			phase.tmp_size = std::max(phase.tmp_size, tmp_size);
+			phase.tmp_size_2 = std::max(phase.tmp_size_2, tmp_size_2 + std::max(lp_bytes, np_bytes));
+			tmp_size_2 += np_bytes;
+			L_bytes = np_bytes;
+		}
+	}
+	// phase 4: P7 and C tables from the last sort of phase 3
+	{
+		auto& phase = out.phase[3];
+		phase.name = "P4";
+		phase.num_read = tmp_size_2;
+		phase.num_write = park_size[6] + C_size;
+		phase.tmp_size = tmp_size + phase.num_write;
+		phase.tmp_size_2 = tmp_size_2;
+	}
+	
+	const auto& throughput = input.throughput;
+	if(throughput.is_measured()) {
+		out.total_sec = 0;
+	}
+	for(int i = 0; i < 4; ++i) {
+		auto& phase = out.phase[i];
+		if(throughput.is_measured()) {
+			phase.time_sec = (phase.num_read + phase.num_write) / throughput.bytes_per_sec[i];
+			out.total_sec += phase.time_sec;
+		}
+		out.tmp_size = std::max(out.tmp_size, phase.tmp_size);
+		out.tmp_size_2 = std::max(out.tmp_size_2, phase.tmp_size_2);
+	}
+}
+
+inline
+std::string format_time(const double time_sec)
+{
+	if(time_sec < 0) {
+		return "unknown";
+	}
+	std::ostringstream out;
+	out << time_sec << " sec";
+	return out.str();
+}
+
+inline
+void print(const output_t& out)
+{
+	const double GiB = std::pow(1024, 3);
+	std::cout << "[Predict] Sampled " << out.match_rate << " +- " << out.match_rate_error
+			<< " matches per entry, used calibration " << out.used_calib << " +- " << out.used_calib_error << std::endl;
+	for(int i = 0; i < 7; ++i) {
+		const auto& table = out.table[i];
+		std::cout << "[Predict] Table " << i + 1 << ": " << uint64_t(table.num_entries) << " entries, "
+				<< uint64_t(table.num_used) << " used (" << 100 * table.num_used / table.num_entries << " %)"
+				<< ", sort bucket " << table.bucket_size / pow(1024, 2) << " MiB (max "
+				<< table.max_bucket_size / pow(1024, 2) << " MiB)" << std::endl;
+	}
+	for(const auto& phase : out.phase) {
+		std::cout << "[Predict] " << phase.name << ": " << format_time(phase.time_sec) << ", <tmp_dir> "
+				<< phase.tmp_size / GiB << " GiB, <tmp_dir2> " << phase.tmp_size_2 / GiB << " GiB, read "
+				<< phase.num_read / GiB << " GiB, write " << phase.num_write / GiB << " GiB" << std::endl;
+	}
+	std::cout << "[Predict] Peak <tmp_dir> " << out.tmp_size / GiB << " GiB, <tmp_dir2> "
+			<< out.tmp_size_2 / GiB << " GiB" << std::endl;
+	std::cout << "[Predict] Plot size " << uint64_t(out.plot_size) << " bytes, total time "
+			<< format_time(out.total_sec) << std::endl;
+	if(out.total_sec < 0) {
+		std::cout << "[Predict] Time is unknown without measured throughput, see --throughput" << std::endl;
+	}
+}
+
+
+} // predict
+
+#endif /* INCLUDE_CHIA_PREDICT_HPP_ */
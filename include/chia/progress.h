@@ -0,0 +1,54 @@
+/*
+ * progress.h
+ *
+ *  Created on: Jun 19, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_PROGRESS_H_
+#define INCLUDE_CHIA_PROGRESS_H_
+
+#include <string>
+#include <cstdint>
+
+
+/*
+ * Starts a new step (like "P1" table 3), the previous step is finished.
+ * num_entries = expected number of entries processed in this step. [thread-safe]
+ */
+void progress_begin(const std::string& phase, int table, uint64_t num_entries);
+
+/*
+ * Finishes the last step, ie. plot is done. [thread-safe]
+ */
+void progress_end();
+
+/*
+ * Counters for the current step. [thread-safe]
+ */
+void progress_add_entries(uint64_t count);
+void progress_add_buckets(uint64_t count);
+void progress_add_parks(uint64_t count);
+
+/*
+ * Returns overall progress [0, 1] and estimated time left in seconds (-1 if unknown). [thread-safe]
+ */
+double get_progress(double* eta_sec = nullptr);
+
+/*
+ * Writes current status as JSON, via rename() so readers never see a partial file. [thread-safe]
+ */
+void write_progress(const std::string& file_name);
+
+/*
+ * Starts a thread which calls write_progress() every interval_sec. [NOT thread-safe]
+ */
+void progress_start(const std::string& file_name, const std::string& plot_name, double interval_sec = 5);
+
+/*
+ * Stops the thread and writes the final status. [NOT thread-safe]
+ */
+void progress_stop();
+
+
+#endif /* INCLUDE_CHIA_PROGRESS_H_ */
@@ -0,0 +1,67 @@
+/*
+ * ram_disk.h
+ *
+ *  Created on: Jun 10, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_RAM_DISK_H_
+#define INCLUDE_CHIA_RAM_DISK_H_
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+
+/*
+ * In-process RAM disk, files are named "ram:<name>".
+ * Each file is one contiguous anonymous mapping (using huge pages if possible),
+ * which allows readers to access the data directly without copying.
+ */
+
+inline
+bool is_ram_file(const std::string& file_name) {
+	return file_name.compare(0, 4, "ram:") == 0;
+}
+
+/*
+ * Enables the RAM disk with a maximum of capacity bytes.
+ */
+void ram_disk_init(uint64_t capacity);
+
+/*
+ * Same as fopen(), supports "r", "r+", "w", "w+" (binary is implied).
+ * The stream is unbuffered, ie. each fwrite() / fread() is one memcpy(). [thread-safe]
+ */
+FILE* ram_fopen(const std::string& file_name, const char* mode);
+
+/*
+ * Returns a pointer to the file's data and its size, or nullptr if it does not exist.
+ * Only valid until the file is written to or removed. [thread-safe]
+ */
+const uint8_t* ram_data(const std::string& file_name, uint64_t& size);
+
+/*
+ * Returns the file size, or -1 if it does not exist. [thread-safe]
+ */
+int64_t ram_file_size(const std::string& file_name);
+
+/*
+ * Frees memory for [offset, offset + length), which will read as zero afterwards.
+ * Returns false if file is not a RAM disk stream. [thread-safe]
+ */
+bool ram_punch(FILE* file, uint64_t offset, uint64_t length);
+
+/*
+ * Writes [offset, offset + length) without using the stream position, same as pwrite(). [thread-safe]
+ * Returns false if file is not a RAM disk stream, throws if out of space.
+ */
+bool ram_pwrite(FILE* file, uint64_t offset, const void* buf, uint64_t length);
+
+/*
+ * Removes the file, memory is freed once all streams are closed. [thread-safe]
+ */
+void ram_remove(const std::string& file_name);
+
+
+#endif /* INCLUDE_CHIA_RAM_DISK_H_ */
@@ -24,5 +24,29 @@ extern size_t g_read_chunk_size;
  */
 extern size_t g_write_chunk_size;
 
+/*
+ * Preallocate sort buckets and the plot file via fallocate().
+ * default = false
+ */
+extern bool g_preallocate;
+
+/*
+ * Read tables via mmap() instead of fread(), always done for tmpfs.
+ * default = false
+ */
+extern bool g_use_mmap;
+
+/*
+ * Store CRC32C of each block written to temporary files, verify when reading.
+ * default = false
+ */
+extern bool g_verify_tmp;
+
+/*
+ * Maximum number of files per sort (2^x), more buckets share the same files.
+ * default = 8
+ */
+extern int g_max_log_num_files;
+
 
 #endif /* INCLUDE_CHIA_SETTINGS_H_ */
@@ -0,0 +1,59 @@
+/*
+ * trace.h
+ *
+ *  Created on: Jun 20, 2021
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_CHIA_TRACE_H_
+#define INCLUDE_CHIA_TRACE_H_
+
+#include <chia/io_stats.h>		// get_time_micros()
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+
+/*
+ * Fixed event names, others are added via trace_thread_begin().
+ */
+enum {
+	TRACE_READ,			// timed fread() / pread(), see io_stats_add()
+	TRACE_WRITE,		// timed fwrite() / pwrite()
+	TRACE_WAIT,			// ThreadPool waiting for previous job (to keep order)
+	TRACE_OUTPUT,		// ThreadPool blocked on output (backpressure)
+	TRACE_NUM_FIXED
+};
+
+extern std::atomic<bool> g_trace_enabled;
+
+inline
+bool is_trace_enabled() {
+	return g_trace_enabled.load(std::memory_order_relaxed);
+}
+
+/*
+ * Enables tracing, each thread keeps the last max_events in its own ring buffer. [NOT thread-safe]
+ */
+void trace_start(size_t max_events = 1 << 20);
+
+/*
+ * Names the current thread in the trace, returns event name for its jobs
+ * (thread name without "/<index>", so all threads of a pool share it). [thread-safe]
+ */
+uint32_t trace_thread_begin(const std::string& thread_name);
+
+/*
+ * Records an event of the current thread, arg = number of bytes for I/O. [thread-safe]
+ */
+void trace_add(uint32_t name, int64_t begin_us, int64_t end_us, uint64_t arg = 0);
+
+/*
+ * Writes all events as Chrome trace JSON (open with ui.perfetto.dev or chrome://tracing).
+ * Should be called while pipelines are idle, since buffers are not locked. [thread-safe]
+ */
+void write_trace(const std::string& file_name);
+
+
+#endif /* INCLUDE_CHIA_TRACE_H_ */
@@ -15,13 +15,18 @@
 #ifndef SRC_CPP_UTIL_HPP_
 #define SRC_CPP_UTIL_HPP_
 
+#include <chia/cpu_features.h>
+
+#include <bitset>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <numeric>
 #include <queue>
 #include <random>
@@ -81,6 +86,21 @@ inline uint64_t bswap_64(uint64_t x) { return __builtin_bswap64(x); }
 #include <cpuid.h>
 #endif
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/vfs.h>
+#include <sys/mman.h>
+#include <linux/magic.h>
+#endif
+
+#include <chia/disk_usage.h>
+#include <chia/ram_disk.h>
+#include <chia/io_stats.h>
+#include <chia/perf_stats.h>
+
+#include "b3/blake3.h"
+
 class Timer {
 public:
     Timer()
@@ -361,17 +381,10 @@ namespace Util {
     }
 #endif /* defined(_WIN32) || defined(__x86_64__) */
 
+    // Uses popcnt if the CPU supports it, via g_cpu_kernels.popcount
     inline uint64_t PopCount(uint64_t n)
     {
-#if defined(_WIN32)
-        return __popcnt64(n);
-#elif defined(__x86_64__)
-        uint64_t r;
-        __asm__("popcnt %1, %0" : "=r"(r) : "r"(n));
-        return r;
-#else
-        return __builtin_popcountl(n);
-#endif /* defined(_WIN32) ... defined(__x86_64__) */
+        return g_cpu_kernels.popcount(&n, 1);
     }
 }
 
@@ -383,10 +396,35 @@ int64_t get_wall_time_micros() {
 inline
 std::ifstream::pos_type get_file_size(const char* file_name)
 {
+	if(is_ram_file(file_name)) {
+		return ram_file_size(file_name);
+	}
 	std::ifstream in(file_name, std::ifstream::ate | std::ifstream::binary);
 	return in.tellg(); 
 }
 
+/*
+ * Same as fopen() but also supports RAM disk files, see ram_disk.h
+ * The stream is registered for I/O stats, see fwrite_at().
+ */
+inline
+FILE* fopen_ex(const std::string& file_name, const char* mode) {
+	FILE* file = is_ram_file(file_name) ? ram_fopen(file_name, mode) : fopen(file_name.c_str(), mode);
+	if(file) {
+		io_stats_open(file, file_name);
+	}
+	return file;
+}
+
+/*
+ * Same as fclose(), for streams opened via fopen_ex().
+ */
+inline
+int fclose_ex(FILE* file) {
+	io_stats_close(file);
+	return fclose(file);
+}
+
 inline
 void fseek_set(FILE* file, uint64_t offset) {
 	if(fseek(file, offset, SEEK_SET)) {
@@ -404,14 +442,192 @@ size_t fwrite_ex(FILE* file, const void* buf, size_t length) {
 
 inline
 size_t fwrite_at(FILE* file, uint64_t offset, const void* buf, size_t length) {
+	const auto time_begin = get_time_micros();
 	fseek_set(file, offset);
 	fwrite_ex(file, buf, length);
+	io_stats_add(file, true, length, get_time_micros() - time_begin);
+	return length;
+}
+
+/*
+ * Writes at offset without using the stream position, ie. many threads can write to the same file.
+ * Cannot be mixed with fwrite() on the same stream, due to its buffer. [thread-safe]
+ */
+inline
+size_t pwrite_ex(FILE* file, uint64_t offset, const void* buf, size_t length) {
+	const auto time_begin = get_time_micros();
+	if(!ram_pwrite(file, offset, buf, length)) {
+#ifdef __linux__
+		for(size_t done = 0; done < length;) {
+			const auto res = ::pwrite(fileno(file), (const uint8_t*)buf + done, length - done, offset + done);
+			if(res <= 0) {
+				throw std::runtime_error("pwrite() failed with: " + std::string(std::strerror(errno)));
+			}
+			done += res;
+		}
+#else
+		static std::mutex mutex;
+		std::lock_guard<std::mutex> lock(mutex);
+		fseek_set(file, offset);
+		fwrite_ex(file, buf, length);
+#endif
+	}
+	io_stats_add(file, true, length, get_time_micros() - time_begin);
 	return length;
 }
 
+/*
+ * Reserves disk space for [offset, offset + length) without writing to it.
+ * With keep_size = true the file size stays the same.
+ * Returns false if not supported by the OS or file system.
+ */
+inline
+bool fallocate_ex(FILE* file, uint64_t offset, uint64_t length, bool keep_size = true) {
+#ifdef __linux__
+	return fallocate(fileno(file), keep_size ? FALLOC_FL_KEEP_SIZE : 0, offset, length) == 0;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Flushes the file and truncates it to length bytes.
+ * Also releases space preallocated past the end via fallocate_ex().
+ */
+inline
+void ftruncate_ex(FILE* file, uint64_t length) {
+	if(fflush(file)) {
+		throw std::runtime_error("fflush() failed");
+	}
+#ifdef __linux__
+	if(ftruncate(fileno(file), length)) {
+		throw std::runtime_error("ftruncate() failed");
+	}
+#endif
+}
+
+/*
+ * Deallocates [offset, offset + length) of a file, ie. turns it into a hole.
+ * The file needs to be open for writing.
+ * Returns false if not supported by the OS or file system.
+ */
+inline
+bool fpunch_ex(FILE* file, uint64_t offset, uint64_t length) {
+	if(ram_punch(file, offset, length)) {
+		return true;
+	}
+#ifdef __linux__
+	return fallocate(fileno(file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Returns true if the file is on a tmpfs (RAM disk).
+ */
+inline
+bool is_tmpfs(const std::string& file_name) {
+#ifdef __linux__
+	struct statfs info = {};
+	if(statfs(file_name.c_str(), &info) == 0) {
+		return info.f_type == TMPFS_MAGIC;
+	}
+#endif
+	return false;
+}
+
+/*
+ * Maps the first length bytes of a file into memory, read-only and for sequential access.
+ * RAM disk files are returned directly without mapping.
+ * Returns nullptr if not supported.
+ */
+inline
+const uint8_t* mmap_file(const std::string& file_name, size_t length) {
+	if(is_ram_file(file_name)) {
+		uint64_t size = 0;
+		const auto data = ram_data(file_name, size);
+		if(!data || size < length) {
+			throw std::runtime_error("ram_data() failed");
+		}
+		return data;
+	}
+#ifdef __linux__
+	const int fd = open(file_name.c_str(), O_RDONLY);
+	if(fd < 0) {
+		throw std::runtime_error("open() failed");
+	}
+	void* data = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		throw std::runtime_error("mmap() failed");
+	}
+	madvise(data, length, MADV_SEQUENTIAL);
+	return (const uint8_t*)data;
+#else
+	return nullptr;
+#endif
+}
+
+inline
+void munmap_file(const std::string& file_name, const uint8_t* data, size_t length) {
+#ifdef __linux__
+	if(!is_ram_file(file_name)) {
+		munmap((void*)data, length);
+	}
+#endif
+}
+
+inline
+std::vector<uint8_t> hex_to_bytes(const std::string& hex)
+{
+	std::vector<uint8_t> result;
+	for(size_t i = 0; i < hex.length(); i += 2) {
+		const std::string byteString = hex.substr(i, 2);
+		result.push_back(::strtol(byteString.c_str(), NULL, 16));
+	}
+	return result;
+}
+
+/*
+ * Returns BLAKE3 hash of file content as hex.
+ */
+inline
+std::string get_file_checksum(const std::string& file_name)
+{
+	FILE* file = fopen_ex(file_name, "rb");
+	if(!file) {
+		throw std::runtime_error("fopen() failed for " + file_name);
+	}
+	blake3_hasher hasher;
+	blake3_hasher_init(&hasher);
+	
+	std::vector<uint8_t> buffer(16 * 1024 * 1024);
+	while(true) {
+		const size_t num_bytes = fread(buffer.data(), 1, buffer.size(), file);
+		if(num_bytes == 0) {
+			break;
+		}
+		blake3_hasher_update(&hasher, buffer.data(), num_bytes);
+	}
+	const bool failed = ferror(file);
+	fclose_ex(file);
+	if(failed) {
+		throw std::runtime_error("fread() failed for " + file_name);
+	}
+	uint8_t hash[32] = {};
+	blake3_hasher_finalize(&hasher, hash, sizeof(hash));
+	return Util::HexStr(hash, sizeof(hash));
+}
+
 inline
 void remove(const std::string& file_name) {
-	std::remove(file_name.c_str());
+	disk_usage_remove(file_name);
+	if(is_ram_file(file_name)) {
+		ram_remove(file_name);
+	} else {
+		std::remove(file_name.c_str());
+	}
 }
 
 #endif  // SRC_CPP_UTIL_HPP_
@@ -0,0 +1,156 @@
+/*
+ * blake3_short.cpp
+ *
+ *  Created on: Jun 23, 2021
+ *      Author: mad
+ */
+
+#include <chia/blake3_short.h>
+#include <chia/cpu_features.h>
+
+#include "b3/blake3.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CHIA_BLAKE3_AVX2
+#endif
+
+
+void blake3_hash_short(const uint8_t* input, size_t length, size_t count, uint8_t* out)
+{
+	if(length > 64) {
+		throw std::logic_error("blake3_hash_short(): length > 64");
+	}
+	g_cpu_kernels.blake3_short(input, length, count, out);
+}
+
+void blake3_hash_short_sw(const uint8_t* input, size_t length, size_t count, uint8_t* out)
+{
+	for(size_t i = 0; i < count; ++i) {
+		blake3_hasher hasher;
+		blake3_hasher_init(&hasher);
+		blake3_hasher_update(&hasher, input + i * 64, length);
+		blake3_hasher_finalize(&hasher, out + i * 32, 32);
+	}
+}
+
+#ifdef CHIA_BLAKE3_AVX2
+
+static const uint32_t g_iv[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint8_t g_schedule[7][16] = {
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+	{2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+	{3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+	{10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+	{12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+	{9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+	{11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+__attribute__((target("avx2")))
+static inline __m256i rotate_right(const __m256i v, const int bits) {
+	return _mm256_or_si256(_mm256_srli_epi32(v, bits), _mm256_slli_epi32(v, 32 - bits));
+}
+
+#define G_AVX2(a, b, c, d, x, y) \
+	a = _mm256_add_epi32(_mm256_add_epi32(a, b), x); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+	c = _mm256_add_epi32(c, d); b = rotate_right(_mm256_xor_si256(b, c), 12); \
+	a = _mm256_add_epi32(_mm256_add_epi32(a, b), y); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+	c = _mm256_add_epi32(c, d); b = rotate_right(_mm256_xor_si256(b, c), 7);
+
+/*
+ * Single block compression (CHUNK_START | CHUNK_END | ROOT) of 8 inputs at once, one per 32-bit lane.
+ */
+__attribute__((target("avx2")))
+void blake3_hash_short_avx2(const uint8_t* input, size_t length, size_t count, uint8_t* out)
+{
+	const __m256i rot16 = _mm256_setr_epi8(
+			2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+			2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+	const __m256i rot8 = _mm256_setr_epi8(
+			1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+			1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+	const __m256i index = _mm256_setr_epi32(0, 64, 128, 192, 256, 320, 384, 448);
+	const __m256i flags = _mm256_set1_epi32(1 | 2 | 8);
+	
+	// zero bytes beyond length, like blake3_hasher_update() does
+	__m256i mask[16];
+	for(size_t i = 0; i < 16; ++i) {
+		const size_t num_bytes = length > i * 4 ? std::min<size_t>(length - i * 4, 4) : 0;
+		mask[i] = _mm256_set1_epi32(num_bytes < 4 ? (uint32_t(1) << (num_bytes * 8)) - 1 : 0xFFFFFFFF);
+	}
+	const size_t num_done = count - count % 8;
+	
+	for(size_t k = 0; k < num_done; k += 8)
+	{
+		const uint8_t* in = input + k * 64;
+		__m256i m[16];
+		for(size_t i = 0; i < 16; ++i) {
+			m[i] = _mm256_and_si256(_mm256_i32gather_epi32((const int*)(in + i * 4), index, 1), mask[i]);
+		}
+		__m256i v[16];
+		for(size_t i = 0; i < 8; ++i) {
+			v[i] = _mm256_set1_epi32(g_iv[i]);
+		}
+		for(size_t i = 0; i < 4; ++i) {
+			v[8 + i] = _mm256_set1_epi32(g_iv[i]);
+		}
+		v[12] = _mm256_setzero_si256();
+		v[13] = _mm256_setzero_si256();
+		v[14] = _mm256_set1_epi32(length);
+		v[15] = flags;
+		
+		for(size_t r = 0; r < 7; ++r) {
+			const uint8_t* s = g_schedule[r];
+			G_AVX2(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+			G_AVX2(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+			G_AVX2(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+			G_AVX2(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+			G_AVX2(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+			G_AVX2(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+			G_AVX2(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+			G_AVX2(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+		}
+		__m256i h[8];
+		for(size_t i = 0; i < 8; ++i) {
+			h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+		}
+		// transpose to one 32 byte hash per input
+		const __m256i t0 = _mm256_unpacklo_epi32(h[0], h[1]);
+		const __m256i t1 = _mm256_unpackhi_epi32(h[0], h[1]);
+		const __m256i t2 = _mm256_unpacklo_epi32(h[2], h[3]);
+		const __m256i t3 = _mm256_unpackhi_epi32(h[2], h[3]);
+		const __m256i t4 = _mm256_unpacklo_epi32(h[4], h[5]);
+		const __m256i t5 = _mm256_unpackhi_epi32(h[4], h[5]);
+		const __m256i t6 = _mm256_unpacklo_epi32(h[6], h[7]);
+		const __m256i t7 = _mm256_unpackhi_epi32(h[6], h[7]);
+		
+		const __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+		const __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+		const __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+		const __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+		const __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+		const __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+		const __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+		const __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+		
+		__m256i* dst = (__m256i*)(out + k * 32);
+		_mm256_storeu_si256(dst + 0, _mm256_permute2x128_si256(u0, u4, 0x20));
+		_mm256_storeu_si256(dst + 1, _mm256_permute2x128_si256(u1, u5, 0x20));
+		_mm256_storeu_si256(dst + 2, _mm256_permute2x128_si256(u2, u6, 0x20));
+		_mm256_storeu_si256(dst + 3, _mm256_permute2x128_si256(u3, u7, 0x20));
+		_mm256_storeu_si256(dst + 4, _mm256_permute2x128_si256(u0, u4, 0x31));
+		_mm256_storeu_si256(dst + 5, _mm256_permute2x128_si256(u1, u5, 0x31));
+		_mm256_storeu_si256(dst + 6, _mm256_permute2x128_si256(u2, u6, 0x31));
+		_mm256_storeu_si256(dst + 7, _mm256_permute2x128_si256(u3, u7, 0x31));
+	}
+	blake3_hash_short_sw(input + num_done * 64, length, count - num_done, out + num_done * 32);
+}
+
+#endif
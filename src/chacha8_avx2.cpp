@@ -0,0 +1,143 @@
+/*
+ * chacha8_avx2.cpp
+ *
+ *  Created on: Jun 22, 2021
+ *      Author: mad
+ */
+
+#include <chacha8.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static inline __m256i rotate_left(const __m256i v, const int bits) {
+	return _mm256_or_si256(_mm256_slli_epi32(v, bits), _mm256_srli_epi32(v, 32 - bits));
+}
+
+#define QUARTERROUND_AVX2(a, b, c, d) \
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+	c = _mm256_add_epi32(c, d); b = rotate_left(_mm256_xor_si256(b, c), 12); \
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+	c = _mm256_add_epi32(c, d); b = rotate_left(_mm256_xor_si256(b, c), 7);
+
+// stores 8 vectors of 8 words as 8 rows of 32 bytes, stride apart
+__attribute__((target("avx2")))
+static inline void store_transposed(const __m256i* v, uint8_t* out, const size_t stride)
+{
+	const __m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+	const __m256i t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+	const __m256i t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+	const __m256i t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+	const __m256i t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+	const __m256i t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+	const __m256i t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+	const __m256i t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+	
+	const __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+	const __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+	const __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+	const __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+	const __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+	const __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+	const __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+	const __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+	
+	_mm256_storeu_si256((__m256i*)(out + 0 * stride), _mm256_permute2x128_si256(u0, u4, 0x20));
+	_mm256_storeu_si256((__m256i*)(out + 1 * stride), _mm256_permute2x128_si256(u1, u5, 0x20));
+	_mm256_storeu_si256((__m256i*)(out + 2 * stride), _mm256_permute2x128_si256(u2, u6, 0x20));
+	_mm256_storeu_si256((__m256i*)(out + 3 * stride), _mm256_permute2x128_si256(u3, u7, 0x20));
+	_mm256_storeu_si256((__m256i*)(out + 4 * stride), _mm256_permute2x128_si256(u0, u4, 0x31));
+	_mm256_storeu_si256((__m256i*)(out + 5 * stride), _mm256_permute2x128_si256(u1, u5, 0x31));
+	_mm256_storeu_si256((__m256i*)(out + 6 * stride), _mm256_permute2x128_si256(u2, u6, 0x31));
+	_mm256_storeu_si256((__m256i*)(out + 7 * stride), _mm256_permute2x128_si256(u3, u7, 0x31));
+}
+
+/*
+ * Computes 8 blocks at once, one per 32-bit lane, then transposes them into keystream order.
+ */
+__attribute__((target("avx2")))
+static void chacha8_x8(const struct chacha8_ctx *x, const __m256i pos_lo, const __m256i pos_hi, uint8_t *c)
+{
+	const __m256i rot16 = _mm256_setr_epi8(
+			2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+			2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+	const __m256i rot8 = _mm256_setr_epi8(
+			3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+			3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+	
+	__m256i j[16];
+	for(int i = 0; i < 16; ++i) {
+		j[i] = _mm256_set1_epi32(x->input[i]);
+	}
+	j[12] = pos_lo;
+	j[13] = pos_hi;
+	
+	__m256i v[16];
+	for(int i = 0; i < 16; ++i) {
+		v[i] = j[i];
+	}
+	for(int i = 8; i > 0; i -= 2) {
+		QUARTERROUND_AVX2(v[0], v[4], v[8], v[12]);
+		QUARTERROUND_AVX2(v[1], v[5], v[9], v[13]);
+		QUARTERROUND_AVX2(v[2], v[6], v[10], v[14]);
+		QUARTERROUND_AVX2(v[3], v[7], v[11], v[15]);
+		QUARTERROUND_AVX2(v[0], v[5], v[10], v[15]);
+		QUARTERROUND_AVX2(v[1], v[6], v[11], v[12]);
+		QUARTERROUND_AVX2(v[2], v[7], v[8], v[13]);
+		QUARTERROUND_AVX2(v[3], v[4], v[9], v[14]);
+	}
+	for(int i = 0; i < 16; ++i) {
+		v[i] = _mm256_add_epi32(v[i], j[i]);
+	}
+	store_transposed(v, c, 64);
+	store_transposed(v + 8, c + 32, 64);
+}
+
+// loads 64-bit block counters into lower and upper words
+__attribute__((target("avx2")))
+static void load_pos(const uint64_t* pos, __m256i& pos_lo, __m256i& pos_hi)
+{
+	alignas(32) uint32_t lo[8];
+	alignas(32) uint32_t hi[8];
+	for(int i = 0; i < 8; ++i) {
+		lo[i] = pos[i];
+		hi[i] = pos[i] >> 32;
+	}
+	pos_lo = _mm256_load_si256((const __m256i*)lo);
+	pos_hi = _mm256_load_si256((const __m256i*)hi);
+}
+
+extern "C"
+__attribute__((target("avx2")))
+void chacha8_get_keystream_avx2(const struct chacha8_ctx *x, uint64_t pos, uint32_t n_blocks, uint8_t *c)
+{
+	for(; n_blocks >= 8; n_blocks -= 8, pos += 8, c += 8 * 64)
+	{
+		uint64_t list[8];
+		for(int i = 0; i < 8; ++i) {
+			list[i] = pos + i;
+		}
+		__m256i pos_lo, pos_hi;
+		load_pos(list, pos_lo, pos_hi);
+		chacha8_x8(x, pos_lo, pos_hi, c);
+	}
+	if(n_blocks) {
+		chacha8_get_keystream(x, pos, n_blocks, c);
+	}
+}
+
+extern "C"
+__attribute__((target("avx2")))
+void chacha8_get_blocks_avx2(const struct chacha8_ctx *x, const uint64_t *pos, uint32_t n_blocks, uint8_t *c)
+{
+	for(; n_blocks >= 8; n_blocks -= 8, pos += 8, c += 8 * 64)
+	{
+		__m256i pos_lo, pos_hi;
+		load_pos(pos, pos_lo, pos_hi);
+		chacha8_x8(x, pos_lo, pos_hi, c);
+	}
+	chacha8_get_blocks_sw(x, pos, n_blocks, c);
+}
+
+#endif
@@ -9,6 +9,9 @@
 #include <chia/phase2.hpp>
 #include <chia/phase3.hpp>
 #include <chia/phase4.hpp>
+#include <chia/predict.hpp>
+#include <chia/progress.h>
+#include <chia/cpu_features.h>
 #include <chia/chia_filesystem.hpp>
 
 #include <bls.hpp>
@@ -18,15 +21,23 @@
 #include <iostream>
 
 
+// parses sizes like "110G", returns 0 if invalid
 inline
-std::vector<uint8_t> hex_to_bytes(const std::string& hex)
+uint64_t parse_size(const std::string& str)
 {
-	std::vector<uint8_t> result;
-	for(size_t i = 0; i < hex.length(); i += 2) {
-		const std::string byteString = hex.substr(i, 2);
-		result.push_back(::strtol(byteString.c_str(), NULL, 16));
+	char* end = nullptr;
+	const double value = ::strtod(str.c_str(), &end);
+	if(end == str.c_str() || value <= 0) {
+		return 0;
 	}
-	return result;
+	switch(*end) {
+		case 'T': return value * (uint64_t(1) << 40);
+		case 'G': return value * (uint64_t(1) << 30);
+		case 'M': return value * (uint64_t(1) << 20);
+		case 'K': return value * (uint64_t(1) << 10);
+		case 0: return value;
+	}
+	return 0;
 }
 
 inline
@@ -54,11 +65,15 @@ phase4::output_t create_plot(	const int num_threads,
 								const vector<uint8_t>& pool_key_bytes,
 								const vector<uint8_t>& farmer_key_bytes,
 								const std::string& tmp_dir,
-								const std::string& tmp_dir_2)
+								const std::string& tmp_dir_2,
+								const vector<uint8_t>& fixed_seed = {},
+								const vector<uint8_t>& fixed_id = {},
+								const std::string& status_file = "")
 {
 	const auto total_begin = get_wall_time_micros();
 	
 	std::cout << "Number of Threads: " << num_threads << std::endl;
+	std::cout << "CPU Features: " << cpu_features_to_string(get_cpu_features()) << std::endl;
 	std::cout << "Number of Sort Buckets: 2^" << log_num_buckets
 			<< " (" << (1 << log_num_buckets) << ")" << std::endl;
 	
@@ -68,8 +83,17 @@ phase4::output_t create_plot(	const int num_threads,
 	std::cout << "Pool Public Key:   " << bls::Util::HexStr(pool_key.Serialize()) << std::endl;
 	std::cout << "Farmer Public Key: " << bls::Util::HexStr(farmer_key.Serialize()) << std::endl;
 	
+	// deterministic mode: same seed / id gives the same plot, for benchmarks
+	const bool is_deterministic = !fixed_seed.empty() || !fixed_id.empty();
+	
 	vector<uint8_t> seed(32);
-	randombytes_buf(seed.data(), seed.size());
+	if(!fixed_seed.empty()) {
+		seed = fixed_seed;
+	} else if(!fixed_id.empty()) {
+		seed = fixed_id;
+	} else {
+		randombytes_buf(seed.data(), seed.size());
+	}
 	
 	bls::AugSchemeMPL MPL;
 	const bls::PrivateKey master_sk = MPL.KeyGen(seed);
@@ -90,12 +114,23 @@ phase4::output_t create_plot(	const int num_threads,
 		}
 		bls::Util::Hash256(params.id.data(), bytes.data(), bytes.size());
 	}
-	const std::string plot_name = "plot-k32-" + get_date_string_ex("%Y-%m-%d-%H-%M")
+	if(!fixed_id.empty()) {
+		// not farmable, since id does not match the keys anymore
+		::memcpy(params.id.data(), fixed_id.data(), params.id.size());
+	}
+	const std::string plot_name = "plot-k32-"
+			+ (is_deterministic ? get_date_string_ex("%Y-%m-%d-%H-%M", true, 0) : get_date_string_ex("%Y-%m-%d-%H-%M"))
 			+ "-" + bls::Util::HexStr(params.id.data(), params.id.size());
 	
 	std::cout << "Working Directory:   " << (tmp_dir.empty() ? "$PWD" : tmp_dir) << std::endl;
 	std::cout << "Working Directory 2: " << (tmp_dir_2.empty() ? "$PWD" : tmp_dir_2) << std::endl;
 	std::cout << "Plot Name: " << plot_name << std::endl;
+	if(is_deterministic) {
+		std::cout << "Deterministic Mode: " << (fixed_id.empty() ? "--seed" : "--plot-id") << std::endl;
+	}
+	if(!status_file.empty()) {
+		progress_start(status_file, plot_name);
+	}
 	
 	// memo = bytes(pool_public_key) + bytes(farmer_public_key) + bytes(local_master_sk)
 	params.memo.insert(params.memo.end(), pool_key_bytes.begin(), pool_key_bytes.end());
@@ -117,31 +152,101 @@ phase4::output_t create_plot(	const int num_threads,
 	phase4::output_t out_4;
 	phase4::compute(out_3, out_4, num_threads, log_num_buckets, plot_name, tmp_dir, tmp_dir_2);
 	
+	progress_end();
+	progress_stop();
+	
 	std::cout << "Total plot creation time was "
 			<< (get_wall_time_micros() - total_begin) / 1e6 << " sec" << std::endl;
+	print_disk_usage("", true);
 	return out_4;
 }
 
 
 int main(int argc, char** argv)
 {
-	if(argc < 3) {
-		std::cout << "chia_plot <pool_key> <farmer_key> [tmp_dir] [tmp_dir2] [num_threads] [log_num_buckets]" << std::endl << std::endl;
+	std::string io_stats_file;
+	std::string status_file;
+	std::string trace_file;
+	std::string golden_checksum;
+	std::string throughput_file;
+	std::string cpu_features;
+	bool predict_only = false;
+	bool enable_perf = false;
+	std::vector<uint8_t> fixed_seed;
+	std::vector<uint8_t> fixed_id;
+	bool print_checksum = false;
+	std::vector<std::string> args;
+	for(int i = 1; i < argc; ++i) {
+		const std::string arg(argv[i]);
+		if(arg == "--io-stats" && i + 1 < argc) {
+			io_stats_file = argv[++i];
+		} else if(arg == "--status" && i + 1 < argc) {
+			status_file = argv[++i];
+		} else if(arg == "--seed" && i + 1 < argc) {
+			fixed_seed = hex_to_bytes(argv[++i]);
+		} else if(arg == "--plot-id" && i + 1 < argc) {
+			fixed_id = hex_to_bytes(argv[++i]);
+		} else if(arg == "--checksum") {
+			print_checksum = true;
+		} else if(arg == "--golden" && i + 1 < argc) {
+			golden_checksum = argv[++i];
+			print_checksum = true;
+		} else if(arg == "--prealloc") {
+			g_preallocate = true;
+		} else if(arg == "--mmap") {
+			g_use_mmap = true;
+		} else if(arg == "--verify-tmp") {
+			g_verify_tmp = true;
+		} else if(arg == "--trace" && i + 1 < argc) {
+			trace_file = argv[++i];
+		} else if(arg == "--perf") {
+			enable_perf = true;
+		} else if(arg == "--predict") {
+			predict_only = true;
+		} else if(arg == "--throughput" && i + 1 < argc) {
+			throughput_file = argv[++i];
+		} else if(arg == "--cpu-features" && i + 1 < argc) {
+			cpu_features = argv[++i];
+		} else if(arg == "--max-log-files" && i + 1 < argc) {
+			g_max_log_num_files = std::max(atoi(argv[++i]), 0);
+		} else {
+			args.push_back(arg);
+		}
+	}
+	if(args.size() < 2) {
+		std::cout << "chia_plot [options] <pool_key> <farmer_key> [tmp_dir] [tmp_dir2] [num_threads] [log_num_buckets]" << std::endl << std::endl;
 		std::cout << "For <pool_key> and <farmer_key> see output of `chia keys show`." << std::endl;
 		std::cout << "<tmp_dir> needs about 200G space, it will handle about 25% of all writes. (Examples: './', '/mnt/tmp/')" << std::endl;
 		std::cout << "<tmp_dir2> needs about 110G space and ideally is a RAM drive, it will handle about 75% of all writes." << std::endl;
 		std::cout << "If <tmp_dir> is not specified it defaults to current directory." << std::endl;
 		std::cout << "If <tmp_dir2> is not specified it defaults to <tmp_dir>." << std::endl;
+		std::cout << "<tmp_dir2> can also be an internal RAM disk of given size, for example 'ram:110G'." << std::endl;
 		std::cout << "[num_threads] defaults to 4, it's recommended to use number of physical cores." << std::endl;
-		std::cout << "[log_num_buckets] defaults to 7 (2^7 = 128)" << std::endl;
+		std::cout << "[log_num_buckets] defaults to 7 (2^7 = 128)" << std::endl << std::endl;
+		std::cout << "Options:" << std::endl;
+		std::cout << "  --prealloc    Preallocate sort buckets and the plot file with fallocate() to avoid fragmentation." << std::endl;
+		std::cout << "  --mmap        Read tables via mmap() (always done for tmpfs)." << std::endl;
+		std::cout << "  --verify-tmp  Checksum (CRC32C) all blocks written to temp files, abort on corruption when reading." << std::endl;
+		std::cout << "  --io-stats <file>  Write I/O statistics per phase, directory and file as JSON." << std::endl;
+		std::cout << "  --status <file>    Rewrite progress, phase and ETA as JSON every 5 sec." << std::endl;
+		std::cout << "  --perf             Print hardware counters (IPC, cache, TLB and branch misses) per table and phase." << std::endl;
+		std::cout << "  --trace <file>     Write timeline of all pipeline threads and I/O as Chrome trace JSON (for Perfetto)." << std::endl;
+		std::cout << "  --max-log-files <n>  Maximum number of files per sort (2^n, default 8), more buckets share files." << std::endl;
+		std::cout << "  --cpu-features <list>  Restrict SIMD kernels to given features (like 'sse4.2,popcnt' or 'none'), for testing." << std::endl;
+		std::cout << "  --seed <hex>     Use fixed 32 byte master seed (deterministic plot name, for benchmarks)." << std::endl;
+		std::cout << "  --plot-id <hex>  Use fixed 32 byte plot id, plot is not farmable (for benchmarks)." << std::endl;
+		std::cout << "  --checksum       Print BLAKE3 checksum of final plot." << std::endl;
+		std::cout << "  --golden <hex>   Compare BLAKE3 checksum of final plot, exit code -3 if different." << std::endl;
+		std::cout << "  --predict        Print predicted table sizes, temp space and duration, then exit." << std::endl;
+		std::cout << "  --throughput <file>  Measured throughput for --predict (test.e2e.json from test_e2e)." << std::endl;
 		return -1;
 	}
-	const auto pool_key = hex_to_bytes(argv[1]);
-	const auto farmer_key = hex_to_bytes(argv[2]);
-	const std::string tmp_dir = argc > 3 ? std::string(argv[3]) : std::string();
-	const std::string tmp_dir2 = argc > 4 ? std::string(argv[4]) : tmp_dir;
-	const int num_threads = argc > 5 ? atoi(argv[5]) : 4;
-	const int log_num_buckets = argc > 6 ? atoi(argv[6]) : 7;
+	const auto pool_key = hex_to_bytes(args[0]);
+	const auto farmer_key = hex_to_bytes(args[1]);
+	const std::string tmp_dir = args.size() > 2 ? args[2] : std::string();
+	std::string tmp_dir2 = args.size() > 3 ? args[3] : tmp_dir;
+	const int num_threads = args.size() > 4 ? atoi(args[4].c_str()) : 4;
+	const int log_num_buckets = args.size() > 5 ? atoi(args[5].c_str()) : 7;
 	
 	if(pool_key.size() != bls::G1Element::SIZE) {
 		std::cout << "Invalid <pool_key>: " << bls::Util::HexStr(pool_key)
@@ -153,14 +258,35 @@ int main(int argc, char** argv)
 			<< " (needs to be " << bls::G1Element::SIZE << " bytes)" << std::endl;
 		return -2;
 	}
+	if(is_ram_file(tmp_dir)) {
+		std::cout << "Invalid <tmp_dir>: " << tmp_dir << " (RAM disk only supported for <tmp_dir2>)" << std::endl;
+		return -2;
+	}
 	if(!tmp_dir.empty() && tmp_dir.find_last_of("/\\") != tmp_dir.size() - 1) {
 		std::cout << "Invalid <tmp_dir>: " << tmp_dir << " (needs trailing '/' or '\\')" << std::endl;
 		return -2;
 	}
-	if(!tmp_dir2.empty() && tmp_dir2.find_last_of("/\\") != tmp_dir2.size() - 1) {
+	uint64_t ram_disk_size = 0;
+	if(is_ram_file(tmp_dir2)) {
+		ram_disk_size = parse_size(tmp_dir2.substr(4));
+		if(!ram_disk_size) {
+			std::cout << "Invalid <tmp_dir2>: " << tmp_dir2 << " (RAM disk needs a size, like 'ram:110G')" << std::endl;
+			return -2;
+		}
+		tmp_dir2 = "ram:";
+	}
+	else if(!tmp_dir2.empty() && tmp_dir2.find_last_of("/\\") != tmp_dir2.size() - 1) {
 		std::cout << "Invalid <tmp_dir2>: " << tmp_dir2 << " (needs trailing '/' or '\\')" << std::endl;
 		return -2;
 	}
+	if(!fixed_seed.empty() && fixed_seed.size() != 32) {
+		std::cout << "Invalid --seed: " << bls::Util::HexStr(fixed_seed) << " (needs to be 32 bytes)" << std::endl;
+		return -2;
+	}
+	if(!fixed_id.empty() && fixed_id.size() != 32) {
+		std::cout << "Invalid --plot-id: " << bls::Util::HexStr(fixed_id) << " (needs to be 32 bytes)" << std::endl;
+		return -2;
+	}
 	if(num_threads < 1 || num_threads > 1024) {
 		std::cout << "Invalid num_threads: " << num_threads << " (supported: [1..1024])" << std::endl;
 		return -2;
@@ -169,12 +295,41 @@ int main(int argc, char** argv)
 		std::cout << "Invalid log_num_buckets: " << log_num_buckets << " (supported: 2^[4..16])" << std::endl;
 		return -2;
 	}
+	if(!cpu_features.empty()) {
+		try {
+			set_cpu_features(cpu_features);
+		}
+		catch(const std::exception& ex) {
+			std::cout << "Invalid --cpu-features: " << ex.what() << std::endl;
+			return -2;
+		}
+	}
+	if(predict_only) {
+		predict::input_t input;
+		input.log_num_buckets = log_num_buckets;
+		try {
+			if(!throughput_file.empty()) {
+				input.throughput.load(throughput_file);
+			}
+		}
+		catch(const std::exception& ex) {
+			std::cout << "Error: " << ex.what() << std::endl;
+			return -2;
+		}
+		predict::output_t prediction;
+		predict::compute(input, prediction);
+		predict::print(prediction);
+		return 0;
+	}
 	try {
 		// Check if the paths exist
 		if(!fs::exists(tmp_dir)) {
 			throw std::runtime_error("<tmp_dir> directory '" + tmp_dir + "' does not exist");
 		}
-		if(!fs::exists(tmp_dir2)) {
+		if(ram_disk_size) {
+			ram_disk_init(ram_disk_size);
+		}
+		else if(!fs::exists(tmp_dir2)) {
 			throw std::runtime_error("<tmp_dir2> directory '" + tmp_dir2 + "' does not exist");
 		}
 	}
@@ -183,7 +338,31 @@ int main(int argc, char** argv)
 		return -2;
 	}
 	
-	const auto out = create_plot(num_threads, log_num_buckets, pool_key, farmer_key, tmp_dir, tmp_dir2);
+	if(enable_perf && !perf_stats_init()) {
+		std::cout << "Warning: perf_event_open() failed, --perf disabled (check kernel.perf_event_paranoid)" << std::endl;
+	}
+	if(!trace_file.empty()) {
+		trace_start();
+	}
+	const auto out = create_plot(num_threads, log_num_buckets, pool_key, farmer_key, tmp_dir, tmp_dir2, fixed_seed, fixed_id, status_file);
+	
+	if(!io_stats_file.empty()) {
+		write_io_stats(io_stats_file);
+	}
+	if(!trace_file.empty()) {
+		write_trace(trace_file);
+	}
+	if(print_checksum) {
+		const auto checksum = get_file_checksum(out.plot_file_name);
+		std::cout << "Plot Checksum: " << checksum << std::endl;
+		if(!golden_checksum.empty()) {
+			if(checksum != golden_checksum) {
+				std::cout << "Checksum mismatch, expected " << golden_checksum << std::endl;
+				return -3;
+			}
+			std::cout << "Checksum matches" << std::endl;
+		}
+	}
 	
 	// TODO: copy to destination
 	
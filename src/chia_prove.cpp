@@ -0,0 +1,102 @@
+/*
+ * chia_prove.cpp
+ *
+ *  Created on: Jun 16, 2021
+ *      Author: mad
+ */
+
+#include <chia/PlotReader.hpp>
+
+#include <random>
+#include <iostream>
+#include <algorithm>
+
+
+static double percentile(std::vector<int64_t> times, double p)
+{
+	if(times.empty()) {
+		return 0;
+	}
+	std::sort(times.begin(), times.end());
+	return times[std::min<size_t>(p * times.size(), times.size() - 1)] / 1e3;
+}
+
+/*
+ * Looks up qualities and full proofs in a finished k32 plot.
+ *
+ * Usage: chia_prove <plot> [-c <challenge>] [-n <count>]
+ */
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		std::cout << "Usage: chia_prove <file.plot> [-c <challenge hex>] [-n <num_challenges>]" << std::endl;
+		return -1;
+	}
+	const std::string file_name = argv[1];
+	std::string challenge_str;
+	int num_challenges = 0;
+	for(int i = 2; i + 1 < argc; i += 2) {
+		const std::string arg = argv[i];
+		if(arg == "-c" || arg == "--challenge") {
+			challenge_str = argv[i + 1];
+		} else if(arg == "-n" || arg == "--count") {
+			num_challenges = atoi(argv[i + 1]);
+		} else {
+			std::cout << "Invalid option: " << arg << std::endl;
+			return -1;
+		}
+	}
+	phase1::initialize();
+	
+	const PlotReader plot(file_name);
+	std::cout << "Plot: " << file_name << std::endl;
+	std::cout << "Plot ID: " << Util::HexStr(plot.get_plot_id().data(), plot.get_plot_id().size()) << std::endl;
+	std::cout << "Size: " << plot.get_file_size() / pow(1024, 3) << " GiB" << std::endl;
+	
+	if(!challenge_str.empty())
+	{
+		const auto challenge = hex_to_bytes(challenge_str);
+		if(challenge.size() != 32) {
+			std::cout << "Invalid challenge, needs to be 32 bytes" << std::endl;
+			return -2;
+		}
+		const auto qualities = plot.get_qualities(challenge.data());
+		std::cout << "Found " << qualities.size() << " proofs" << std::endl;
+		
+		for(size_t i = 0; i < qualities.size(); ++i) {
+			const auto proof = PlotReader::get_proof_bytes(plot.get_full_proof(challenge.data(), i));
+			std::cout << "Quality [" << i << "]: " << Util::HexStr(qualities[i].data(), qualities[i].size()) << std::endl;
+			std::cout << "Proof [" << i << "]: " << Util::HexStr(proof.data(), proof.size()) << std::endl;
+		}
+	}
+	if(num_challenges > 0)
+	{
+		std::mt19937_64 generator(0);
+		std::vector<int64_t> quality_times;
+		std::vector<int64_t> proof_times;
+		size_t num_proofs = 0;
+		
+		for(int i = 0; i < num_challenges; ++i) {
+			uint8_t challenge[32];
+			for(auto& byte : challenge) {
+				byte = generator();
+			}
+			auto time_begin = get_wall_time_micros();
+			const auto qualities = plot.get_qualities(challenge);
+			quality_times.push_back(get_wall_time_micros() - time_begin);
+			
+			for(size_t j = 0; j < qualities.size(); ++j) {
+				time_begin = get_wall_time_micros();
+				plot.get_full_proof(challenge, j);
+				proof_times.push_back(get_wall_time_micros() - time_begin);
+				num_proofs++;
+			}
+		}
+		std::cout << "Challenges: " << num_challenges << ", found " << num_proofs << " proofs" << std::endl;
+		std::cout << "Qualities: p50 " << percentile(quality_times, 0.5) << " ms, p99 "
+				<< percentile(quality_times, 0.99) << " ms" << std::endl;
+		std::cout << "Full proofs: p50 " << percentile(proof_times, 0.5) << " ms, p99 "
+				<< percentile(proof_times, 0.99) << " ms" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * cpu_features.cpp
+ *
+ *  Created on: Jun 22, 2021
+ *      Author: mad
+ */
+
+#include <chia/cpu_features.h>
+#include <chia/crc32c.h>
+#include <chia/codec.h>
+#include <chia/blake3_short.h>
+
+#include <chacha8.h>
+
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#define CHIA_CPU_X86
+#endif
+
+
+static const std::pair<uint32_t, const char*> g_feature_names[] = {
+	{CPU_POPCNT, "popcnt"},
+	{CPU_SSE42, "sse4.2"},
+	{CPU_AVX2, "avx2"},
+};
+
+// portable kernels, valid before dynamic initialization
+cpu_kernels_t g_cpu_kernels = {
+	popcount_sw,
+	crc32c_sw,
+	chacha8_get_keystream,
+	chacha8_get_blocks_sw,
+	blake3_hash_short_sw,
+	shuffle_apply_none,
+};
+
+static uint32_t g_cpu_features = 0;
+
+uint64_t popcount_sw(const uint64_t* words, size_t count)
+{
+	uint64_t sum = 0;
+	for(size_t i = 0; i < count; ++i) {
+		uint64_t v = words[i];
+		v = v - ((v >> 1) & 0x5555555555555555ull);
+		v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+		v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		sum += (v * 0x0101010101010101ull) >> 56;
+	}
+	return sum;
+}
+
+#ifdef CHIA_CPU_X86
+__attribute__((target("popcnt")))
+uint64_t popcount_popcnt(const uint64_t* words, size_t count)
+{
+	uint64_t sum = 0;
+	for(size_t i = 0; i < count; ++i) {
+		sum += __builtin_popcountll(words[i]);
+	}
+	return sum;
+}
+#else
+uint64_t popcount_popcnt(const uint64_t* words, size_t count)
+{
+	return popcount_sw(words, count);
+}
+#endif
+
+void chacha8_get_blocks_sw(const chacha8_ctx* ctx, const uint64_t* pos, uint32_t n_blocks, uint8_t* out)
+{
+	for(uint32_t i = 0; i < n_blocks; ++i) {
+		chacha8_get_keystream(ctx, pos[i], 1, out + i * 64);
+	}
+}
+
+uint32_t detect_cpu_features()
+{
+	static const uint32_t features = []() -> uint32_t {
+		uint32_t out = 0;
+#ifdef CHIA_CPU_X86
+		unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+		if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+			return 0;
+		}
+		if(ecx & bit_POPCNT) {
+			out |= CPU_POPCNT;
+		}
+		if(ecx & bit_SSE4_2) {
+			out |= CPU_SSE42;
+		}
+		// AVX2 also needs the OS to save YMM registers (XCR0 bits 1 and 2)
+		if((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+			uint32_t xcr0_lo = 0, xcr0_hi = 0;
+			__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+			if((xcr0_lo & 6) == 6 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2)) {
+				out |= CPU_AVX2;
+			}
+		}
+#endif
+		return out;
+	}();
+	return features;
+}
+
+uint32_t get_cpu_features()
+{
+	return g_cpu_features;
+}
+
+static void select_kernels(const uint32_t features)
+{
+	cpu_kernels_t kernels = {
+		popcount_sw,
+		crc32c_sw,
+		chacha8_get_keystream,
+		chacha8_get_blocks_sw,
+		blake3_hash_short_sw,
+		shuffle_apply_none,
+	};
+#ifdef CHIA_CPU_X86
+	if(features & CPU_POPCNT) {
+		kernels.popcount = popcount_popcnt;
+	}
+	if(features & CPU_SSE42) {
+		kernels.crc32c = crc32c_sse42;
+	}
+	if(features & CPU_AVX2) {
+		kernels.chacha8_keystream = chacha8_get_keystream_avx2;
+		kernels.chacha8_blocks = chacha8_get_blocks_avx2;
+		kernels.blake3_short = blake3_hash_short_avx2;
+		kernels.shuffle = shuffle_apply_avx2;
+	}
+#endif
+	g_cpu_kernels = kernels;
+	g_cpu_features = features;
+}
+
+static const bool g_is_init = []() {
+	select_kernels(detect_cpu_features());
+	return true;
+}();
+
+void set_cpu_features(const std::string& list)
+{
+	const auto detected = detect_cpu_features();
+	if(list == "native") {
+		select_kernels(detected);
+		return;
+	}
+	uint32_t features = 0;
+	if(list != "none") {
+		std::istringstream in(list);
+		std::string name;
+		while(std::getline(in, name, ',')) {
+			uint32_t flag = 0;
+			for(const auto& entry : g_feature_names) {
+				if(name == entry.second) {
+					flag = entry.first;
+				}
+			}
+			if(!flag) {
+				throw std::runtime_error("unknown CPU feature: '" + name + "' (supported: popcnt, sse4.2, avx2, none, native)");
+			}
+			if(!(detected & flag)) {
+				throw std::runtime_error("CPU feature not supported: " + name);
+			}
+			features |= flag;
+		}
+	}
+	select_kernels(features);
+}
+
+std::string cpu_features_to_string(uint32_t features)
+{
+	std::string out;
+	for(const auto& entry : g_feature_names) {
+		if(features & entry.first) {
+			out += std::string(out.empty() ? "" : ",") + entry.second;
+		}
+	}
+	return out.empty() ? "none" : out;
+}
@@ -0,0 +1,119 @@
+/*
+ * crc32c.cpp
+ *
+ *  Created on: Jun 21, 2021
+ *      Author: mad
+ */
+
+#include <chia/crc32c.h>
+#include <chia/cpu_features.h>
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CHIA_CRC32C_SSE42
+#endif
+
+
+static const uint32_t g_poly = 0x82F63B78;		// reversed Castagnoli polynomial
+
+// slicing-by-8 tables for the software fallback
+static const std::array<std::array<uint32_t, 256>, 8> g_table = []() {
+	std::array<std::array<uint32_t, 256>, 8> table;
+	for(uint32_t i = 0; i < 256; ++i) {
+		uint32_t crc = i;
+		for(int k = 0; k < 8; ++k) {
+			crc = (crc >> 1) ^ (crc & 1 ? g_poly : 0);
+		}
+		table[0][i] = crc;
+	}
+	for(uint32_t i = 0; i < 256; ++i) {
+		for(int k = 1; k < 8; ++k) {
+			table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+		}
+	}
+	return table;
+}();
+
+uint32_t crc32c_sw(const uint8_t* data, size_t length, uint32_t crc)
+{
+	for(; length >= 8; length -= 8, data += 8) {
+		uint64_t word;
+		::memcpy(&word, data, 8);
+		word ^= crc;
+		crc = g_table[7][word & 0xFF] ^ g_table[6][(word >> 8) & 0xFF]
+			^ g_table[5][(word >> 16) & 0xFF] ^ g_table[4][(word >> 24) & 0xFF]
+			^ g_table[3][(word >> 32) & 0xFF] ^ g_table[2][(word >> 40) & 0xFF]
+			^ g_table[1][(word >> 48) & 0xFF] ^ g_table[0][word >> 56];
+	}
+	for(; length; --length, ++data) {
+		crc = (crc >> 8) ^ g_table[0][(crc ^ *data) & 0xFF];
+	}
+	return crc;
+}
+
+#ifdef CHIA_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(const uint8_t* data, size_t length, uint32_t crc)
+{
+	uint64_t crc_64 = crc;
+	for(; length >= 8; length -= 8, data += 8) {
+		uint64_t word;
+		::memcpy(&word, data, 8);
+		crc_64 = _mm_crc32_u64(crc_64, word);
+	}
+	crc = crc_64;
+	for(; length; --length, ++data) {
+		crc = _mm_crc32_u8(crc, *data);
+	}
+	return crc;
+}
+#endif
+
+uint32_t crc32c(const void* data, size_t length, uint32_t crc)
+{
+	return ~g_cpu_kernels.crc32c((const uint8_t*)data, length, ~crc);
+}
+
+// returns a * b modulo the polynomial, see zlib crc32_combine()
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = uint32_t(1) << 31;
+	uint32_t p = 0;
+	while(true) {
+		if(a & m) {
+			p ^= b;
+			if((a & (m - 1)) == 0) {
+				break;
+			}
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ g_poly : b >> 1;
+	}
+	return p;
+}
+
+// x^(2^k) modulo the polynomial
+static const std::array<uint32_t, 32> g_x2n_table = []() {
+	std::array<uint32_t, 32> table;
+	uint32_t p = uint32_t(1) << 30;		// x^1
+	table[0] = p;
+	for(int k = 1; k < 32; ++k) {
+		table[k] = p = multmodp(p, p);
+	}
+	return table;
+}();
+
+uint32_t crc32c_combine(uint32_t crc_A, uint32_t crc_B, uint64_t length_B)
+{
+	// multiply crc_A by x^(8 * length_B)
+	uint32_t p = uint32_t(1) << 31;		// x^0
+	for(int k = 3; length_B; length_B >>= 1, ++k) {
+		if(length_B & 1) {
+			p = multmodp(g_x2n_table[k & 31], p);
+		}
+	}
+	return multmodp(p, crc_A) ^ crc_B;
+}
@@ -0,0 +1,76 @@
+/*
+ * disk_usage.cpp
+ *
+ *  Created on: Jun 9, 2021
+ *      Author: mad
+ */
+
+#include <chia/disk_usage.h>
+
+#include <map>
+#include <mutex>
+#include <iostream>
+#include <algorithm>
+
+
+struct dir_usage_t {
+	int64_t current = 0;
+	int64_t peak = 0;
+	int64_t total_peak = 0;
+};
+
+static std::mutex g_mutex;
+static std::map<std::string, int64_t> g_files;
+static std::map<std::string, dir_usage_t> g_dirs;
+
+std::string get_usage_dir(const std::string& file_name)
+{
+	if(file_name.compare(0, 4, "ram:") == 0) {
+		return "ram:";
+	}
+	const auto pos = file_name.find_last_of("/\\");
+	if(pos == std::string::npos) {
+		return std::string();
+	}
+	return file_name.substr(0, pos + 1);
+}
+
+static void update(const std::string& file_name, int64_t num_bytes)
+{
+	auto& dir = g_dirs[get_usage_dir(file_name)];
+	dir.current += num_bytes;
+	dir.peak = std::max(dir.peak, dir.current);
+	dir.total_peak = std::max(dir.total_peak, dir.current);
+}
+
+void disk_usage_add(const std::string& file_name, int64_t num_bytes)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	g_files[file_name] += num_bytes;
+	update(file_name, num_bytes);
+}
+
+void disk_usage_remove(const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	auto iter = g_files.find(file_name);
+	if(iter != g_files.end()) {
+		update(file_name, -iter->second);
+		g_files.erase(iter);
+	}
+}
+
+void print_disk_usage(const std::string& prefix, bool total)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	std::cout << (prefix.empty() ? prefix : prefix + " ") << (total ? "Total peak" : "Peak") << " disk usage:";
+	for(auto& entry : g_dirs) {
+		auto& dir = entry.second;
+		std::cout << " " << (entry.first.empty() ? "$PWD" : entry.first) << " = "
+				<< (total ? dir.total_peak : dir.peak) / double(1 << 30) << " GiB";
+		if(!total) {
+			dir.peak = dir.current;
+		}
+	}
+	std::cout << std::endl;
+}
@@ -0,0 +1,267 @@
+/*
+ * io_stats.cpp
+ *
+ *  Created on: Jun 11, 2021
+ *      Author: mad
+ */
+
+#include <chia/io_stats.h>
+#include <chia/disk_usage.h>
+#include <chia/trace.h>
+#include <chia/json.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+
+struct io_counter_t {
+	uint64_t num_bytes = 0;
+	uint64_t num_ops = 0;
+	uint64_t num_timed = 0;			// ops with latency
+	uint64_t time_us = 0;			// sum of latency
+	uint64_t histogram[32] = {};	// latency, bucket i = [2^(i-1), 2^i) usec
+	
+	void add(uint64_t bytes, int64_t time) {
+		num_bytes += bytes;
+		num_ops++;
+		if(time >= 0) {
+			int i = 0;
+			while(i < 31 && (uint64_t(1) << i) <= uint64_t(time)) {
+				i++;
+			}
+			histogram[i]++;
+			num_timed++;
+			time_us += time;
+		}
+	}
+	
+	// returns upper bound in usec
+	uint64_t percentile(double p) const {
+		uint64_t sum = 0;
+		for(int i = 0; i < 32; ++i) {
+			sum += histogram[i];
+			if(sum && sum >= p * num_timed) {
+				return uint64_t(1) << i;
+			}
+		}
+		return 0;
+	}
+};
+
+struct io_entry_t {
+	io_counter_t read;
+	io_counter_t write;
+};
+
+struct section_t {
+	std::string name;
+	int64_t begin = 0;
+	int64_t end = 0;
+	std::map<std::string, io_entry_t> dirs;
+	std::map<std::string, io_entry_t> files;
+};
+
+static std::mutex g_mutex;
+static std::vector<section_t> g_sections;
+static std::unordered_map<FILE*, std::string> g_streams;
+
+
+// groups all buckets of a DiskSort into one file entry
+static std::string get_file_group(const std::string& file_name)
+{
+	const std::string key = ".sort_bucket_";
+	const auto pos = file_name.rfind(key);
+	if(pos == std::string::npos) {
+		return file_name;
+	}
+	auto end = pos + key.size();
+	while(end < file_name.size() && isdigit(file_name[end])) {
+		end++;
+	}
+	return file_name.substr(0, pos + key.size()) + "*" + file_name.substr(end);
+}
+
+static std::string get_device(const std::string& dir)
+{
+	if(dir == "ram:") {
+		return "ram";
+	}
+	struct stat info = {};
+	if(::stat(dir.empty() ? "." : dir.c_str(), &info) == 0) {
+		return std::to_string(major(info.st_dev)) + ":" + std::to_string(minor(info.st_dev));
+	}
+	return "unknown";
+}
+
+static section_t& get_section()
+{
+	if(g_sections.empty()) {
+		g_sections.emplace_back();
+		g_sections.back().begin = get_time_micros();
+	}
+	return g_sections.back();
+}
+
+void io_stats_add(const std::string& file_name, bool is_write, uint64_t num_bytes, int64_t time_us)
+{
+	if(time_us >= 0 && is_trace_enabled()) {
+		const auto now = get_time_micros();
+		trace_add(is_write ? TRACE_WRITE : TRACE_READ, now - time_us, now, num_bytes);
+	}
+	std::lock_guard<std::mutex> lock(g_mutex);
+	auto& section = get_section();
+	auto& dir = section.dirs[get_usage_dir(file_name)];
+	auto& file = section.files[get_file_group(file_name)];
+	(is_write ? dir.write : dir.read).add(num_bytes, time_us);
+	(is_write ? file.write : file.read).add(num_bytes, time_us);
+}
+
+void io_stats_add(FILE* file, bool is_write, uint64_t num_bytes, int64_t time_us)
+{
+	std::string file_name;
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		auto iter = g_streams.find(file);
+		if(iter == g_streams.end()) {
+			return;
+		}
+		file_name = iter->second;
+	}
+	io_stats_add(file_name, is_write, num_bytes, time_us);
+}
+
+void io_stats_open(FILE* file, const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	g_streams[file] = file_name;
+}
+
+void io_stats_close(FILE* file)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	g_streams.erase(file);
+}
+
+void io_stats_begin(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	const auto now = get_time_micros();
+	if(!g_sections.empty() && !g_sections.back().end) {
+		g_sections.back().end = now;
+	}
+	g_sections.emplace_back();
+	g_sections.back().name = name;
+	g_sections.back().begin = now;
+}
+
+void get_io_stats(const std::string& name, uint64_t& num_read, uint64_t& num_write)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	num_read = 0;
+	num_write = 0;
+	for(auto iter = g_sections.rbegin(); iter != g_sections.rend(); ++iter) {
+		if(iter->name == name) {
+			for(const auto& entry : iter->dirs) {
+				num_read += entry.second.read.num_bytes;
+				num_write += entry.second.write.num_bytes;
+			}
+			break;
+		}
+	}
+}
+
+static void print_counter(const char* name, const io_counter_t& counter, double elapsed)
+{
+	std::cout << name << " " << counter.num_bytes / double(1 << 30) << " GiB at "
+			<< counter.num_bytes / elapsed / 1e6 << " MB/s (" << counter.num_ops << " ops";
+	if(counter.num_timed) {
+		std::cout << ", p50 " << counter.percentile(0.5) / 1e3 << " ms, p99 "
+				<< counter.percentile(0.99) / 1e3 << " ms";
+	}
+	std::cout << ")";
+}
+
+void print_io_stats(const std::string& prefix)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	auto& section = get_section();
+	section.end = get_time_micros();
+	const double elapsed = std::max<int64_t>(section.end - section.begin, 1) / 1e6;
+	
+	for(const auto& entry : section.dirs) {
+		std::cout << (prefix.empty() ? prefix : prefix + " ") << "I/O "
+				<< (entry.first.empty() ? "$PWD" : entry.first) << " (" << get_device(entry.first) << "): ";
+		print_counter("read", entry.second.read, elapsed);
+		std::cout << ", ";
+		print_counter("write", entry.second.write, elapsed);
+		std::cout << std::endl;
+	}
+}
+
+static void write_counter(std::ostream& out, const io_counter_t& counter, double elapsed)
+{
+	out << "{\"bytes\": " << counter.num_bytes << ", \"ops\": " << counter.num_ops
+		<< ", \"timed_ops\": " << counter.num_timed << ", \"time_us\": " << counter.time_us
+		<< ", \"mb_per_sec\": " << counter.num_bytes / elapsed / 1e6
+		<< ", \"latency_p50_us\": " << counter.percentile(0.5)
+		<< ", \"latency_p99_us\": " << counter.percentile(0.99)
+		<< ", \"latency_histogram_log2_us\": [";
+	for(int i = 0; i < 32; ++i) {
+		out << (i ? ", " : "") << counter.histogram[i];
+	}
+	out << "]}";
+}
+
+static void write_entries(	std::ostream& out, const std::map<std::string, io_entry_t>& entries,
+							const std::string& key, double elapsed, bool is_dir)
+{
+	out << "[";
+	bool first = true;
+	for(const auto& entry : entries) {
+		out << (first ? "" : ",") << "\n      {" << json_string(key) << ": " << json_string(entry.first);
+		if(is_dir) {
+			out << ", \"device\": " << json_string(get_device(entry.first));
+		}
+		out << ",\n        \"read\": ";
+		write_counter(out, entry.second.read, elapsed);
+		out << ",\n        \"write\": ";
+		write_counter(out, entry.second.write, elapsed);
+		out << "}";
+		first = false;
+	}
+	out << "]";
+}
+
+void write_io_stats(const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	std::ofstream out(file_name);
+	if(!out) {
+		throw std::runtime_error("failed to open " + file_name);
+	}
+	const auto now = get_time_micros();
+	out << "{\"sections\": [";
+	for(size_t i = 0; i < g_sections.size(); ++i) {
+		const auto& section = g_sections[i];
+		const double elapsed = std::max<int64_t>((section.end ? section.end : now) - section.begin, 1) / 1e6;
+		out << (i ? "," : "") << "\n  {\"name\": " << json_string(section.name) << ", \"time_sec\": " << elapsed;
+		out << ",\n    \"dirs\": ";
+		write_entries(out, section.dirs, "dir", elapsed, true);
+		out << ",\n    \"files\": ";
+		write_entries(out, section.files, "file", elapsed, false);
+		out << "}";
+	}
+	out << "\n]}" << std::endl;
+}
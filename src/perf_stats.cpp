@@ -0,0 +1,124 @@
+/*
+ * perf_stats.cpp
+ *
+ *  Created on: Jun 20, 2021
+ *      Author: mad
+ */
+
+#include <chia/perf_stats.h>
+#include <chia/io_stats.h>
+
+#include <iostream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_NUM_COUNTERS
+};
+
+static int g_fd[PERF_NUM_COUNTERS] = {-1, -1, -1, -1, -1};
+static bool g_is_init = false;
+
+#ifdef __linux__
+static int open_counter(uint32_t type, uint64_t config)
+{
+	perf_event_attr attr = {};
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// returns value scaled by time enabled / running, in case counters were multiplexed
+static uint64_t read_counter(int fd)
+{
+	uint64_t data[3] = {};		// value, time enabled, time running
+	if(fd < 0 || ::read(fd, data, sizeof(data)) != sizeof(data) || !data[2]) {
+		return 0;
+	}
+	return data[0] * (double(data[1]) / data[2]);
+}
+#endif
+
+bool perf_stats_init()
+{
+#ifdef __linux__
+	if(g_is_init) {
+		return true;
+	}
+	g_fd[PERF_CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	g_fd[PERF_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	g_fd[PERF_LLC_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	g_fd[PERF_DTLB_MISSES] = open_counter(PERF_TYPE_HW_CACHE,
+			PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	g_fd[PERF_BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	
+	// need at least cycles and instructions, others are optional (not all CPUs / VMs have them)
+	g_is_init = g_fd[PERF_CYCLES] >= 0 && g_fd[PERF_INSTRUCTIONS] >= 0;
+	if(!g_is_init) {
+		for(auto& fd : g_fd) {
+			if(fd >= 0) {
+				::close(fd);
+			}
+			fd = -1;
+		}
+	}
+#endif
+	return g_is_init;
+}
+
+perf_stats_t get_perf_stats()
+{
+	perf_stats_t out;
+#ifdef __linux__
+	if(g_is_init) {
+		out.time_us = get_time_micros();
+		out.cycles = read_counter(g_fd[PERF_CYCLES]);
+		out.instructions = read_counter(g_fd[PERF_INSTRUCTIONS]);
+		out.llc_misses = read_counter(g_fd[PERF_LLC_MISSES]);
+		out.dtlb_misses = read_counter(g_fd[PERF_DTLB_MISSES]);
+		out.branch_misses = read_counter(g_fd[PERF_BRANCH_MISSES]);
+	}
+#endif
+	return out;
+}
+
+void print_perf_stats(const std::string& prefix, const perf_stats_t& begin)
+{
+	if(!g_is_init) {
+		return;
+	}
+	const auto end = get_perf_stats();
+	const double elapsed = (end.time_us - begin.time_us) / 1e6;
+	const double cycles = end.cycles - begin.cycles;
+	const double instructions = end.instructions - begin.instructions;
+	const double llc_misses = end.llc_misses - begin.llc_misses;
+	const double kilo_instr = std::max(instructions / 1e3, 1.);
+	
+	std::cout << prefix << " perf: IPC " << (cycles > 0 ? instructions / cycles : 0)
+		<< ", " << cycles / 1e9 << " G cycles"
+		<< ", LLC " << llc_misses / kilo_instr << " MPKI"
+		<< " (" << (elapsed > 0 ? llc_misses * 64 / elapsed / 1e9 : 0) << " GB/s)";
+	if(g_fd[PERF_DTLB_MISSES] >= 0) {
+		std::cout << ", dTLB " << (end.dtlb_misses - begin.dtlb_misses) / kilo_instr << " MPKI";
+	}
+	if(g_fd[PERF_BRANCH_MISSES] >= 0) {
+		std::cout << ", branch " << (end.branch_misses - begin.branch_misses) / kilo_instr << " MPKI";
+	}
+	std::cout << std::endl;
+}
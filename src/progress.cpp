@@ -0,0 +1,247 @@
+/*
+ * progress.cpp
+ *
+ *  Created on: Jun 19, 2021
+ *      Author: mad
+ */
+
+#include <chia/progress.h>
+#include <chia/io_stats.h>
+#include <chia/json.h>
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <condition_variable>
+
+#include <time.h>
+#include <stdio.h>
+
+
+struct progress_step_t {
+	std::string phase;
+	int table = 0;
+	uint64_t num_expected = 0;
+	uint64_t num_entries = 0;
+	uint64_t num_buckets = 0;
+	uint64_t num_parks = 0;
+	int64_t begin = 0;
+	int64_t end = 0;				// 0 = running
+};
+
+static std::mutex g_mutex;
+static std::vector<progress_step_t> g_steps;
+static std::atomic<uint64_t> g_num_entries {0};
+static std::atomic<uint64_t> g_num_buckets {0};
+static std::atomic<uint64_t> g_num_parks {0};
+
+static std::thread g_thread;
+static bool g_do_run = false;
+static std::condition_variable g_signal;
+static std::string g_file_name;
+static std::string g_plot_name;
+static int64_t g_time_begin = 0;
+static int64_t g_wall_begin = 0;
+
+/*
+ * Phase weights, from the reference run in README.md [sec].
+ * P2 is scan + rewrite, P3 is stage 1 + stage 2.
+ */
+static const std::map<std::pair<std::string, int>, double> g_weights = {
+	{{"P1", 1}, 21.0}, {{"P1", 2}, 152.6}, {{"P1", 3}, 181.2}, {{"P1", 4}, 223.3},
+	{{"P1", 5}, 232.1}, {{"P1", 6}, 221.5}, {{"P1", 7}, 182.6},
+	{{"P2", 7}, 61.7}, {{"P2", 6}, 128.7}, {{"P2", 5}, 124.6}, {{"P2", 4}, 128.2},
+	{{"P2", 3}, 129.0}, {{"P2", 2}, 122.7},
+	{{"P3", 2}, 151.2}, {{"P3", 3}, 151.0}, {{"P3", 4}, 209.9}, {{"P3", 5}, 204.8},
+	{{"P3", 6}, 216.7}, {{"P3", 7}, 163.1},
+	{{"P4", 7}, 89.1}
+};
+
+static double get_weight(const std::string& phase, int table)
+{
+	const auto iter = g_weights.find(std::make_pair(phase, table));
+	return iter != g_weights.end() ? iter->second : 0;
+}
+
+// copies atomic counters into current step, needs g_mutex
+static void update_current()
+{
+	if(!g_steps.empty() && !g_steps.back().end) {
+		auto& step = g_steps.back();
+		step.num_entries = g_num_entries;
+		step.num_buckets = g_num_buckets;
+		step.num_parks = g_num_parks;
+	}
+}
+
+// needs g_mutex
+static void finish_current(const int64_t now)
+{
+	update_current();
+	if(!g_steps.empty() && !g_steps.back().end) {
+		g_steps.back().end = now;
+	}
+}
+
+void progress_begin(const std::string& phase, int table, uint64_t num_entries)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	const auto now = get_time_micros();
+	finish_current(now);
+	if(!g_time_begin) {
+		g_time_begin = now;
+	}
+	progress_step_t step;
+	step.phase = phase;
+	step.table = table;
+	step.num_expected = num_entries;
+	step.begin = now;
+	g_steps.push_back(step);
+	g_num_entries = 0;
+	g_num_buckets = 0;
+	g_num_parks = 0;
+}
+
+void progress_end()
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	finish_current(get_time_micros());
+}
+
+void progress_add_entries(uint64_t count) {
+	g_num_entries += count;
+}
+
+void progress_add_buckets(uint64_t count) {
+	g_num_buckets += count;
+}
+
+void progress_add_parks(uint64_t count) {
+	g_num_parks += count;
+}
+
+// needs g_mutex
+static double get_progress_ex(const int64_t now, double* eta_sec)
+{
+	update_current();
+	
+	double total = 0;
+	for(const auto& entry : g_weights) {
+		total += entry.second;
+	}
+	double done = 0;
+	bool is_end = false;
+	for(const auto& step : g_steps) {
+		const double weight = get_weight(step.phase, step.table);
+		if(step.end) {
+			done += weight;
+		} else if(step.num_expected) {
+			done += weight * std::min(double(step.num_entries) / step.num_expected, 1.);
+		}
+		is_end = step.end && step.phase == "P4";
+	}
+	const double progress = is_end ? 1 : std::min(done / total, 1.);
+	if(eta_sec) {
+		*eta_sec = -1;
+		if(is_end) {
+			*eta_sec = 0;
+		} else if(progress > 0 && g_time_begin) {
+			// measured speed relative to reference run
+			const double elapsed = (now - g_time_begin) / 1e6;
+			*eta_sec = elapsed * (1 - progress) / progress;
+		}
+	}
+	return progress;
+}
+
+double get_progress(double* eta_sec)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	return get_progress_ex(get_time_micros(), eta_sec);
+}
+
+void write_progress(const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	const auto now = get_time_micros();
+	const auto wall_now = ::time(nullptr);
+	
+	double eta_sec = -1;
+	const double progress = get_progress_ex(now, &eta_sec);
+	const double elapsed = g_time_begin ? (now - g_time_begin) / 1e6 : 0;
+	
+	const std::string tmp_name = file_name + ".tmp";
+	{
+		std::ofstream out(tmp_name);
+		if(!out) {
+			throw std::runtime_error("failed to open " + tmp_name);
+		}
+		out << "{\"plot_name\": " << json_string(g_plot_name);
+		if(!g_steps.empty()) {
+			const auto& step = g_steps.back();
+			out << ", \"phase\": " << json_string(step.phase) << ", \"table\": " << step.table;
+		}
+		out << ", \"progress\": " << progress << ", \"elapsed_sec\": " << elapsed
+			<< ", \"eta_sec\": " << eta_sec << ", \"start_time\": " << g_wall_begin
+			<< ", \"update_time\": " << wall_now
+			<< ", \"finish_time\": " << (eta_sec >= 0 ? wall_now + int64_t(eta_sec) : -1)
+			<< ",\n \"steps\": [";
+		for(size_t i = 0; i < g_steps.size(); ++i) {
+			const auto& step = g_steps[i];
+			out << (i ? "," : "") << "\n  {\"phase\": " << json_string(step.phase) << ", \"table\": " << step.table
+				<< ", \"entries\": " << step.num_entries << ", \"expected\": " << step.num_expected
+				<< ", \"buckets\": " << step.num_buckets << ", \"parks\": " << step.num_parks
+				<< ", \"time_sec\": " << ((step.end ? step.end : now) - step.begin) / 1e6
+				<< ", \"done\": " << (step.end ? "true" : "false") << "}";
+		}
+		out << "\n]}" << std::endl;
+	}
+	if(::rename(tmp_name.c_str(), file_name.c_str())) {
+		throw std::runtime_error("rename() failed for " + file_name);
+	}
+}
+
+void progress_start(const std::string& file_name, const std::string& plot_name, double interval_sec)
+{
+	progress_stop();
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		g_do_run = true;
+		g_file_name = file_name;
+		g_plot_name = plot_name;
+		g_wall_begin = ::time(nullptr);
+	}
+	const auto interval = std::chrono::microseconds(int64_t(interval_sec * 1e6));
+	g_thread = std::thread([interval]() {
+		std::unique_lock<std::mutex> lock(g_mutex);
+		while(g_do_run) {
+			g_signal.wait_for(lock, interval);
+			lock.unlock();
+			try {
+				write_progress(g_file_name);
+			} catch(...) {
+				// ignore, try again later
+			}
+			lock.lock();
+		}
+	});
+}
+
+void progress_stop()
+{
+	if(!g_thread.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		g_do_run = false;
+	}
+	g_signal.notify_all();
+	g_thread.join();
+	write_progress(g_file_name);
+}
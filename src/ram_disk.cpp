@@ -0,0 +1,348 @@
+/*
+ * ram_disk.cpp
+ *
+ *  Created on: Jun 10, 2021
+ *      Author: mad
+ */
+
+#include <chia/ram_disk.h>
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <shared_mutex>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <cerrno>
+
+
+static const uint64_t g_page_size = 4096;
+static const uint64_t g_huge_page_size = 2 << 20;
+
+/*
+ * map_mutex guards the mapping (data, capacity): shared while copying, unique while remapping.
+ * mutex guards size and num_bytes, it is never held during a copy.
+ * Lock order is map_mutex before mutex.
+ */
+struct ram_file_t {
+	std::shared_mutex map_mutex;
+	std::mutex mutex;
+	uint8_t* data = nullptr;
+	uint64_t size = 0;			// file size
+	uint64_t capacity = 0;		// mapping size, never shrinks
+	uint64_t num_bytes = 0;		// bytes in use, ie. size minus punched
+	
+	~ram_file_t() {
+		if(data) {
+			munmap(data, capacity);
+		}
+	}
+	
+	// needs unique lock on map_mutex
+	bool reserve(uint64_t new_size)
+	{
+		if(new_size <= capacity) {
+			return true;
+		}
+		uint64_t new_capacity = std::max(std::max(new_size, capacity * 2), g_huge_page_size);
+		new_capacity = ((new_capacity + g_huge_page_size - 1) / g_huge_page_size) * g_huge_page_size;
+		
+		void* ptr = nullptr;
+		if(data) {
+			ptr = mremap(data, capacity, new_capacity, MREMAP_MAYMOVE);
+		} else {
+			ptr = mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		}
+		if(ptr == MAP_FAILED) {
+			return false;
+		}
+		madvise(ptr, new_capacity, MADV_HUGEPAGE);
+		data = (uint8_t*)ptr;
+		capacity = new_capacity;
+		return true;
+	}
+};
+
+struct ram_stream_t {
+	std::shared_ptr<ram_file_t> file;
+	uint64_t offset = 0;
+	FILE* stream = nullptr;
+};
+
+static std::mutex g_mutex;
+static uint64_t g_capacity = 0;
+static std::atomic<uint64_t> g_used {0};
+static std::map<std::string, std::shared_ptr<ram_file_t>> g_files;
+static std::unordered_map<FILE*, std::shared_ptr<ram_file_t>> g_streams;
+
+
+static ssize_t stream_read(void* cookie, char* buf, size_t size)
+{
+	auto handle = (ram_stream_t*)cookie;
+	auto& file = *handle->file;
+	std::shared_lock<std::shared_mutex> map_lock(file.map_mutex);
+	size_t count = 0;
+	{
+		std::lock_guard<std::mutex> lock(file.mutex);
+		if(handle->offset >= file.size) {
+			return 0;
+		}
+		count = std::min<uint64_t>(size, file.size - handle->offset);
+	}
+	::memcpy(buf, file.data + handle->offset, count);
+	handle->offset += count;
+	return count;
+}
+
+static ssize_t write_at(ram_file_t& file, uint64_t offset, const void* buf, size_t size)
+{
+	const uint64_t end = offset + size;
+	std::shared_lock<std::shared_mutex> map_lock(file.map_mutex);
+	if(end > file.capacity) {
+		map_lock.unlock();
+		{
+			std::unique_lock<std::shared_mutex> lock(file.map_mutex);
+			if(!file.reserve(end)) {
+				errno = ENOMEM;
+				return -1;
+			}
+		}
+		map_lock.lock();	// capacity cannot shrink in between
+	}
+	{
+		std::lock_guard<std::mutex> lock(file.mutex);
+		if(end > file.size) {
+			const uint64_t num_bytes = end - file.size;
+			if(g_used.fetch_add(num_bytes) + num_bytes > g_capacity) {
+				g_used -= num_bytes;
+				errno = ENOSPC;
+				return -1;
+			}
+			file.num_bytes += num_bytes;
+			file.size = end;
+		}
+	}
+	::memcpy(file.data + offset, buf, size);
+	return size;
+}
+
+static ssize_t stream_write(void* cookie, const char* buf, size_t size)
+{
+	auto handle = (ram_stream_t*)cookie;
+	const auto res = write_at(*handle->file, handle->offset, buf, size);
+	if(res > 0) {
+		handle->offset += res;
+	}
+	return res;
+}
+
+static int stream_seek(void* cookie, off64_t* offset, int whence)
+{
+	auto handle = (ram_stream_t*)cookie;
+	int64_t base = 0;
+	switch(whence) {
+		case SEEK_SET: break;
+		case SEEK_CUR: base = handle->offset; break;
+		case SEEK_END: {
+			std::lock_guard<std::mutex> lock(handle->file->mutex);
+			base = handle->file->size;
+			break;
+		}
+		default: return -1;
+	}
+	if(base + *offset < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	handle->offset = base + *offset;
+	*offset = handle->offset;
+	return 0;
+}
+
+static int stream_close(void* cookie)
+{
+	auto handle = (ram_stream_t*)cookie;
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		g_streams.erase(handle->stream);
+	}
+	delete handle;
+	return 0;
+}
+
+void ram_disk_init(uint64_t capacity)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	g_capacity = capacity;
+}
+
+FILE* ram_fopen(const std::string& file_name, const char* mode)
+{
+	const bool is_read = mode[0] == 'r';
+	const bool is_write = !is_read || ::strchr(mode, '+');
+	if(!is_read && mode[0] != 'w') {
+		throw std::logic_error("ram_fopen(): unsupported mode");
+	}
+	auto handle = new ram_stream_t();
+	
+	std::lock_guard<std::mutex> lock(g_mutex);
+	auto iter = g_files.find(file_name);
+	if(is_read) {
+		if(iter == g_files.end()) {
+			delete handle;
+			errno = ENOENT;
+			return nullptr;
+		}
+		handle->file = iter->second;
+	} else {
+		if(iter != g_files.end()) {
+			// truncate, existing streams keep the old data
+			std::lock_guard<std::mutex> lock(iter->second->mutex);
+			g_used -= iter->second->num_bytes;
+			iter->second->num_bytes = 0;
+		}
+		handle->file = std::make_shared<ram_file_t>();
+		g_files[file_name] = handle->file;
+	}
+	cookie_io_functions_t funcs = {};
+	funcs.read = &stream_read;
+	funcs.write = is_write ? &stream_write : nullptr;
+	funcs.seek = &stream_seek;
+	funcs.close = &stream_close;
+	
+	FILE* stream = fopencookie(handle, mode, funcs);
+	if(!stream) {
+		delete handle;
+		return nullptr;
+	}
+	setvbuf(stream, nullptr, _IONBF, 0);
+	handle->stream = stream;
+	g_streams[stream] = handle->file;
+	return stream;
+}
+
+const uint8_t* ram_data(const std::string& file_name, uint64_t& size)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	auto iter = g_files.find(file_name);
+	if(iter == g_files.end()) {
+		return nullptr;
+	}
+	auto& file = *iter->second;
+	std::shared_lock<std::shared_mutex> map_lock(file.map_mutex);
+	std::lock_guard<std::mutex> lock_file(file.mutex);
+	size = file.size;
+	return file.data;
+}
+
+int64_t ram_file_size(const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	auto iter = g_files.find(file_name);
+	if(iter == g_files.end()) {
+		return -1;
+	}
+	std::lock_guard<std::mutex> lock_file(iter->second->mutex);
+	return iter->second->size;
+}
+
+bool ram_punch(FILE* stream, uint64_t offset, uint64_t length)
+{
+	std::shared_ptr<ram_file_t> file;
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		auto iter = g_streams.find(stream);
+		if(iter == g_streams.end()) {
+			return false;
+		}
+		file = iter->second;
+	}
+	std::shared_lock<std::shared_mutex> map_lock(file->map_mutex);
+	std::unique_lock<std::mutex> lock(file->mutex);
+	const uint64_t end = std::min(offset + length, file->size);
+	if(offset >= end) {
+		return true;
+	}
+	// only whole pages can be released
+	const uint64_t begin_page = ((offset + g_page_size - 1) / g_page_size) * g_page_size;
+	const uint64_t end_page = (end / g_page_size) * g_page_size;
+	if(end_page <= begin_page) {
+		return true;
+	}
+	// partial pages stay resident, so they are still counted as used
+	const uint64_t num_bytes = std::min(end_page - begin_page, file->num_bytes);
+	file->num_bytes -= num_bytes;
+	g_used -= num_bytes;
+	lock.unlock();
+	
+	madvise(file->data + begin_page, end_page - begin_page, MADV_DONTNEED);
+	return true;
+}
+
+bool ram_pwrite(FILE* stream, uint64_t offset, const void* buf, uint64_t length)
+{
+	std::shared_ptr<ram_file_t> file;
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		auto iter = g_streams.find(stream);
+		if(iter == g_streams.end()) {
+			return false;
+		}
+		file = iter->second;
+	}
+	if(write_at(*file, offset, buf, length) < 0) {
+		throw std::runtime_error("ram_pwrite() failed with: " + std::string(std::strerror(errno)));
+	}
+	return true;
+}
+
+void ram_remove(const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	auto iter = g_files.find(file_name);
+	if(iter != g_files.end()) {
+		{
+			std::lock_guard<std::mutex> lock(iter->second->mutex);
+			g_used -= iter->second->num_bytes;
+			iter->second->num_bytes = 0;
+		}
+		g_files.erase(iter);
+	}
+}
+
+#else
+
+void ram_disk_init(uint64_t capacity) {
+	throw std::runtime_error("RAM disk not supported on this platform");
+}
+
+FILE* ram_fopen(const std::string& file_name, const char* mode) {
+	return nullptr;
+}
+
+const uint8_t* ram_data(const std::string& file_name, uint64_t& size) {
+	return nullptr;
+}
+
+int64_t ram_file_size(const std::string& file_name) {
+	return -1;
+}
+
+bool ram_punch(FILE* file, uint64_t offset, uint64_t length) {
+	return false;
+}
+
+bool ram_pwrite(FILE* file, uint64_t offset, const void* buf, uint64_t length) {
+	return false;
+}
+
+void ram_remove(const std::string& file_name) {}
+
+#endif
@@ -11,3 +11,9 @@
 size_t g_read_chunk_size = 65536;
 size_t g_write_chunk_size = 4096;
 
+bool g_preallocate = false;
+bool g_use_mmap = false;
+bool g_verify_tmp = false;
+
+int g_max_log_num_files = 8;
+
@@ -0,0 +1,140 @@
+/*
+ * trace.cpp
+ *
+ *  Created on: Jun 20, 2021
+ *      Author: mad
+ */
+
+#include <chia/trace.h>
+#include <chia/json.h>
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+
+struct trace_event_t {
+	int64_t begin = 0;
+	int64_t duration = 0;
+	uint64_t arg = 0;
+	uint32_t name = 0;
+};
+
+struct trace_buffer_t {
+	uint32_t tid = 0;
+	std::string thread_name;
+	uint64_t num_events = 0;			// total, including overwritten
+	std::vector<trace_event_t> events;	// ring buffer, grows up to g_max_events
+};
+
+std::atomic<bool> g_trace_enabled {false};
+
+static std::mutex g_mutex;
+static size_t g_max_events = 0;
+static std::vector<std::string> g_names = {"read", "write", "wait", "output"};
+static std::unordered_map<std::string, uint32_t> g_name_map;
+static std::vector<std::shared_ptr<trace_buffer_t>> g_buffers;
+
+// buffers outlive their threads, since most pipeline threads exit before the trace is written
+static thread_local std::shared_ptr<trace_buffer_t> g_local;
+
+static trace_buffer_t& get_local_buffer()
+{
+	if(!g_local) {
+		std::lock_guard<std::mutex> lock(g_mutex);
+		g_local = std::make_shared<trace_buffer_t>();
+		g_local->tid = g_buffers.size() + 1;
+		g_local->thread_name = g_local->tid == 1 ? "main" : "thread-" + std::to_string(g_local->tid);
+		g_buffers.push_back(g_local);
+	}
+	return *g_local;
+}
+
+void trace_start(size_t max_events)
+{
+	if(max_events < 1) {
+		throw std::logic_error("max_events < 1");
+	}
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		g_max_events = max_events;
+	}
+	get_local_buffer();		// calling thread is "main"
+	g_trace_enabled = true;
+}
+
+uint32_t trace_thread_begin(const std::string& thread_name)
+{
+	auto& buffer = get_local_buffer();
+	auto name = thread_name;
+	const auto pos = name.find_last_of('/');
+	if(pos != std::string::npos && pos + 1 < name.size()
+		&& name.find_first_not_of("0123456789", pos + 1) == std::string::npos)
+	{
+		name.resize(pos);
+	}
+	std::lock_guard<std::mutex> lock(g_mutex);
+	buffer.thread_name = thread_name;
+	
+	auto iter = g_name_map.find(name);
+	if(iter == g_name_map.end()) {
+		iter = g_name_map.emplace(name, g_names.size()).first;
+		g_names.push_back(name);
+	}
+	return iter->second;
+}
+
+void trace_add(uint32_t name, int64_t begin_us, int64_t end_us, uint64_t arg)
+{
+	auto& buffer = get_local_buffer();
+	trace_event_t event;
+	event.begin = begin_us;
+	event.duration = end_us - begin_us;
+	event.arg = arg;
+	event.name = name;
+	if(buffer.events.size() < g_max_events) {
+		buffer.events.push_back(event);
+	} else {
+		buffer.events[buffer.num_events % buffer.events.size()] = event;
+	}
+	buffer.num_events++;
+}
+
+void write_trace(const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	
+	std::ofstream out(file_name);
+	if(!out) {
+		throw std::runtime_error("failed to open " + file_name);
+	}
+	int64_t time_begin = 0;
+	for(const auto& buffer : g_buffers) {
+		for(const auto& event : buffer->events) {
+			if(!time_begin || event.begin < time_begin) {
+				time_begin = event.begin;
+			}
+		}
+	}
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	bool is_first = true;
+	for(const auto& buffer : g_buffers)
+	{
+		out << (is_first ? "" : ",") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+			<< ", \"args\": {\"name\": " << json_string(buffer->thread_name) << "}}";
+		is_first = false;
+		
+		for(const auto& event : buffer->events) {
+			out << ",\n{\"name\": " << json_string(g_names[event.name]) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+				<< ", \"ts\": " << event.begin - time_begin << ", \"dur\": " << event.duration;
+			if(event.name == TRACE_READ || event.name == TRACE_WRITE) {
+				out << ", \"args\": {\"bytes\": " << event.arg << "}";
+			}
+			out << "}";
+		}
+	}
+	out << "\n]}" << std::endl;
+}
@@ -0,0 +1,164 @@
+/*
+ * bench.h
+ *
+ *  Created on: Jun 14, 2021
+ *      Author: mad
+ */
+
+#ifndef TEST_BENCH_H_
+#define TEST_BENCH_H_
+
+#include <chia/util.hpp>
+
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+
+/*
+ * Minimal benchmark harness, results are printed as JSON to stdout, progress to stderr.
+ *
+ * Usage: bench_xxx [num_reps] [num_warmup] [filter]
+ */
+class Benchmark {
+public:
+	struct result_t {
+		std::string unit;				// what is counted, like "blocks"
+		double num_ops = 0;				// per repetition
+		double num_bytes = 0;			// per repetition, 0 = not applicable
+		std::vector<int64_t> times;		// usec per repetition
+	};
+	
+	int num_reps = 10;
+	int num_warmup = 2;
+	std::string filter;
+	
+	Benchmark(int argc, char** argv)
+	{
+		if(argc > 1) {
+			num_reps = std::max(atoi(argv[1]), 1);
+		}
+		if(argc > 2) {
+			num_warmup = std::max(atoi(argv[2]), 0);
+		}
+		if(argc > 3) {
+			filter = argv[3];
+		}
+	}
+	
+	// returns true if benchmark should run
+	bool enabled(const std::string& name) const {
+		return filter.empty() || name.find(filter) != std::string::npos;
+	}
+	
+	// records one repetition
+	void add(const std::string& name, const std::string& unit, double num_ops, double num_bytes, int64_t time_us)
+	{
+		auto& result = results[name];
+		result.unit = unit;
+		result.num_ops = num_ops;
+		result.num_bytes = num_bytes;
+		result.times.push_back(std::max<int64_t>(time_us, 1));
+	}
+	
+	/*
+	 * Calls setup() and func() num_warmup + num_reps times, only func() is timed.
+	 */
+	template<typename S, typename F>
+	void run(const std::string& name, const std::string& unit, double num_ops, double num_bytes,
+			const S& setup, const F& func)
+	{
+		if(!enabled(name)) {
+			return;
+		}
+		for(int i = 0; i < num_warmup + num_reps; ++i) {
+			setup();
+			const auto time_begin = get_wall_time_micros();
+			func();
+			const auto time = get_wall_time_micros() - time_begin;
+			if(i >= num_warmup) {
+				add(name, unit, num_ops, num_bytes, time);
+			}
+		}
+		print(name);
+	}
+	
+	template<typename F>
+	void run(const std::string& name, const std::string& unit, double num_ops, const F& func)
+	{
+		run(name, unit, num_ops, 0, []() {}, func);
+	}
+	
+	// prints summary of one benchmark to stderr
+	void print(const std::string& name) const
+	{
+		const auto& result = results.at(name);
+		const auto times = sorted(result.times);
+		std::cerr << name << ": " << rate(result.num_ops, percentile(times, 0.5)) << " " << result.unit << "/s";
+		if(result.num_bytes) {
+			std::cerr << ", " << rate(result.num_bytes, percentile(times, 0.5)) / 1e9 << " GB/s";
+		}
+		std::cerr << " (p50 " << percentile(times, 0.5) / 1e3 << " ms, p90 "
+				<< percentile(times, 0.9) / 1e3 << " ms)" << std::endl;
+	}
+	
+	void print_json(const std::string& suite) const
+	{
+		std::cout << "{\"suite\": \"" << suite << "\", \"reps\": " << num_reps
+				<< ", \"warmup\": " << num_warmup << ", \"results\": [";
+		bool first = true;
+		for(const auto& entry : results) {
+			const auto& result = entry.second;
+			const auto times = sorted(result.times);
+			std::cout << (first ? "" : ",") << "\n  {\"name\": \"" << entry.first << "\", \"unit\": \"" << result.unit
+					<< "\", \"ops\": " << result.num_ops << ", \"bytes\": " << result.num_bytes;
+			for(const auto p : {0., 0.1, 0.5, 0.9, 0.99, 1.}) {
+				const auto time = percentile(times, p);
+				const auto suffix = std::to_string(int(p * 100));
+				std::cout << ", \"time_p" << suffix << "_us\": " << time;
+			}
+			std::cout << ", \"ops_per_sec_p50\": " << rate(result.num_ops, percentile(times, 0.5));
+			std::cout << ", \"ops_per_sec_best\": " << rate(result.num_ops, times.front());
+			if(result.num_bytes) {
+				std::cout << ", \"gb_per_sec_p50\": " << rate(result.num_bytes, percentile(times, 0.5)) / 1e9;
+			}
+			std::cout << "}";
+			first = false;
+		}
+		std::cout << "\n]}" << std::endl;
+	}
+
+private:
+	static std::vector<int64_t> sorted(std::vector<int64_t> times) {
+		std::sort(times.begin(), times.end());
+		return times;
+	}
+	
+	// nearest rank
+	static int64_t percentile(const std::vector<int64_t>& times, double p) {
+		if(times.empty()) {
+			return 0;
+		}
+		return times[std::min<size_t>(p * times.size(), times.size() - 1)];
+	}
+	
+	static double rate(double num, int64_t time_us) {
+		return num / (time_us * 1e-6);
+	}
+
+private:
+	std::map<std::string, result_t> results;
+
+};
+
+// prevents the compiler from optimizing away a result
+template<typename T>
+inline void bench_keep(const T& value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+
+#endif /* TEST_BENCH_H_ */
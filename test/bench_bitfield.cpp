@@ -0,0 +1,62 @@
+/*
+ * bench_bitfield.cpp
+ *
+ *  Created on: Jun 14, 2021
+ *      Author: mad
+ */
+
+#include <chia/bitfield_index.hpp>
+
+#include "bench.h"
+
+#include <random>
+
+
+int main(int argc, char** argv)
+{
+	Benchmark bench(argc, argv);
+	std::mt19937_64 generator(0);
+	
+	// about 80% of entries survive back propagation
+	const int64_t num_bits = int64_t(1) << 28;
+	bitfield bits(num_bits);
+	for(int64_t i = 0; i < num_bits; ++i) {
+		if(generator() % 5) {
+			bits.set(i);
+		}
+	}
+	
+	bench.run("bitfield_index_build", "bits", num_bits,
+		[&]() {
+			bitfield_index index(bits);
+			bench_keep(index);
+		});
+	
+	const bitfield_index index(bits);
+	
+	// lookups in table order, offset is 10 bit
+	const size_t num_lookups = 1 << 22;
+	std::vector<std::pair<uint64_t, uint64_t>> input;
+	input.reserve(num_lookups);
+	while(input.size() < num_lookups) {
+		const uint64_t pos = generator() % (num_bits - 16384);
+		const uint64_t offset = generator() % 1024;
+		if(bits.get(pos) && bits.get(pos + offset)) {
+			input.emplace_back(pos, offset);
+		}
+	}
+	std::sort(input.begin(), input.end());
+	
+	uint64_t sum = 0;
+	bench.run("bitfield_index_lookup", "lookups", num_lookups,
+		[&]() {
+			for(const auto& entry : input) {
+				const auto res = index.lookup(entry.first, entry.second);
+				sum += res.first + res.second;
+			}
+			bench_keep(sum);
+		});
+	
+	bench.print_json("bitfield");
+	return 0;
+}
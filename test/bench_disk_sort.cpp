@@ -0,0 +1,118 @@
+/*
+ * bench_disk_sort.cpp
+ *
+ *  Created on: Jun 14, 2021
+ *      Author: mad
+ */
+
+#include <chia/phase1.h>
+#include <chia/phase2.h>
+#include <chia/phase3.h>
+#include <chia/DiskSort.hpp>
+
+#include "bench.h"
+
+#include <random>
+
+
+template<typename T>
+void set_dense_key(T& entry, uint32_t key) {
+	throw std::logic_error("no dense keys for this type");
+}
+
+void set_dense_key(phase3::entry_np& entry, uint32_t key) {
+	entry.key = key;
+}
+
+/*
+ * Measures write (add + finish) and read (sort) throughput of one entry type.
+ * Entries are random bytes, with key limited to key_size bits.
+ * With dense_keys the keys are a random permutation of [0, N), as in phase 3.
+ */
+template<typename T, typename Key>
+void bench_sort(Benchmark& bench, const std::string& name, int key_size, int log_num_entries, int num_threads,
+				const bool dense_keys = false)
+{
+	const std::string name_write = "disk_sort_write_" + name;
+	const std::string name_read = "disk_sort_read_" + name;
+	if(!bench.enabled(name_write) && !bench.enabled(name_read)) {
+		return;
+	}
+	const size_t num_entries = size_t(1) << log_num_entries;
+	const int log_num_buckets = std::min(7, key_size - 1);
+	
+	std::mt19937_64 generator(0);
+	std::vector<T> input(num_entries);
+	for(auto& entry : input) {
+		uint8_t buf[T::disk_size];
+		for(auto& byte : buf) {
+			byte = generator();
+		}
+		entry.read(buf);
+	}
+	if(dense_keys) {
+		std::vector<uint32_t> keys(num_entries);
+		for(size_t i = 0; i < num_entries; ++i) {
+			keys[i] = i;
+		}
+		std::shuffle(keys.begin(), keys.end(), generator);
+		for(size_t i = 0; i < num_entries; ++i) {
+			set_dense_key(input[i], keys[i]);
+		}
+		key_size = log_num_entries;
+	}
+	for(int i = 0; i < bench.num_warmup + bench.num_reps; ++i) {
+		DiskSort<T, Key> sort(key_size, log_num_buckets, "bench_disk_sort");
+		sort.set_dense_keys(dense_keys);
+		
+		const auto write_begin = get_wall_time_micros();
+		for(const auto& entry : input) {
+			sort.add(entry);
+		}
+		sort.finish();
+		const auto write_time = get_wall_time_micros() - write_begin;
+		
+		size_t count = 0;
+		Thread<std::vector<T>> output(
+			[&count](std::vector<T>& block) {
+				count += block.size();
+			}, "bench/out");
+		
+		const auto read_begin = get_wall_time_micros();
+		sort.read(&output, num_threads);
+		output.close();
+		const auto read_time = get_wall_time_micros() - read_begin;
+		
+		if(count != num_entries) {
+			throw std::logic_error("count != num_entries");
+		}
+		if(i >= bench.num_warmup) {
+			bench.add(name_write, "entries", num_entries, num_entries * T::disk_size, write_time);
+			bench.add(name_read, "entries", num_entries, num_entries * T::disk_size, read_time);
+		}
+	}
+	bench.print(name_write);
+	bench.print(name_read);
+}
+
+int main(int argc, char** argv)
+{
+	Benchmark bench(argc, argv);
+	
+	const int log_num_entries = 22;
+	const int num_threads = 4;
+	
+	// key_size is limited by what fits into an entry, random bytes cover the full range
+	bench_sort<phase1::entry_1, phase1::get_y<phase1::entry_1>>(bench, "entry_1", 40, log_num_entries, num_threads);
+	bench_sort<phase1::entry_2, phase1::get_y<phase1::entry_2>>(bench, "entry_2", 38, log_num_entries, num_threads);
+	bench_sort<phase1::entry_3, phase1::get_y<phase1::entry_3>>(bench, "entry_3", 38, log_num_entries, num_threads);
+	bench_sort<phase1::entry_5, phase1::get_y<phase1::entry_5>>(bench, "entry_5", 38, log_num_entries, num_threads);
+	bench_sort<phase1::entry_7, phase1::get_y<phase1::entry_7>>(bench, "entry_7", 32, log_num_entries, num_threads);
+	bench_sort<phase2::entry_x, phase2::get_pos<phase2::entry_x>>(bench, "phase2_entry_x", 32, log_num_entries, num_threads);
+	bench_sort<phase3::entry_lp, phase3::get_line_point<phase3::entry_lp>>(bench, "phase3_entry_lp", 64, log_num_entries, num_threads);
+	bench_sort<phase3::entry_np, phase3::get_sort_key<phase3::entry_np>>(bench, "phase3_entry_np", 32, log_num_entries, num_threads);
+	bench_sort<phase3::entry_np, phase3::get_sort_key<phase3::entry_np>>(bench, "phase3_entry_np_dense", 32, log_num_entries, num_threads, true);
+	
+	bench.print_json("disk_sort");
+	return 0;
+}
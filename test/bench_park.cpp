@@ -0,0 +1,104 @@
+/*
+ * bench_park.cpp
+ *
+ *  Created on: Jun 14, 2021
+ *      Author: mad
+ */
+
+#include <chia/phase3.hpp>
+#include <chia/encoding.hpp>
+
+#include "bench.h"
+
+#include <random>
+
+using namespace phase3;
+
+
+int main(int argc, char** argv)
+{
+	Benchmark bench(argc, argv);
+	std::mt19937_64 generator(0);
+	
+	const size_t num_parks = 1 << 10;
+	
+	// sorted line points with exponential gaps, similar to a k32 table
+	std::vector<std::vector<uint64_t>> parks(num_parks);
+	{
+		std::exponential_distribution<double> gap(1. / (uint64_t(1) << 30));
+		uint64_t point = 0;
+		for(auto& park : parks) {
+			park.resize(kEntriesPerPark);
+			for(auto& value : park) {
+				value = point;
+				point += gap(generator);
+			}
+		}
+	}
+	std::vector<std::vector<uint8_t>> deltas(num_parks);
+	std::vector<std::vector<uint64_t>> stubs(num_parks);
+	for(size_t k = 0; k < num_parks; ++k) {
+		const auto& points = parks[k];
+		for(size_t i = 0; i < points.size() - 1; ++i) {
+			const auto big_delta = points[i + 1] - points[i];
+			deltas[k].push_back(std::min<uint64_t>(big_delta >> (32 - kStubMinusBits), 255));
+			stubs[k].push_back(big_delta & ((1ull << (32 - kStubMinusBits)) - 1));
+		}
+	}
+	
+	for(int table_index = 1; table_index <= 6; ++table_index)
+	{
+		const auto park_size = CalculateParkSize(32, table_index);
+		std::vector<uint8_t> buffer(park_size);
+		
+		bench.run("write_park_table_" + std::to_string(table_index), "parks", num_parks,
+			[&]() {
+				for(size_t k = 0; k < num_parks; ++k) {
+					WritePark(parks[k][0], deltas[k], stubs[k], table_index, buffer.data(), buffer.size());
+				}
+				bench_keep(buffer);
+			});
+	}
+	
+	{
+		std::vector<uint8_t> buffer(kEntriesPerPark * 2);
+		
+		bench.run("ans_encode_deltas", "parks", num_parks,
+			[&]() {
+				for(size_t k = 0; k < num_parks; ++k) {
+					Encoding::ANSEncodeDeltas(deltas[k], kRValues[1], buffer.data());
+				}
+				bench_keep(buffer);
+			});
+	}
+	
+	{
+		const size_t num_points = 1 << 20;
+		
+		std::vector<std::pair<uint64_t, uint64_t>> squares(num_points);
+		for(auto& entry : squares) {
+			entry.first = generator() & 0xFFFFFFFF;
+			entry.second = generator() & 0xFFFFFFFF;
+		}
+		std::vector<uint128_t> points(num_points);
+		
+		bench.run("square_to_line_point", "points", num_points,
+			[&]() {
+				for(size_t i = 0; i < num_points; ++i) {
+					points[i] = Encoding::SquareToLinePoint(squares[i].first, squares[i].second);
+				}
+				bench_keep(points);
+			});
+		
+		bench.run("line_point_to_square", "points", num_points,
+			[&]() {
+				for(size_t i = 0; i < num_points; ++i) {
+					squares[i] = Encoding::LinePointToSquare(points[i]);
+				}
+				bench_keep(squares);
+			});
+	}
+	
+	bench.print_json("park");
+	return 0;
+}
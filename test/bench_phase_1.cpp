@@ -0,0 +1,115 @@
+/*
+ * bench_phase_1.cpp
+ *
+ *  Created on: Jun 14, 2021
+ *      Author: mad
+ */
+
+#include <chia/phase1.hpp>
+
+#include "bench.h"
+
+#include <random>
+
+using namespace phase1;
+
+
+template<typename T, typename S>
+void bench_fx(Benchmark& bench, int table_index, std::mt19937_64& generator)
+{
+	const size_t num_evals = 1 << 16;
+	
+	std::vector<T> L(num_evals);
+	std::vector<T> R(num_evals);
+	for(size_t i = 0; i < num_evals; ++i) {
+		for(auto* entry : {&L[i], &R[i]}) {
+			uint8_t bytes[sizeof(T)];
+			for(auto& byte : bytes) {
+				byte = generator();
+			}
+			::memcpy((void*)entry, bytes, sizeof(T));
+			entry->y = generator() & ((uint64_t(1) << (32 + kExtraBits)) - 1);
+		}
+	}
+	FxCalculator<T, S> Fx(table_index);
+	std::vector<S> out(num_evals);
+	
+	bench.run("fx_table_" + std::to_string(table_index), "evals", num_evals,
+		[&]() {
+			for(size_t i = 0; i < num_evals; ++i) {
+				Fx.evaluate(L[i], R[i], out[i]);
+			}
+			bench_keep(out);
+		});
+}
+
+int main(int argc, char** argv)
+{
+	Benchmark bench(argc, argv);
+	std::mt19937_64 generator(0);
+	
+	initialize();
+	
+	{
+		uint8_t id[32] = {};
+		for(size_t i = 0; i < sizeof(id); ++i) {
+			id[i] = i + 1;
+		}
+		F1Calculator F1(id);
+		
+		const size_t num_blocks = 1 << 16;
+		std::vector<entry_1> out(num_blocks * 16);
+		
+		bench.run("f1", "blocks", num_blocks,
+			[&]() {
+				F1.compute_blocks(0, num_blocks, out.data());
+				bench_keep(out);
+			});
+	}
+	
+	bench_fx<entry_1, entry_2>(bench, 2, generator);
+	bench_fx<entry_2, entry_3>(bench, 3, generator);
+	bench_fx<entry_3, entry_4>(bench, 4, generator);
+	bench_fx<entry_4, entry_5>(bench, 5, generator);
+	bench_fx<entry_5, entry_6>(bench, 6, generator);
+	bench_fx<entry_6, entry_7>(bench, 7, generator);
+	
+	{
+		// k32 has 2^32 entries in 2^38 / kBC groups, so about kBC / 64 per group
+		const size_t num_groups = 1 << 12;
+		const size_t group_size = kBC / 64;
+		
+		std::vector<std::vector<entry_1>> groups(num_groups);
+		for(size_t i = 0; i < num_groups; ++i) {
+			auto& group = groups[i];
+			group.resize(group_size);
+			for(auto& entry : group) {
+				entry.y = i * kBC + generator() % kBC;
+				entry.x = generator();
+			}
+			std::sort(group.begin(), group.end(),
+				[](const entry_1& lhs, const entry_1& rhs) -> bool {
+					return lhs.y < rhs.y;
+				});
+		}
+		FxMatcher<entry_1> matcher;
+		std::vector<match_t<entry_1>> matches;
+		matches.reserve(num_groups * kExtraBitsPow * 2);
+		
+		size_t num_matches = 0;
+		for(size_t i = 0; i + 1 < num_groups; ++i) {
+			num_matches += matcher.find_matches(0, groups[i].data(), group_size, groups[i + 1].data(), group_size, matches);
+		}
+		bench.run("fx_match", "matches", num_matches,
+			[&]() {
+				matches.clear();
+				for(size_t i = 0; i + 1 < num_groups; ++i) {
+					matcher.find_matches(0, groups[i].data(), group_size, groups[i + 1].data(), group_size, matches);
+				}
+				bench_keep(matches);
+			});
+	}
+	
+	bench.print_json("phase1");
+	return 0;
+}
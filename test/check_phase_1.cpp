@@ -5,7 +5,7 @@
  *      Author: mad
  */
 
-#include <chia/phase1.h>
+#include "check_phase_1.h"
 
 #include "chia_ref/verifier.hpp"
 
@@ -14,44 +14,6 @@ using namespace phase1;
 std::array<table_t, 7> table;
 std::array<FILE*, 7> file;
 
-void gather_x(int depth, uint64_t pos, uint16_t off, std::vector<uint32_t>& out)
-{
-	FILE* f = file[depth];
-	if(depth == 0) {
-		tmp_entry_1 entry = {};
-		fseek_set(f, pos * tmp_entry_1::disk_size);
-		read_entry(f, entry);
-//		std::cout << "[" << depth + 1 << "] x=" << entry.x << std::endl;
-		out.push_back(entry.x);
-		
-		fseek_set(f, (pos + off) * tmp_entry_1::disk_size);
-		read_entry(f, entry);
-//		std::cout << "[" << depth + 1 << "] x=" << entry.x << std::endl;
-		out.push_back(entry.x);
-	} else {
-		tmp_entry_x entry = {};
-		fseek_set(f, pos * tmp_entry_x::disk_size);
-		read_entry(f, entry);
-//		std::cout << "[" << depth + 1 << "] pos=" << entry.pos << ", off=" << entry.off << std::endl;
-		gather_x(depth - 1, entry.pos, entry.off, out);
-		
-		fseek_set(f, (pos + off) * tmp_entry_x::disk_size);
-		read_entry(f, entry);
-//		std::cout << "[" << depth + 1 << "] pos=" << entry.pos << ", off=" << entry.off << std::endl;
-		gather_x(depth - 1, entry.pos, entry.off, out);
-	}
-}
-
-uint32_t gather_7(uint64_t pos, std::vector<uint32_t>& out)
-{
-	entry_7 entry = {};
-	fseek_set(file[6], pos * entry_7::disk_size);
-	read_entry(file[6], entry);
-//	std::cout << "[7] y=" << entry.y << ", pos=" << entry.pos << ", off=" << entry.off << std::endl;
-	gather_x(5, entry.pos, entry.off, out);
-	return entry.y;
-}
-
 
 int main()
 {
@@ -84,7 +46,7 @@ int main()
 	{
 //		std::cout << std::endl;
 		std::vector<uint32_t> proof;
-		const auto y = gather_7(1000000000 + index, proof);
+		const auto y = gather_7(file, 1000000000 + index, proof);
 		
 //		std::cout << y << " :";
 //		for(auto x : proof) {
@@ -0,0 +1,59 @@
+/*
+ * check_phase_1.h
+ *
+ *  Created on: Jun 3, 2021
+ *      Author: mad
+ */
+
+#ifndef TEST_CHECK_PHASE_1_H_
+#define TEST_CHECK_PHASE_1_H_
+
+#include <chia/phase1.h>
+
+#include <array>
+#include <vector>
+
+
+/*
+ * Collects the x values of a proof from phase 1 tables, file[i] = table i + 1.
+ */
+inline
+void gather_x(const std::array<FILE*, 7>& file, int depth, uint64_t pos, uint16_t off, std::vector<uint32_t>& out)
+{
+	FILE* f = file[depth];
+	if(depth == 0) {
+		phase1::tmp_entry_1 entry = {};
+		fseek_set(f, pos * phase1::tmp_entry_1::disk_size);
+		read_entry(f, entry);
+		out.push_back(entry.x);
+		
+		fseek_set(f, (pos + off) * phase1::tmp_entry_1::disk_size);
+		read_entry(f, entry);
+		out.push_back(entry.x);
+	} else {
+		phase1::tmp_entry_x entry = {};
+		fseek_set(f, pos * phase1::tmp_entry_x::disk_size);
+		read_entry(f, entry);
+		gather_x(file, depth - 1, entry.pos, entry.off, out);
+		
+		fseek_set(f, (pos + off) * phase1::tmp_entry_x::disk_size);
+		read_entry(f, entry);
+		gather_x(file, depth - 1, entry.pos, entry.off, out);
+	}
+}
+
+/*
+ * Collects the 64 x values of a proof, starting at table 7 entry pos, returns its y.
+ */
+inline
+uint32_t gather_7(const std::array<FILE*, 7>& file, uint64_t pos, std::vector<uint32_t>& out)
+{
+	phase1::entry_7 entry = {};
+	fseek_set(file[6], pos * phase1::entry_7::disk_size);
+	read_entry(file[6], entry);
+	gather_x(file, 5, entry.pos, entry.off, out);
+	return entry.y;
+}
+
+
+#endif /* TEST_CHECK_PHASE_1_H_ */
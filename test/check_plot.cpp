@@ -0,0 +1,310 @@
+/*
+ * check_plot.cpp
+ *
+ *  Created on: Jun 17, 2021
+ *      Author: mad
+ */
+
+#include <chia/PlotReader.hpp>
+#include <chia/BatchVerifier.hpp>
+#include <chia/ThreadPool.h>
+
+#include "chia_ref/verifier.hpp"
+
+#include <random>
+#include <iostream>
+
+
+struct block_t {
+	int table_index = 0;			// 1 to 6 = line point parks, 7 = P7, 10 = C3
+	uint64_t park_index = 0;		// of first park in data
+	uint64_t num_parks = 0;
+	uint64_t total_parks = 0;		// in this table
+	std::vector<uint8_t> data;
+};
+
+struct result_t {
+	int table_index = 0;
+	uint64_t park_index = 0;
+	uint64_t num_parks = 0;
+	uint128_t first_point = 0;		// first line point of block
+	uint128_t last_point = 0;		// last line point of block
+	std::vector<uint64_t> last_f7;	// relative to C1 entry, one per C3 park
+	std::vector<std::string> errors;
+};
+
+static void decode_block(const block_t& block, result_t& out, const uint64_t max_pos)
+{
+	out.table_index = block.table_index;
+	out.park_index = block.park_index;
+	out.num_parks = block.num_parks;
+	if(block.table_index == 10) {
+		out.last_f7.resize(block.num_parks);
+	}
+	
+	const uint64_t park_size = block.table_index == 10 ?
+			PlotReader::get_c3_park_size() : PlotReader::get_park_size(block.table_index);
+	
+	for(uint64_t i = 0; i < block.num_parks; ++i)
+	{
+		const uint64_t park_index = block.park_index + i;
+		const bool is_last = park_index + 1 == block.total_parks;
+		const uint8_t* park = block.data.data() + i * park_size;
+		try {
+			if(block.table_index < 7) {
+				std::vector<uint8_t> deltas;
+				const auto first_point = PlotReader::decode_park(block.table_index, park, deltas);
+				if(!is_last && deltas.size() != kEntriesPerPark - 1) {
+					throw std::runtime_error("park has only " + std::to_string(deltas.size() + 1) + " entries");
+				}
+				if(i > 0 && first_point < out.last_point) {
+					throw std::runtime_error("line points not sorted");
+				}
+				const uint32_t stub_size = PlotReader::k - kStubMinusBits;
+				const uint8_t* stubs = park + phase3::CalculateLinePointSize(PlotReader::k);
+				
+				uint128_t point = first_point;
+				for(size_t j = 0; j < deltas.size(); ++j) {
+					point += (uint128_t(deltas[j]) << stub_size) + Util::SliceInt64FromBytes(stubs, j * stub_size, stub_size);
+				}
+				if(i == 0) {
+					out.first_point = first_point;
+				}
+				out.last_point = point;
+			}
+			else if(block.table_index == 7) {
+				for(uint32_t j = 0; j < kEntriesPerPark; ++j) {
+					const auto pos = Util::SliceInt64FromBytes(park, j * (PlotReader::k + 1), PlotReader::k + 1);
+					if(pos >= max_pos) {
+						throw std::runtime_error("P7 entry " + std::to_string(j) + " out of bounds");
+					}
+				}
+			}
+			else {
+				const auto deltas = PlotReader::decode_c3_park(park);
+				if(!is_last && deltas.size() != kCheckpoint1Interval - 1) {
+					throw std::runtime_error("C3 park has only " + std::to_string(deltas.size() + 1) + " entries");
+				}
+				uint64_t sum = 0;
+				for(const auto delta : deltas) {
+					sum += delta;
+				}
+				out.last_f7[i] = sum;
+			}
+		}
+		catch(const std::exception& ex) {
+			out.errors.push_back("Table " + std::to_string(block.table_index)
+					+ " park " + std::to_string(park_index) + ": " + ex.what());
+		}
+	}
+}
+
+/*
+ * Verifies num_proofs proofs for random challenges, returns number of invalid proofs.
+ * All proofs are validated at once via BatchVerifier, the first num_ref also via the reference verifier.
+ */
+static size_t check_proofs(const PlotReader& plot, const size_t num_proofs, const uint64_t seed, const size_t num_ref = 10)
+{
+	std::mt19937_64 generator(seed);
+	
+	std::vector<BatchVerifier::proof_t> proofs;
+	std::vector<std::array<uint8_t, 32>> qualities;
+	size_t num_challenges = 0;
+	
+	// some challenges have no proof, so give up after 10x tries
+	while(proofs.size() < num_proofs && num_challenges < 10 * num_proofs)
+	{
+		BatchVerifier::proof_t proof;
+		proof.id = plot.get_plot_id();
+		for(auto& byte : proof.challenge) {
+			byte = generator();
+		}
+		num_challenges++;
+		
+		const auto list = plot.get_qualities(proof.challenge.data());
+		for(size_t i = 0; i < list.size() && proofs.size() < num_proofs; ++i)
+		{
+			const auto xs = plot.get_full_proof(proof.challenge.data(), i);
+			std::copy(xs.begin(), xs.end(), proof.xs.begin());
+			proofs.push_back(proof);
+			qualities.push_back(list[i]);
+		}
+	}
+	const auto time_begin = get_wall_time_micros();
+	const auto results = BatchVerifier().validate(proofs);
+	const auto elapsed = (get_wall_time_micros() - time_begin) / 1e6;
+	
+	chia::Verifier verifier;
+	size_t num_failed = 0;
+	for(size_t i = 0; i < proofs.size(); ++i)
+	{
+		const auto& proof = proofs[i];
+		bool is_valid = results[i].valid && results[i].quality == qualities[i];
+		
+		if(i < num_ref) {
+			const auto proof_bytes = PlotReader::get_proof_bytes(std::vector<uint32_t>(proof.xs.begin(), proof.xs.end()));
+			const auto quality = verifier.ValidateProof(
+					proof.id.data(), PlotReader::k, proof.challenge.data(), proof_bytes.data(), proof_bytes.size());
+			
+			uint8_t quality_bytes[32] = {};
+			if(quality.GetSize() == 256) {
+				quality.ToBytes(quality_bytes);
+			}
+			if(quality.GetSize() != 256 || ::memcmp(quality_bytes, qualities[i].data(), 32)) {
+				is_valid = false;
+			}
+			if((quality.GetSize() == 256) != results[i].valid) {
+				std::cout << "BatchVerifier differs from reference for proof [" << i << "]" << std::endl;
+			}
+		}
+		if(!is_valid) {
+			std::cout << "Invalid proof [" << i << "] for challenge "
+					<< Util::HexStr(proof.challenge.data(), proof.challenge.size()) << std::endl;
+			num_failed++;
+		}
+	}
+	std::cout << "Checked " << proofs.size() << " proofs (" << num_challenges << " challenges) in "
+			<< elapsed << " sec, " << num_failed << " failed" << std::endl;
+	return num_failed;
+}
+
+/*
+ * Decodes every park of a finished plot in parallel, then validates random proofs.
+ *
+ * Usage: check_plot <file.plot> [num_proofs] [num_threads]
+ *
+ * Returns 1 for invalid parks, 2 for invalid proofs.
+ */
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		std::cout << "Usage: check_plot <file.plot> [num_proofs] [num_threads]" << std::endl;
+		return -1;
+	}
+	const std::string file_name = argv[1];
+	const size_t num_proofs = argc > 2 ? atoi(argv[2]) : 100;
+	const int num_threads = argc > 3 ? atoi(argv[3]) : std::max<int>(std::thread::hardware_concurrency(), 1);
+	const uint64_t max_block_size = 16 * 1024 * 1024;
+	
+	phase1::initialize();
+	
+	const PlotReader plot(file_name);
+	std::cout << "Plot: " << file_name << std::endl;
+	std::cout << "Plot ID: " << Util::HexStr(plot.get_plot_id().data(), plot.get_plot_id().size()) << std::endl;
+	
+	const auto time_begin = get_wall_time_micros();
+	size_t num_errors = 0;
+	
+	for(int i = 1; i <= 10; ++i) {
+		std::cout << "Table " << i << " begin: " << plot.get_table_begin(i) << std::endl;
+	}
+	for(uint64_t i = 1; i < plot.get_num_c1(); ++i) {
+		if(plot.read_c1(i) < plot.read_c1(i - 1)) {
+			std::cout << "C1 not sorted at " << i << std::endl;
+			num_errors++;
+			break;
+		}
+	}
+	// max P7 entry is bounded by size of table 6
+	const uint64_t max_pos = plot.get_num_parks(6) * kEntriesPerPark;
+	
+	int prev_table = 0;
+	uint128_t prev_point = 0;
+	uint64_t num_parks_total = 0;
+	
+	Thread<result_t> check_thread(
+		[&plot, &prev_table, &prev_point, &num_errors, &num_parks_total](result_t& result) {
+			for(const auto& error : result.errors) {
+				std::cout << error << std::endl;
+			}
+			num_errors += result.errors.size();
+			num_parks_total += result.num_parks;
+			
+			if(result.table_index < 7) {
+				if(result.table_index == prev_table && result.first_point < prev_point) {
+					std::cout << "Table " << result.table_index << " park " << result.park_index
+							<< ": line points not sorted" << std::endl;
+					num_errors++;
+				}
+				prev_table = result.table_index;
+				prev_point = result.last_point;
+			}
+			if(result.table_index == 10) {
+				// C3 deltas need to end before next C1 entry
+				for(size_t i = 0; i < result.last_f7.size(); ++i) {
+					const auto index = result.park_index + i;
+					if(index + 1 < plot.get_num_c1()
+						&& plot.read_c1(index) + result.last_f7[i] > plot.read_c1(index + 1))
+					{
+						std::cout << "C3 park " << index << ": does not match C1" << std::endl;
+						num_errors++;
+					}
+				}
+			}
+		}, "check/out");
+	
+	ThreadPool<block_t, result_t> decode_pool(
+		[max_pos](block_t& input, result_t& out, size_t&) {
+			decode_block(input, out, max_pos);
+		}, &check_thread, num_threads, "check/decode");
+	
+	FILE* file = fopen_ex(file_name, "rb");
+	if(!file) {
+		throw std::runtime_error("fopen() failed for " + file_name);
+	}
+	uint64_t num_bytes_read = 0;
+	
+	for(const int table_index : {1, 2, 3, 4, 5, 6, 7, 10})
+	{
+		const uint64_t begin = plot.get_table_begin(table_index);
+		const uint64_t end = table_index < 10 ? plot.get_table_begin(table_index + 1) : plot.get_file_size();
+		const uint64_t park_size = table_index == 10 ?
+				PlotReader::get_c3_park_size() : PlotReader::get_park_size(table_index);
+		const uint64_t num_parks = table_index == 10 ? plot.get_num_c1() : (end - begin) / park_size;
+		
+		if(begin + num_parks * park_size > end) {
+			std::cout << "Table " << table_index << ": truncated, expected "
+					<< num_parks * park_size << " bytes" << std::endl;
+			num_errors++;
+			continue;
+		}
+		if(table_index < 10 && (end - begin) % park_size) {
+			std::cout << "Table " << table_index << ": size is not a multiple of park size" << std::endl;
+			num_errors++;
+		}
+		const uint64_t parks_per_block = std::max<uint64_t>(max_block_size / park_size, 1);
+		fseek_set(file, begin);
+		
+		for(uint64_t park = 0; park < num_parks; park += parks_per_block) {
+			block_t block;
+			block.table_index = table_index;
+			block.park_index = park;
+			block.num_parks = std::min(parks_per_block, num_parks - park);
+			block.total_parks = num_parks;
+			block.data.resize(block.num_parks * park_size);
+			if(fread(block.data.data(), 1, block.data.size(), file) != block.data.size()) {
+				throw std::runtime_error("fread() failed");
+			}
+			num_bytes_read += block.data.size();
+			decode_pool.take(block);
+		}
+		std::cout << "Table " << table_index << ": " << num_parks << " parks" << std::endl;
+	}
+	fclose_ex(file);
+	decode_pool.close();
+	check_thread.close();
+	
+	const auto elapsed = (get_wall_time_micros() - time_begin) / 1e6;
+	std::cout << "Decoded " << num_parks_total << " parks in " << elapsed << " sec ("
+			<< num_bytes_read / elapsed / pow(1024, 2) << " MB/s), " << num_errors << " errors" << std::endl;
+	
+	if(num_errors) {
+		std::cout << "FAILED: invalid parks" << std::endl;
+		return 1;
+	}
+	if(check_proofs(plot, num_proofs, 0)) {
+		std::cout << "FAILED: invalid proofs" << std::endl;
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * generate_tables.cpp
+ *
+ *  Created on: Jun 21, 2021
+ *      Author: mad
+ */
+
+#include "generate_tables.h"
+
+
+/*
+ * Writes test.p1.table[1-7].tmp, same as test_phase_1, for test_phase_2 / 3 / 4.
+ *
+ * Usage: generate_tables [log_num_entries] [num_threads] [seed]
+ */
+int main(int argc, char** argv)
+{
+	const int log_num_entries = argc > 1 ? atoi(argv[1]) : 26;
+	const int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+	const uint64_t seed = argc > 3 ? atoll(argv[3]) : 0;
+	
+	if(log_num_entries < 16 || log_num_entries > 32) {
+		std::cout << "Invalid log_num_entries: " << log_num_entries << " (supported: [16..32])" << std::endl;
+		return -2;
+	}
+	const auto total_begin = get_wall_time_micros();
+	
+	generate_tables(log_num_entries, num_threads, seed);
+	
+	std::cout << "Generating tables took " << (get_wall_time_micros() - total_begin) / 1e6 << " sec" << std::endl;
+	return 0;
+}
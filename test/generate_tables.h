@@ -0,0 +1,182 @@
+/*
+ * generate_tables.h
+ *
+ *  Created on: Jun 21, 2021
+ *      Author: mad
+ */
+
+#ifndef TEST_GENERATE_TABLES_H_
+#define TEST_GENERATE_TABLES_H_
+
+#include <chia/phase1.h>
+#include <chia/DiskTable.h>
+#include <chia/ThreadPool.h>
+
+#include <array>
+#include <string>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+
+/*
+ * Statistical model of phase 1 output, scaled to 2^log_num_entries entries per table:
+ *
+ * Entries sorted by y form BC groups of Poisson(kBC / 2^kExtraBits) size (~236, same for any k).
+ * Each entry finds Poisson(1) matches with random entries of the next group,
+ * so off = right - left is distributed as in a real table, and e^-2 (13.5 %) of a
+ * table is not referenced by the next one, same as in a real plot.
+ * Since y of a new table is a hash, its sort order is a random permutation of the matches,
+ * ie. entry j of tables 2 to 6 is an independent random match into the previous table.
+ * Table 7 is written in match order, as in phase 1.
+ *
+ * x and f7 are scaled to [0, 2^log_num_entries), which keeps line point and f7 deltas
+ * realistic for the parks of phase 3 and 4.
+ */
+static const size_t block_size = 1 << 20;
+
+inline std::vector<uint64_t> generate_groups(const uint64_t num_entries, const uint64_t seed)
+{
+	std::mt19937_64 generator(seed);
+	std::poisson_distribution<uint64_t> group_size(double(kBC) / (1 << kExtraBits));
+	
+	std::vector<uint64_t> groups;
+	uint64_t offset = 0;
+	while(offset < num_entries) {
+		groups.push_back(offset);
+		offset += group_size(generator);
+	}
+	groups.push_back(num_entries);
+	return groups;
+}
+
+template<typename T>
+void write_table(DiskTable<T>& table, const std::vector<uint64_t>& jobs, int num_threads,
+				const std::function<void(uint64_t, std::vector<T>&)>& func)
+{
+	Thread<std::vector<T>> output(
+		[&table](std::vector<T>& input) {
+			table.write(input);
+		}, "gen/write");
+	
+	ThreadPool<uint64_t, std::vector<T>> pool(
+		[&func](uint64_t& job, std::vector<T>& out, size_t&) {
+			func(job, out);
+		}, &output, num_threads, "gen/table");
+	
+	for(auto job : jobs) {
+		pool.take(job);
+	}
+	pool.close();
+	output.close();
+	table.close();
+}
+
+/*
+ * Writes <prefix>.p1.table[1-7].tmp with 2^log_num_entries entries per table, in the format of phase 1.
+ */
+inline
+std::array<table_t, 7> generate_tables(const int log_num_entries, const int num_threads, const uint64_t seed,
+										const std::string& prefix = "test")
+{
+	std::array<table_t, 7> tables;
+	const uint64_t num_entries = uint64_t(1) << log_num_entries;
+	
+	std::vector<uint64_t> blocks;
+	for(uint64_t i = 0; i < num_entries; i += block_size) {
+		blocks.push_back(i);
+	}
+	{
+		const auto begin = get_wall_time_micros();
+		DiskTable<phase1::tmp_entry_1> table(prefix + ".p1.table1.tmp");
+		write_table<phase1::tmp_entry_1>(table, blocks, num_threads,
+			[num_entries, seed](uint64_t offset, std::vector<phase1::tmp_entry_1>& out) {
+				std::mt19937_64 generator(seed ^ (uint64_t(1) << 56) ^ offset);
+				out.resize(std::min<uint64_t>(block_size, num_entries - offset));
+				for(auto& entry : out) {
+					entry.x = generator() & (num_entries - 1);
+				}
+			});
+		tables[0] = table.get_info();
+		std::cout << "[Gen] Table 1 took " << (get_wall_time_micros() - begin) / 1e6 << " sec, "
+				<< table.get_info().num_entries << " entries" << std::endl;
+	}
+	
+	for(int R_index = 2; R_index <= 6; ++R_index)
+	{
+		const auto begin = get_wall_time_micros();
+		const auto groups = generate_groups(num_entries, seed ^ (uint64_t(R_index - 1) << 48));
+		
+		DiskTable<phase1::tmp_entry_x> table(prefix + ".p1.table" + std::to_string(R_index) + ".tmp");
+		write_table<phase1::tmp_entry_x>(table, blocks, num_threads,
+			[num_entries, seed, R_index, &groups](uint64_t offset, std::vector<phase1::tmp_entry_x>& out) {
+				std::mt19937_64 generator(seed ^ (uint64_t(R_index) << 56) ^ offset);
+				out.resize(std::min<uint64_t>(block_size, num_entries - offset));
+				for(auto& entry : out) {
+					while(true) {
+						const uint64_t pos = generator() & (num_entries - 1);
+						const size_t group = std::upper_bound(groups.begin(), groups.end(), pos) - groups.begin() - 1;
+						if(group + 2 >= groups.size()) {
+							continue;	// last group has no matches
+						}
+						const uint64_t next_begin = groups[group + 1];
+						const uint64_t next_size = groups[group + 2] - next_begin;
+						if(!next_size) {
+							continue;
+						}
+						const uint64_t off = next_begin + generator() % next_size - pos;
+						if(off < 1024) {
+							entry.pos = pos;
+							entry.off = off;
+							break;
+						}
+					}
+				}
+			});
+		tables[R_index - 1] = table.get_info();
+		std::cout << "[Gen] Table " << R_index << " took " << (get_wall_time_micros() - begin) / 1e6 << " sec, "
+				<< table.get_info().num_entries << " entries" << std::endl;
+	}
+	{
+		const auto begin = get_wall_time_micros();
+		const auto groups = generate_groups(num_entries, seed ^ (uint64_t(6) << 48));
+		
+		// split on group boundaries, since matches don't cross into the next job
+		std::vector<uint64_t> jobs;
+		for(uint64_t i = 0; i + 2 < groups.size(); i += block_size / 256) {
+			jobs.push_back(i);
+		}
+		DiskTable<phase1::entry_7> table(prefix + ".p1.table7.tmp");
+		write_table<phase1::entry_7>(table, jobs, num_threads,
+			[num_entries, seed, &groups](uint64_t first, std::vector<phase1::entry_7>& out) {
+				std::mt19937_64 generator(seed ^ (uint64_t(7) << 56) ^ first);
+				std::poisson_distribution<uint32_t> num_matches(1);
+				
+				const uint64_t last = std::min<uint64_t>(first + block_size / 256, groups.size() - 2);
+				for(uint64_t group = first; group < last; ++group) {
+					const uint64_t next_begin = groups[group + 1];
+					const uint64_t next_size = groups[group + 2] - next_begin;
+					for(uint64_t pos = groups[group]; pos < next_begin && next_size; ++pos) {
+						for(uint32_t i = num_matches(generator); i > 0; --i) {
+							const uint64_t off = next_begin + generator() % next_size - pos;
+							if(off < 1024) {
+								phase1::entry_7 entry;
+								entry.y = generator() & (num_entries - 1);
+								entry.pos = pos;
+								entry.off = off;
+								out.push_back(entry);
+							}
+						}
+					}
+				}
+			});
+		tables[6] = table.get_info();
+		std::cout << "[Gen] Table 7 took " << (get_wall_time_micros() - begin) / 1e6 << " sec, "
+				<< table.get_info().num_entries << " entries" << std::endl;
+	}
+	return tables;
+}
+
+
+#endif /* TEST_GENERATE_TABLES_H_ */
@@ -55,6 +55,111 @@ int main(int argc, char** argv)
 		std::cout << "sort() took " << (get_wall_time_micros() - sort_begin) / 1000. << " ms" << std::endl;
 	}
 	
+	if(true) {
+		typedef DiskSort<phase1::entry_1, phase1::get_y<phase1::entry_1>> DiskSort1;
+		
+		DiskSort1 sort(test_bits, log_num_buckets, "test_ranges");
+		
+		for(size_t i = 0; i < test_size; ++i) {
+			phase1::entry_1 entry = {};
+			entry.y = generator() % test_size;
+			entry.x = i;
+			sort.add(entry);
+		}
+		sort.finish();
+		
+		std::mutex mutex;
+		std::vector<std::pair<uint64_t, uint64_t>> ranges;
+		
+		const auto sort_begin = get_wall_time_micros();
+		sort.read_ranges(
+			[&mutex, &ranges](sorted_range_t<phase1::entry_1>& range) {
+				for(size_t i = 1; i < range.data.size(); ++i) {
+					if(range.data[i].y < range.data[i - 1].y) {
+						throw std::logic_error("range not sorted");
+					}
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				ranges.emplace_back(range.offset, range.data.size());
+			}, num_threads);
+		
+		std::sort(ranges.begin(), ranges.end());
+		uint64_t offset = 0;
+		for(const auto& range : ranges) {
+			if(range.first != offset) {
+				throw std::logic_error("range offset mismatch");
+			}
+			offset += range.second;
+		}
+		if(offset != test_size) {
+			throw std::logic_error("read_ranges() lost entries");
+		}
+		std::cout << "read_ranges() took " << (get_wall_time_micros() - sort_begin) / 1000. << " ms" << std::endl;
+	}
+	
+	for(const int log_files_per_bucket : {3, 6})
+	{
+		typedef DiskSort<phase1::entry_1, phase1::get_y<phase1::entry_1>> DiskSort1;
+		
+		// more buckets than files, such that runs contain entries of several buckets,
+		// with 2^6 buckets per file these are read in groups of 2^2 buckets
+		const int max_log_num_files = g_max_log_num_files;
+		g_max_log_num_files = std::max<int>(log_num_buckets - log_files_per_bucket, 0);
+		g_verify_tmp = log_files_per_bucket > 3;
+		
+		DiskSort1 sort(test_bits, log_num_buckets, "test_shared");
+		g_max_log_num_files = max_log_num_files;
+		
+		for(size_t i = 0; i < test_size; ++i) {
+			phase1::entry_1 entry = {};
+			entry.y = generator() % test_size;
+			entry.x = i;
+			sort.add(entry);
+		}
+		sort.finish();
+		sort.set_keep_files(true);
+		
+		if(sort.num_entries() != test_size) {
+			throw std::logic_error("shared files lost entries");
+		}
+		const auto check_sorted = [num_threads, test_size](DiskSort1& sort) {
+			uint64_t count = 0;
+			uint64_t y_max = 0;
+			Thread<std::vector<phase1::entry_1>> thread(
+				[&count, &y_max](std::vector<phase1::entry_1>& input) {
+					for(const auto& entry : input) {
+						if(entry.y < y_max) {
+							throw std::logic_error("shared files not sorted");
+						}
+						y_max = entry.y;
+					}
+					count += input.size();
+				}, "test_output");
+			
+			sort.read(&thread, num_threads);
+			thread.close();
+			if(count != test_size) {
+				throw std::logic_error("shared files lost entries");
+			}
+		};
+		const auto sort_begin = get_wall_time_micros();
+		check_sorted(sort);
+		std::cout << "sort() with " << sort.num_files() << " files took "
+				<< (get_wall_time_micros() - sort_begin) / 1000. << " ms" << std::endl;
+		
+		// same files again, run index is recovered from the run headers
+		g_max_log_num_files = std::max<int>(log_num_buckets - log_files_per_bucket, 0);
+		DiskSort1 reopen(test_bits, log_num_buckets, "test_shared", true);
+		g_max_log_num_files = max_log_num_files;
+		
+		if(reopen.num_entries() != test_size) {
+			throw std::logic_error("shared files lost entries on reopen");
+		}
+		reopen.set_keep_files(false);
+		check_sorted(reopen);
+		g_verify_tmp = false;
+	}
+	
 	if(false) {
 		std::cout << "sizeof(phase1::entry_4) = " << sizeof(phase1::entry_4) << std::endl;
 		
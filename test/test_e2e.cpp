@@ -0,0 +1,210 @@
+/*
+ * test_e2e.cpp
+ *
+ *  Created on: Jun 15, 2021
+ *      Author: mad
+ */
+
+#include <chia/phase1.hpp>
+#include <chia/phase2.hpp>
+#include <chia/phase3.hpp>
+#include <chia/phase4.hpp>
+#include <chia/json.h>
+
+#include "check_phase_1.h"
+#include "generate_tables.h"
+
+#include "chia_ref/verifier.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+
+struct phase_result_t {
+	std::string name;
+	double time_sec = 0;
+	uint64_t num_read = 0;
+	uint64_t num_write = 0;
+};
+
+/*
+ * Returns number of invalid proofs out of num_proofs.
+ */
+size_t check_proofs(const phase1::output_t& input, const size_t num_proofs)
+{
+	const auto& table_7 = input.table[6];
+	if(table_7.num_entries == 0) {
+		throw std::logic_error("table 7 is empty");
+	}
+	std::array<FILE*, 7> file = {};
+	for(size_t i = 0; i < file.size(); ++i) {
+		file[i] = fopen_ex(input.table[i].file_name, "rb");
+		if(!file[i]) {
+			throw std::runtime_error("fopen() failed for " + input.table[i].file_name);
+		}
+	}
+	size_t num_failed = 0;
+	for(size_t i = 0; i < num_proofs; ++i)
+	{
+		std::vector<uint32_t> proof;
+		const auto y = gather_7(file, (table_7.num_entries / num_proofs) * i, proof);
+		
+		uint8_t challenge[32] = {};
+		Bits(y, 32).ToBytes(challenge);
+		
+		uint8_t proof_bytes[256] = {};
+		for(size_t k = 0; k < proof.size(); ++k) {
+			Bits(proof[k], 32).ToBytes(proof_bytes + 4 * k);
+		}
+		chia::Verifier verify;
+		const auto quality = verify.ValidateProof(input.params.id.data(), 32, challenge, proof_bytes, sizeof(proof_bytes));
+		if(quality.GetSize() == 0) {
+			num_failed++;
+		}
+	}
+	for(auto f : file) {
+		fclose_ex(f);
+	}
+	return num_failed;
+}
+
+/*
+ * Creates a plot with fixed id and memo, writes timings and I/O volume per phase to test.e2e.json.
+ *
+ * By default phase 1 is replaced by synthetic tables of 2^22 entries (see generate_tables.h),
+ * such that phase 2 to 4 run in seconds. With log_num_entries = 32 a complete k32 plot is created
+ * (needs about 250 GiB of disk), and proofs from phase 1 are checked via the reference verifier.
+ *
+ * If a baseline (previous test.e2e.json) is given, fails if any phase got slower than threshold,
+ * or if the plot checksum differs (golden plot).
+ *
+ * Usage: test_e2e [num_threads] [log_num_buckets] [baseline.json] [threshold] [log_num_entries]
+ */
+int main(int argc, char** argv)
+{
+	const int num_threads = argc > 1 ? atoi(argv[1]) : 4;
+	const int log_num_buckets = argc > 2 ? atoi(argv[2]) : 7;
+	const std::string baseline_file = argc > 3 ? argv[3] : "";
+	const double threshold = argc > 4 ? atof(argv[4]) : 0.1;
+	const int log_num_entries = argc > 5 ? atoi(argv[5]) : 22;
+	const bool is_full = log_num_entries == 32;
+	const size_t num_proofs = is_full ? 100 : 0;
+	
+	if(log_num_entries < 16 || log_num_entries > 32) {
+		std::cout << "Invalid log_num_entries: " << log_num_entries << " (supported: [16..32])" << std::endl;
+		return -2;
+	}
+	
+	phase1::input_t params;
+	for(size_t i = 0; i < params.id.size(); ++i) {
+		params.id[i] = i + 1;
+	}
+	for(size_t i = 0; i < 128; ++i) {
+		params.memo.push_back(i);
+	}
+	const std::string plot_name = "test.e2e";
+	
+	const auto total_begin = get_wall_time_micros();
+	std::vector<phase_result_t> phases;
+	
+	auto add_phase = [&phases](const std::string& name, const int64_t time_begin) {
+		phase_result_t result;
+		result.name = name;
+		result.time_sec = (get_wall_time_micros() - time_begin) / 1e6;
+		get_io_stats(name, result.num_read, result.num_write);
+		phases.push_back(result);
+	};
+	
+	auto time_begin = get_wall_time_micros();
+	phase1::output_t out_1;
+	size_t num_failed = 0;
+	if(is_full) {
+		phase1::compute(params, out_1, num_threads, log_num_buckets, plot_name, "", "");
+		add_phase("P1", time_begin);
+		
+		num_failed = check_proofs(out_1, num_proofs);
+		std::cout << "Checked " << num_proofs << " proofs, " << num_failed << " failed" << std::endl;
+	} else {
+		// synthetic tables don't contain valid proofs, and are not timed
+		out_1.params = params;
+		out_1.table = generate_tables(log_num_entries, num_threads, 0, plot_name);
+	}
+	
+	time_begin = get_wall_time_micros();
+	phase2::output_t out_2;
+	phase2::compute(out_1, out_2, num_threads, log_num_buckets, plot_name, "", "");
+	add_phase("P2", time_begin);
+	
+	time_begin = get_wall_time_micros();
+	phase3::output_t out_3;
+	phase3::compute(out_2, out_3, num_threads, log_num_buckets, plot_name, "", "");
+	add_phase("P3", time_begin);
+	
+	time_begin = get_wall_time_micros();
+	phase4::output_t out_4;
+	phase4::compute(out_3, out_4, num_threads, log_num_buckets, plot_name, "", "");
+	add_phase("P4", time_begin);
+	
+	const double total_sec = (get_wall_time_micros() - total_begin) / 1e6;
+	const auto checksum = get_file_checksum(out_4.plot_file_name);
+	std::cout << "Plot checksum: " << checksum << std::endl;
+	
+	std::stringstream json;
+	json << "{\"k\": 32, \"log_num_entries\": " << log_num_entries << ", \"threads\": " << num_threads << ", \"log_num_buckets\": " << log_num_buckets
+		<< ", \"proofs\": " << num_proofs << ", \"proofs_failed\": " << num_failed
+		<< ", \"plot_size\": " << out_4.plot_size << ", \"checksum\": \"" << checksum << "\""
+		<< ", \"total_sec\": " << total_sec << ",\n \"phases\": {";
+	for(size_t i = 0; i < phases.size(); ++i) {
+		const auto& phase = phases[i];
+		json << (i ? "," : "") << "\n  \"" << phase.name << "\": {\"time_sec\": " << phase.time_sec
+			<< ", \"read_bytes\": " << phase.num_read << ", \"write_bytes\": " << phase.num_write << "}";
+	}
+	json << "\n}}" << std::endl;
+	{
+		std::ofstream out("test.e2e.json");
+		out << json.str();
+	}
+	std::cout << json.str();
+	
+	if(num_failed) {
+		std::cout << "FAILED: invalid proofs" << std::endl;
+		return 1;
+	}
+	if(!baseline_file.empty()) {
+		std::ifstream in(baseline_file);
+		if(!in) {
+			throw std::runtime_error("failed to open " + baseline_file);
+		}
+		const std::string baseline((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		
+		double base_entries = 32;
+		json_get_number(baseline, "", "log_num_entries", base_entries);
+		if(base_entries != log_num_entries) {
+			std::cout << "FAILED: baseline has log_num_entries = " << base_entries << ", not " << log_num_entries << std::endl;
+			return 4;
+		}
+		std::string golden;
+		if(json_get_string(baseline, "checksum", golden) && golden != checksum) {
+			std::cout << "FAILED: checksum mismatch, expected " << golden << std::endl;
+			return 2;
+		}
+		bool is_slower = false;
+		for(const auto& phase : phases) {
+			double base_sec = 0;
+			if(json_get_number(baseline, phase.name, "time_sec", base_sec) && base_sec > 0) {
+				const auto change = phase.time_sec / base_sec - 1;
+				std::cout << phase.name << ": " << phase.time_sec << " sec vs " << base_sec
+						<< " sec (" << (change > 0 ? "+" : "") << change * 100 << " %)" << std::endl;
+				if(change > threshold) {
+					is_slower = true;
+				}
+			}
+		}
+		if(is_slower) {
+			std::cout << "FAILED: slower than baseline by more than " << threshold * 100 << " %" << std::endl;
+			return 3;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * test_kernels.cpp
+ *
+ *  Created on: Jun 22, 2021
+ *      Author: mad
+ */
+
+#include <chia/phase1.hpp>
+#include <chia/phase2.h>
+#include <chia/phase3.h>
+#include <chia/crc32c.h>
+#include <chia/blake3_short.h>
+#include <chia/cpu_features.h>
+
+#include <random>
+
+using namespace phase1;
+
+
+template<typename T>
+std::vector<uint8_t> encode_decode(const std::vector<uint8_t>& input)
+{
+	const size_t count = input.size() / T::disk_size;
+	std::vector<T> entries(count);
+	decode_block(input.data(), entries.data(), count);
+	
+	std::vector<uint8_t> out(count * T::disk_size);
+	encode_block(entries.data(), out.data(), count);
+	return out;
+}
+
+template<typename T>
+void check_codec(const std::vector<uint8_t>& input, std::vector<std::vector<uint8_t>>& out)
+{
+	out.push_back(encode_decode<T>(input));
+}
+
+/*
+ * Checks decode_block() / encode_block() against T::read() / T::write(), for the currently selected features.
+ * Entries are compared as bytes, decoding into zeroed memory such that padding matches.
+ * Encoding starts from random bytes, to cover bits above the stored size of each field.
+ */
+template<typename T>
+bool check_codec_ref(const std::vector<uint8_t>& input, const std::string& name)
+{
+	const size_t count = std::min(input.size() / T::disk_size, input.size() / sizeof(T));
+	bool is_ok = true;
+	{
+		std::vector<T> expected(count);
+		std::vector<T> entries(count);
+		::memset((void*)expected.data(), 0, count * sizeof(T));
+		::memset((void*)entries.data(), 0, count * sizeof(T));
+		for(size_t i = 0; i < count; ++i) {
+			expected[i].read(input.data() + i * T::disk_size);
+		}
+		decode_block(input.data(), entries.data(), count);
+		if(::memcmp(entries.data(), expected.data(), count * sizeof(T))) {
+			std::cout << "decode_block() " << name << ": differs from read()" << std::endl;
+			is_ok = false;
+		}
+	}
+	{
+		std::vector<T> entries(count);
+		::memcpy((void*)entries.data(), input.data(), count * sizeof(T));
+		
+		std::vector<uint8_t> expected(count * T::disk_size);
+		std::vector<uint8_t> out(count * T::disk_size);
+		for(size_t i = 0; i < count; ++i) {
+			entries[i].write(expected.data() + i * T::disk_size);
+		}
+		encode_block(entries.data(), out.data(), count);
+		if(out != expected) {
+			std::cout << "encode_block() " << name << ": differs from write()" << std::endl;
+			is_ok = false;
+		}
+	}
+	return is_ok;
+}
+
+bool check_codecs(const std::vector<uint8_t>& data)
+{
+	bool is_ok = true;
+	is_ok &= check_codec_ref<entry_1>(data, "entry_1");
+	is_ok &= check_codec_ref<entry_7>(data, "entry_7");
+	is_ok &= check_codec_ref<tmp_entry_1>(data, "tmp_entry_1");
+	is_ok &= check_codec_ref<tmp_entry_x>(data, "tmp_entry_x");
+	is_ok &= check_codec_ref<phase2::entry_x>(data, "phase2::entry_x");
+	is_ok &= check_codec_ref<phase3::entry_lp>(data, "phase3::entry_lp");
+	is_ok &= check_codec_ref<phase3::entry_np>(data, "phase3::entry_np");
+	return is_ok;
+}
+
+/*
+ * Checks that the key read from disk format matches the key of the decoded entry.
+ */
+template<typename T, typename Key>
+bool check_disk_key(const std::vector<uint8_t>& input, const std::string& name)
+{
+	const size_t count = input.size() / T::disk_size;
+	size_t num_fail = 0;
+	for(size_t i = 0; i < count; ++i) {
+		const uint8_t* record = input.data() + i * T::disk_size;
+		T entry;
+		entry.read(record);
+		if(disk_key_t<T, Key>::get(record) != Key{}(entry)) {
+			num_fail++;
+		}
+	}
+	std::cout << "disk key " << name << ": " << (num_fail ? "FAILED" : "OK") << std::endl;
+	return num_fail == 0;
+}
+
+/*
+ * Computes output of every kernel, for the currently selected features.
+ */
+std::vector<std::vector<uint8_t>> compute(const std::vector<uint8_t>& data)
+{
+	std::vector<std::vector<uint8_t>> out;
+	{
+		uint8_t id[32] = {};
+		for(size_t i = 0; i < sizeof(id); ++i) {
+			id[i] = data[i];
+		}
+		F1Calculator F1(id);
+		
+		// crossing 2^32 blocks, which carries into the upper counter word
+		for(const uint64_t index : {uint64_t(0), (uint64_t(1) << 32) - 13}) {
+			for(const size_t count : {1, 7, 8, 9, 33}) {
+				std::vector<entry_1> block(count * 16);
+				F1.compute_blocks(index, count, block.data());
+				std::vector<uint8_t> bytes;
+				for(const auto& entry : block) {
+					bytes.insert(bytes.end(), (const uint8_t*)&entry.y, (const uint8_t*)(&entry.y + 1));
+					bytes.insert(bytes.end(), (const uint8_t*)&entry.x, (const uint8_t*)(&entry.x + 1));
+				}
+				out.push_back(bytes);
+			}
+		}
+	}
+	{
+		uint8_t id[32] = {};
+		F1Calculator F1(id);
+		
+		std::vector<uint32_t> xs(100);
+		for(size_t i = 0; i < xs.size(); ++i) {
+			::memcpy(&xs[i], &data[i * 4], 4);
+		}
+		std::vector<entry_1> entries(xs.size());
+		F1.compute_entries(xs.data(), xs.size(), entries.data());
+		
+		std::vector<uint8_t> bytes;
+		for(const auto& entry : entries) {
+			bytes.insert(bytes.end(), (const uint8_t*)&entry.y, (const uint8_t*)(&entry.y + 1));
+		}
+		out.push_back(bytes);
+	}
+	for(const size_t length : {0, 1, 13, 21, 37, 63, 64}) {
+		std::vector<uint8_t> hash(19 * 32);
+		blake3_hash_short(data.data(), length, 19, hash.data());
+		out.push_back(hash);
+	}
+	for(const size_t length : {0, 1, 7, 8, 9, 4095, 65536}) {
+		const auto crc = crc32c(data.data(), length);
+		out.emplace_back((const uint8_t*)&crc, (const uint8_t*)(&crc + 1));
+	}
+	{
+		const size_t num_bits = data.size() * 8;
+		bitfield bits(num_bits);
+		for(size_t i = 0; i < num_bits; ++i) {
+			if(data[i / 8] & (1 << (i % 8))) {
+				bits.set(i);
+			}
+		}
+		for(const int64_t end : {int64_t(0), int64_t(63), int64_t(64), int64_t(1000), int64_t(num_bits)}) {
+			const auto count = bits.count(0, end);
+			out.emplace_back((const uint8_t*)&count, (const uint8_t*)(&count + 1));
+		}
+	}
+	check_codec<entry_1>(data, out);
+	check_codec<entry_7>(data, out);
+	check_codec<tmp_entry_1>(data, out);
+	check_codec<tmp_entry_x>(data, out);
+	check_codec<phase3::entry_lp>(data, out);
+	check_codec<phase3::entry_np>(data, out);
+	return out;
+}
+
+/*
+ * Checks that all kernels give the same output for any subset of the CPU features.
+ */
+int main(int argc, char** argv)
+{
+	const auto detected = detect_cpu_features();
+	std::cout << "Detected CPU features: " << cpu_features_to_string(detected) << std::endl;
+	
+	std::mt19937_64 generator(0);
+	std::vector<uint8_t> data(1 << 20);
+	for(auto& byte : data) {
+		byte = generator();
+	}
+	bool is_fail = false;
+	is_fail |= !check_disk_key<entry_1, get_y<entry_1>>(data, "entry_1");
+	is_fail |= !check_disk_key<entry_2, get_y<entry_2>>(data, "entry_2");
+	is_fail |= !check_disk_key<entry_3, get_y<entry_3>>(data, "entry_3");
+	is_fail |= !check_disk_key<entry_5, get_y<entry_5>>(data, "entry_5");
+	is_fail |= !check_disk_key<entry_7, get_y<entry_7>>(data, "entry_7");
+	is_fail |= !check_disk_key<phase2::entry_x, phase2::get_pos<phase2::entry_x>>(data, "phase2::entry_x");
+	is_fail |= !check_disk_key<phase3::entry_lp, phase3::get_line_point<phase3::entry_lp>>(data, "phase3::entry_lp");
+	is_fail |= !check_disk_key<phase3::entry_np, phase3::get_sort_key<phase3::entry_np>>(data, "phase3::entry_np");
+	
+	set_cpu_features("none");
+	const auto expected = compute(data);
+	if(!check_codecs(data)) {
+		std::cout << "none: FAILED" << std::endl;
+		is_fail = true;
+	}
+	
+	for(uint32_t features = 1; features <= CPU_ALL; ++features) {
+		if((features & detected) != features) {
+			continue;
+		}
+		const auto list = cpu_features_to_string(features);
+		set_cpu_features(list);
+		
+		const auto begin = get_wall_time_micros();
+		const auto out = compute(data);
+		const bool is_ok = out == expected && check_codecs(data);
+		std::cout << list << ": " << (is_ok ? "OK" : "FAILED")
+				<< " (" << (get_wall_time_micros() - begin) / 1e3 << " ms)" << std::endl;
+		if(!is_ok) {
+			is_fail = true;
+		}
+	}
+	set_cpu_features("native");
+	
+	if(is_fail) {
+		std::cout << "FAILED: kernel output differs from portable version or read() / write()" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -67,6 +67,7 @@ int main(int argc, char** argv)
 	
 	auto L_sort_np = std::make_shared<DiskSortNP>(
 			32, log_num_buckets, "test.p3s2.t2", false);
+	L_sort_np->set_dense_keys(true);
 	
 	num_written_final += compute_stage2(
 			1, num_threads, R_sort_lp.get(), L_sort_np.get(),
@@ -86,6 +87,7 @@ int main(int argc, char** argv)
 		
 		L_sort_np = std::make_shared<DiskSortNP>(
 				32, log_num_buckets, "test.p3s2." + R_t, false);
+		L_sort_np->set_dense_keys(true);
 		
 		num_written_final += compute_stage2(
 				L_index, num_threads, R_sort_lp.get(), L_sort_np.get(),
@@ -0,0 +1,80 @@
+/*
+ * test_predict.cpp
+ *
+ *  Created on: Jun 18, 2021
+ *      Author: mad
+ */
+
+#include <chia/predict.hpp>
+
+
+/*
+ * Compares the prediction with the reference run in README.md, for several seeds.
+ *
+ * The allowed error follows from the sampling error of match rate and used calibration:
+ * table i has up to i + 1 factors of the match rate in it, so its relative error is up to (i + 1) times larger.
+ * Each seed has to be within 4 sigma, the mean over all seeds within 4 sigma / sqrt(num_seeds).
+ *
+ * Usage: test_predict [num_seeds] [test.e2e.json]
+ */
+int main(int argc, char** argv)
+{
+	const int num_seeds = argc > 1 ? atoi(argv[1]) : 8;
+	
+	// entries written in phase 3 of the reference run
+	const std::array<double, 6> ref_used = {3429434057, 3439942310, 3466172090, 3532988739, 3713631348, 4294838936};
+	const double ref_plot_size = 108834390977;
+	
+	bool is_fail = false;
+	std::array<double, 7> sum_error = {};
+	std::array<double, 7> sum_bound = {};
+	
+	for(int seed = 0; seed < num_seeds; ++seed)
+	{
+		predict::input_t input;
+		input.seed = seed;
+		if(argc > 2) {
+			input.throughput.load(argv[2]);
+		}
+		predict::output_t out;
+		const auto time_begin = get_wall_time_micros();
+		predict::compute(input, out);
+		std::cout << "Seed " << seed << ": prediction took " << (get_wall_time_micros() - time_begin) / 1e6 << " sec" << std::endl;
+		if(seed == 0) {
+			predict::print(out);
+		}
+		if(!input.throughput.is_measured() && out.total_sec >= 0) {
+			std::cout << "FAILED: time predicted without measured throughput" << std::endl;
+			is_fail = true;
+		}
+		const double sigma_rate = out.match_rate_error / out.match_rate;
+		const double sigma_calib = out.used_calib_error / out.used_calib;
+		
+		for(int i = 1; i < 8; ++i) {
+			const auto error = i < 7 ? out.table[i].num_used / ref_used[i - 1] - 1 : out.plot_size / ref_plot_size - 1;
+			const auto bound = 4 * std::hypot((i + 1) * sigma_rate, sigma_calib);
+			std::cout << (i < 7 ? "Table " + std::to_string(i + 1) + " used" : std::string("Plot size")) << ": "
+					<< error * 100 << " % error (max " << bound * 100 << " %)" << std::endl;
+			if(std::abs(error) > bound) {
+				std::cout << "FAILED: more than 4 sigma error" << std::endl;
+				is_fail = true;
+			}
+			sum_error[i - 1] += error;
+			sum_bound[i - 1] += bound;
+		}
+	}
+	for(int i = 0; i < 7; ++i) {
+		const auto mean = sum_error[i] / num_seeds;
+		const auto bound = sum_bound[i] / num_seeds / std::sqrt(num_seeds);
+		if(std::abs(mean) > bound) {
+			std::cout << "FAILED: mean error " << mean * 100 << " % is more than " << bound * 100 << " %"
+					<< (i < 6 ? " for table " + std::to_string(i + 2) : std::string(" for plot size")) << std::endl;
+			is_fail = true;
+		}
+	}
+	if(is_fail) {
+		std::cout << "FAILED" << std::endl;
+		return 1;
+	}
+	return 0;
+}
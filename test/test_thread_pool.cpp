@@ -0,0 +1,125 @@
+/*
+ * test_thread_pool.cpp
+ *
+ *  Created on: Jun 26, 2021
+ *      Author: mad
+ */
+
+#include <chia/ThreadPool.h>
+
+#include <chrono>
+#include <vector>
+#include <iostream>
+
+
+/*
+ * Runs num_jobs jobs, where job fail_job throws, returns false on error.
+ * Jobs before fail_job are slow, such that later jobs finish first.
+ * The pool must fail, all jobs before fail_job must be output in order, and no output may be out of order.
+ */
+static bool test_job_failure(const int num_threads, const uint64_t num_jobs, const uint64_t fail_job)
+{
+	std::vector<uint64_t> order;
+	Thread<uint64_t> output([&order](uint64_t& job) {
+		order.push_back(job);
+	}, "test/output");
+	
+	bool is_fail = false;
+	try {
+		ThreadPool<uint64_t, uint64_t> pool(
+			[fail_job](uint64_t& job, uint64_t& out, size_t&) {
+				if(job == fail_job) {
+					throw std::runtime_error("job " + std::to_string(job) + " failed");
+				}
+				if(job < fail_job) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1 + (job * 7) % 5));
+				}
+				out = job;
+			}, &output, num_threads, "test/pool");
+		
+		for(uint64_t i = 0; i < num_jobs; ++i) {
+			pool.take_copy(i);
+		}
+		pool.close();
+	} catch(...) {
+		is_fail = true;
+	}
+	output.close();
+	
+	bool is_ok = is_fail;
+	if(order.size() < fail_job) {
+		is_ok = false;
+	}
+	for(size_t i = 0; i < order.size(); ++i) {
+		if(i < fail_job ? order[i] != i : (i && order[i] <= order[i - 1])) {
+			is_ok = false;
+		}
+		if(order[i] == fail_job) {
+			is_ok = false;
+		}
+	}
+	std::cout << "num_threads = " << num_threads << ", fail_job = " << fail_job
+			<< ": " << (is_ok ? "OK" : "FAILED") << " (" << (is_fail ? "aborted" : "not aborted") << ", output:";
+	for(size_t i = 0; i < std::min<size_t>(order.size(), fail_job + 4); ++i) {
+		std::cout << " " << order[i];
+	}
+	std::cout << (order.size() > fail_job + 4 ? " ...)" : ")") << std::endl;
+	return is_ok;
+}
+
+/*
+ * Same as above, but output fails at fail_job, which must not block the pool.
+ */
+static bool test_output_failure(const int num_threads, const uint64_t num_jobs, const uint64_t fail_job)
+{
+	std::vector<uint64_t> order;
+	Thread<uint64_t> output([&order, fail_job](uint64_t& job) {
+		if(job == fail_job) {
+			throw std::runtime_error("output failed");
+		}
+		order.push_back(job);
+	}, "test/output");
+	
+	ThreadPool<uint64_t, uint64_t> pool(
+		[](uint64_t& job, uint64_t& out, size_t&) {
+			out = job;
+		}, &output, num_threads, "test/pool");
+	
+	for(uint64_t i = 0; i < num_jobs; ++i) {
+		pool.take_copy(i);
+	}
+	pool.close();
+	
+	bool is_fail = false;
+	try {
+		output.close();
+	} catch(...) {
+		is_fail = true;
+	}
+	bool is_ok = is_fail && order.size() == fail_job;
+	for(size_t i = 0; i < order.size(); ++i) {
+		is_ok = is_ok && order[i] == i;
+	}
+	std::cout << "num_threads = " << num_threads << ", output fails at " << fail_job
+			<< ": " << (is_ok ? "OK" : "FAILED") << std::endl;
+	return is_ok;
+}
+
+/*
+ * Checks that a failing ThreadPool job aborts the pipeline, without losing or reordering output.
+ */
+int main(int argc, char** argv)
+{
+	bool is_ok = true;
+	for(const int num_threads : {1, 2, 4, 7}) {
+		for(const uint64_t fail_job : {0, 3, 20}) {
+			is_ok &= test_job_failure(num_threads, 100, fail_job);
+		}
+		is_ok &= test_output_failure(num_threads, 100, 20);
+	}
+	if(!is_ok) {
+		std::cout << "FAILED" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,371 @@
+/*
+ * test_verify.cpp
+ *
+ *  Created on: Jun 24, 2021
+ *      Author: mad
+ */
+
+#include <chia/PlotReader.hpp>
+#include <chia/BatchVerifier.hpp>
+#include <chia/cpu_features.h>
+
+#include "chia_ref/verifier.hpp"
+
+#include <random>
+#include <sstream>
+#include <iostream>
+
+typedef BatchVerifier::proof_t proof_t;
+typedef BatchVerifier::result_t result_t;
+
+
+/*
+ * Entry of a plot made by make_plot(), L and R point into the previous table (x for table 1).
+ */
+struct ref_entry_t {
+	uint64_t y = 0;
+	Bits meta;
+	uint64_t L = 0;
+	uint64_t R = 0;
+};
+
+static std::vector<uint8_t> get_proof_bytes(const proof_t& proof, const uint8_t k)
+{
+	if(k == BatchVerifier::default_k) {
+		return PlotReader::get_proof_bytes(std::vector<uint32_t>(proof.xs.begin(), proof.xs.end()));
+	}
+	LargeBits bits;
+	for(const auto x : proof.xs) {
+		bits += Bits(x, k);
+	}
+	std::vector<uint8_t> out(k * 8);
+	bits.ToBytes(out.data());
+	return out;
+}
+
+/*
+ * Validates via chia::Verifier::ValidateProof(), which prints the reason for every invalid proof.
+ */
+static result_t validate_ref(const proof_t& proof, const uint8_t k)
+{
+	std::ostringstream discard;
+	const auto prev = std::cerr.rdbuf(discard.rdbuf());
+	
+	chia::Verifier verifier;
+	const auto proof_bytes = get_proof_bytes(proof, k);
+	const auto quality = verifier.ValidateProof(
+			proof.id.data(), k, proof.challenge.data(), proof_bytes.data(), proof_bytes.size());
+	std::cerr.rdbuf(prev);
+	
+	result_t out;
+	out.valid = quality.GetSize() == 256;
+	if(out.valid) {
+		quality.ToBytes(out.quality.data());
+	}
+	return out;
+}
+
+/*
+ * Returns proof with one bit of a random x value flipped.
+ */
+static proof_t flip_x(proof_t proof, const uint8_t k, std::mt19937_64& generator)
+{
+	proof.xs[generator() % proof.xs.size()] ^= uint32_t(1) << (generator() % k);
+	return proof;
+}
+
+/*
+ * Returns proof with the two x values of a random pair swapped, ie. not in proof order anymore.
+ */
+static proof_t swap_pair(proof_t proof, std::mt19937_64& generator)
+{
+	const size_t i = (generator() % (proof.xs.size() / 2)) * 2;
+	std::swap(proof.xs[i], proof.xs[i + 1]);
+	return proof;
+}
+
+/*
+ * All cases derived from each proof, original first.
+ * Changing the last 5 bits of the challenge selects a different quality, which keeps a valid proof valid.
+ */
+static std::vector<proof_t> get_cases(const proof_t& proof, const uint8_t k, std::mt19937_64& generator)
+{
+	std::vector<proof_t> out;
+	out.push_back(proof);
+	out.push_back(flip_x(proof, k, generator));
+	out.push_back(swap_pair(proof, generator));
+	{
+		auto tmp = proof;
+		tmp.challenge[generator() % (k / 8)] ^= 1 << (generator() % 8);	// first k bits
+		out.push_back(tmp);
+	}
+	{
+		auto tmp = proof;
+		tmp.challenge[31] ^= 1 + (generator() % 31);
+		out.push_back(tmp);
+	}
+	{
+		auto tmp = proof;
+		tmp.id[generator() % tmp.id.size()] ^= 1 << (generator() % 8);
+		out.push_back(tmp);
+	}
+	return out;
+}
+
+static proof_t get_random_proof(const std::array<uint8_t, 32>& id, const uint8_t k, std::mt19937_64& generator)
+{
+	proof_t proof;
+	proof.id = id;
+	for(auto& byte : proof.challenge) {
+		byte = generator();
+	}
+	for(auto& x : proof.xs) {
+		x = uint32_t(generator()) >> (32 - k);
+	}
+	return proof;
+}
+
+/*
+ * Computes all tables of a k bit plot in memory via the reference code, only feasible for small k.
+ */
+static std::array<std::vector<ref_entry_t>, 7> make_plot(const uint8_t k, const std::array<uint8_t, 32>& id)
+{
+	std::array<std::vector<ref_entry_t>, 7> tables;
+	{
+		chia::F1Calculator F1(k, id.data());
+		for(uint64_t x = 0; x < (uint64_t(1) << k); ++x) {
+			const auto res = F1.CalculateBucket(Bits(x, k));
+			ref_entry_t entry;
+			entry.y = res.first.GetValue();
+			entry.meta = res.second;
+			entry.L = x;
+			tables[0].push_back(entry);
+		}
+	}
+	std::vector<uint16_t> idx_L(0x10000);
+	std::vector<uint16_t> idx_R(0x10000);
+	
+	for(int i = 1; i < 7; ++i)
+	{
+		auto& prev = tables[i - 1];
+		std::sort(prev.begin(), prev.end(),
+			[](const ref_entry_t& L, const ref_entry_t& R) -> bool {
+				return L.y < R.y;
+			});
+		chia::FxCalculator Fx(k, i + 1);
+		
+		// match each BC group with the next one
+		for(size_t begin = 0; begin < prev.size();)
+		{
+			size_t end = begin;
+			while(end < prev.size() && prev[end].y / kBC == prev[begin].y / kBC) {
+				end++;
+			}
+			size_t next_end = end;
+			while(next_end < prev.size() && prev[next_end].y / kBC == prev[begin].y / kBC + 1) {
+				next_end++;
+			}
+			if(next_end > end) {
+				std::vector<chia::PlotEntry> bucket_L(end - begin);
+				std::vector<chia::PlotEntry> bucket_R(next_end - end);
+				for(size_t j = 0; j < bucket_L.size(); ++j) {
+					bucket_L[j].y = prev[begin + j].y;
+				}
+				for(size_t j = 0; j < bucket_R.size(); ++j) {
+					bucket_R[j].y = prev[end + j].y;
+				}
+				const auto count = Fx.FindMatches(bucket_L, bucket_R, idx_L.data(), idx_R.data());
+				for(int j = 0; j < count; ++j) {
+					const auto& L = prev[begin + idx_L[j]];
+					const auto& R = prev[end + idx_R[j]];
+					const auto res = Fx.CalculateBucket(Bits(L.y, k + kExtraBits), L.meta, R.meta);
+					ref_entry_t entry;
+					entry.y = res.first.GetValue();
+					entry.meta = res.second;
+					entry.L = begin + idx_L[j];
+					entry.R = end + idx_R[j];
+					tables[i].push_back(entry);
+				}
+			}
+			begin = end;
+		}
+	}
+	return tables;
+}
+
+/*
+ * Collects the x values below entry index of table i + 1, in proof order.
+ */
+static void gather_xs(const std::array<std::vector<ref_entry_t>, 7>& tables, int i, uint64_t index, std::vector<uint32_t>& xs)
+{
+	const auto& entry = tables[i][index];
+	if(i == 0) {
+		xs.push_back(entry.L);
+	} else {
+		gather_xs(tables, i - 1, entry.L, xs);
+		gather_xs(tables, i - 1, entry.R, xs);
+	}
+}
+
+/*
+ * Returns num_proofs valid proofs from a plot made by make_plot(), the challenge starts with f7.
+ */
+static std::vector<proof_t> get_plot_proofs(const uint8_t k, const std::array<uint8_t, 32>& id,
+											const size_t num_proofs, std::mt19937_64& generator)
+{
+	const auto tables = make_plot(k, id);
+	const auto& table_7 = tables[6];
+	
+	std::vector<proof_t> out;
+	for(size_t i = 0; i < num_proofs && i < table_7.size(); ++i)
+	{
+		const uint64_t index = (table_7.size() / num_proofs) * i;
+		std::vector<uint32_t> xs;
+		gather_xs(tables, 6, index, xs);
+		
+		proof_t proof;
+		proof.id = id;
+		std::copy(xs.begin(), xs.end(), proof.xs.begin());
+		for(auto& byte : proof.challenge) {
+			byte = generator();
+		}
+		Bits(table_7[index].y >> kExtraBits, k).ToBytes(proof.challenge.data());
+		out.push_back(proof);
+	}
+	std::cout << "k" << int(k) << " plot: " << tables[0].size() << " entries, "
+			<< table_7.size() << " in table 7 (" << out.size() << " proofs)" << std::endl;
+	return out;
+}
+
+/*
+ * Tests all cases of each proof, plus random proofs, returns true on failure.
+ * The batch is shuffled, such that proofs of several plot ids are mixed.
+ */
+static bool test_proofs(const uint8_t k, std::vector<proof_t> base, const size_t num_random, const bool need_valid,
+						std::mt19937_64& generator)
+{
+	for(size_t j = 0; j < 4; ++j) {
+		std::array<uint8_t, 32> id;
+		for(auto& byte : id) {
+			byte = generator();
+		}
+		for(size_t i = 0; i < num_random; ++i) {
+			base.push_back(get_random_proof(id, k, generator));
+		}
+	}
+	std::vector<proof_t> proofs;
+	for(const auto& proof : base) {
+		const auto list = get_cases(proof, k, generator);
+		proofs.insert(proofs.end(), list.begin(), list.end());
+	}
+	std::shuffle(proofs.begin(), proofs.end(), generator);
+	
+	size_t num_valid = 0;
+	std::vector<result_t> expected;
+	for(const auto& proof : proofs) {
+		expected.push_back(validate_ref(proof, k));
+		num_valid += expected.back().valid;
+	}
+	std::cout << "[k" << int(k) << "] Proofs: " << proofs.size() << " (" << num_valid << " valid)" << std::endl;
+	
+	bool is_fail = false;
+	if(need_valid && !num_valid) {
+		std::cout << "FAILED: no valid proofs" << std::endl;
+		is_fail = true;
+	}
+	// quality string of any proof, not only valid ones
+	size_t num_quality_fail = 0;
+	for(const auto& proof : proofs) {
+		const auto proof_bytes = get_proof_bytes(proof, k);
+		const auto quality = chia::Verifier::GetQualityString(k,
+				LargeBits(proof_bytes.data(), proof_bytes.size(), proof_bytes.size() * 8),
+				(proof.challenge[31] & 0x1F) * 2, proof.challenge.data());
+		std::array<uint8_t, 32> bytes = {};
+		quality.ToBytes(bytes.data());
+		if(BatchVerifier::get_quality(proof, k) != bytes) {
+			num_quality_fail++;
+		}
+	}
+	std::cout << "[k" << int(k) << "] get_quality(): " << (num_quality_fail ? "FAILED" : "OK") << std::endl;
+	is_fail |= num_quality_fail;
+	
+	for(const std::string features : {"none", "native"})
+	{
+		set_cpu_features(features);
+		const auto results = BatchVerifier(k).validate(proofs);
+		
+		size_t num_fail = 0;
+		for(size_t i = 0; i < proofs.size(); ++i) {
+			if(results[i].valid != expected[i].valid
+				|| (expected[i].valid && results[i].quality != expected[i].quality))
+			{
+				num_fail++;
+			}
+		}
+		std::cout << "[k" << int(k) << "] " << features << ": " << (num_fail ? "FAILED" : "OK");
+		if(num_fail) {
+			std::cout << " (" << num_fail << " proofs differ)";
+		}
+		std::cout << std::endl;
+		is_fail |= num_fail;
+	}
+	set_cpu_features("native");
+	return is_fail;
+}
+
+/*
+ * Checks BatchVerifier::validate() against chia::Verifier::ValidateProof(), for CPU features "none" and "native".
+ * Valid proofs come from a k16 plot made in memory via the reference code, which runs the same code as k32.
+ * Valid k32 proofs are taken from a plot if given, since they cannot be made without one.
+ * Each proof is tested as is, with an x value flipped, with a pair swapped,
+ * with a wrong challenge, with a different quality index and with a wrong plot id.
+ *
+ * Usage: test_verify [file.plot] [num_proofs]
+ */
+int main(int argc, char** argv)
+{
+	const std::string file_name = argc > 1 ? argv[1] : "";
+	const size_t num_proofs = argc > 2 ? atoi(argv[2]) : 20;
+	
+	phase1::initialize();
+	std::mt19937_64 generator(0);
+	
+	bool is_fail = false;
+	{
+		std::array<uint8_t, 32> id;
+		for(auto& byte : id) {
+			byte = generator();
+		}
+		const uint8_t k = 16;
+		is_fail |= test_proofs(k, get_plot_proofs(k, id, num_proofs, generator), num_proofs, true, generator);
+	}
+	
+	std::vector<proof_t> base;
+	if(!file_name.empty()) {
+		const PlotReader plot(file_name);
+		for(size_t num_challenges = 0; base.size() < num_proofs && num_challenges < 10 * num_proofs; ++num_challenges)
+		{
+			proof_t proof;
+			proof.id = plot.get_plot_id();
+			for(auto& byte : proof.challenge) {
+				byte = generator();
+			}
+			const auto list = plot.get_qualities(proof.challenge.data());
+			for(size_t i = 0; i < list.size() && base.size() < num_proofs; ++i) {
+				const auto xs = plot.get_full_proof(proof.challenge.data(), i);
+				std::copy(xs.begin(), xs.end(), proof.xs.begin());
+				base.push_back(proof);
+			}
+		}
+		std::cout << "Plot: " << file_name << " (" << base.size() << " proofs)" << std::endl;
+	} else {
+		std::cout << "No plot given, only invalid k32 proofs are tested" << std::endl;
+	}
+	is_fail |= test_proofs(BatchVerifier::default_k, base, num_proofs, !file_name.empty(), generator);
+	
+	if(is_fail) {
+		std::cout << "FAILED: BatchVerifier differs from reference" << std::endl;
+		return 1;
+	}
+	return 0;
+}